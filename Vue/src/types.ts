@@ -21,6 +21,8 @@ export interface DataMethods {
   deletePage(page: number): void;
   importCSV(file: File): Promise<any>;
   exportCSV(): Promise<any>;
+  importStatement(): Promise<any>;
+  bookPath(): Promise<string | undefined>;  /* vueRunner 上でなければ undefined */
 }
 
 export interface CardEntry {
@@ -1,99 +1,175 @@
 import { nextTick } from "vue"
+import type { DataEntry } from "./types.ts"
+
+/*  undo/redo で実行する操作（DataMethods と同じ語彙）  */
+export type UndoOp =
+  { op: "setValue", page: number, row: number, key: keyof DataEntry, value?: string | number | boolean } |
+  { op: "insertRow", page: number, row: number, entry: DataEntry } |
+  { op: "deleteRow", page: number, row: number } |
+  { op: "insertPage", page: number } |
+  { op: "deletePage", page: number };
+
+export interface UndoStatus {
+  canUndo: boolean;
+  canRedo: boolean;
+}
+
+/*  undo/redo の結果：ops を順に実行する  */
+export interface UndoResult extends UndoStatus {
+  ops: UndoOp[];
+  /*  家計簿が他の手段で変更されていたため、履歴を破棄した  */
+  stale?: boolean;
+}
+
+/*  undo 履歴の保存先（サーバ側のジャーナル）  */
+export interface UndoStore {
+  record(ops: UndoOp[], inverse: UndoOp[]): Promise<UndoStatus>;
+  undo(): Promise<UndoResult>;
+  redo(): Promise<UndoResult>;
+  status(): Promise<UndoStatus>;
+}
+
 export class UndoManager {
-  /*  undoスタック: 引数なし、戻り値なしの関数の配列の配列  */
-  undoStack: (()=>void)[][];
-  /*  redoスタック: 引数なし、戻り値なしの関数の配列の配列  */
-  redoStack: (()=>void)[][];
-  /*  undo実行中か？ 0:どちらでもない、1:undo中、2:redo中  */
-  undoOrRedo: number = 0;
-  /*  一時的な undo/redo スタック：nextTick 時に redoStack または undoStack に乗せる  */
-  temporaryUndos: (()=>void)[];
-  temporaryRedos: (()=>void)[];
-  /*  コンストラクタ  */
-  constructor() {
-    this.undoStack = [];
-    this.redoStack = [];
-    this.temporaryUndos = [];
-    this.temporaryRedos = [];
+  /*  履歴の保存先。undefined ならメモリ上に保持する（最大 maxLocalSteps 段階）  */
+  store: UndoStore | undefined = undefined;
+  maxLocalSteps: number = 100;
+  /*  メモリ上の undo/redo スタック：１段階は [操作, 逆操作]  */
+  undoStack: [UndoOp[], UndoOp[]][] = [];
+  redoStack: [UndoOp[], UndoOp[]][] = [];
+  /*  undo/redo が可能か（サーバから返された状態）  */
+  undoAvailable: boolean = false;
+  redoAvailable: boolean = false;
+  /*  undo/redo 実行中か？ 実行中の操作は登録しない  */
+  busy: boolean = false;
+  /*  登録中の１段階分：nextTick 時にまとめて保存する  */
+  temporaryOps: UndoOp[] = [];
+  temporaryInverses: UndoOp[] = [];
+  pendingSave: Promise<void> | undefined = undefined;
+
+  /*  操作を実行する関数（undo/redo 時に呼ばれる）  */
+  applyOp: ((op: UndoOp, isUndoing: boolean) => void) | undefined = undefined;
+  /*  undo, redo 時に事前・事後に実行する内容  */
+  beforeUndoOrRedo: ((isUndoing: boolean) => void) | undefined = undefined;
+  afterUndoOrRedo: ((isUndoing: boolean) => void) | undefined = undefined;
+
+  /*  保存先を設定し、状態を読み込む  */
+  async setStore(store: UndoStore | undefined) {
+    this.store = store;
+    await this.refresh();
   }
-  /*  undo動作を登録  */
-  registerUndo(action: ()=>void) {
-    if (this.temporaryUndos.length == 0 && this.temporaryRedos.length == 0) {
-      let tempUndoOrRedo = this.undoOrRedo;  /* 一時変数にコピーしてアロー関数に渡す */
-      nextTick(() => {
-        if (tempUndoOrRedo == 1) {
-          this.redoStack.push(this.temporaryRedos);
-          this.temporaryRedos = [];
-        } else {
-          this.undoStack.push(this.temporaryUndos);
-          this.temporaryUndos = [];
-          if (tempUndoOrRedo == 0) {
-            /* 通常の動作(undo中でもredo中でもない)なら redoStack をクリアする */
-            this.redoStack.length = 0;
-          }
-        }
-      });
-    }
-    if (this.undoOrRedo == 1) {
-      this.temporaryRedos.push(action);
+
+  /*  状態を読み直す（家計簿を切り替えた時など）  */
+  async refresh() {
+    if (this.store !== undefined) {
+      const st = await this.store.status();
+      this.undoAvailable = st.canUndo;
+      this.redoAvailable = st.canRedo;
     } else {
-      this.temporaryUndos.push(action);
+      this.undoAvailable = (this.undoStack.length > 0);
+      this.redoAvailable = (this.redoStack.length > 0);
     }
   }
 
-  /*  undo, redo 時に事前・事後に実行する内容  */
-  beforeUndoOrRedo: ((isUndoing: boolean) => void) | undefined = undefined;
-  afterUndoOrRedo: ((isUndoing: boolean) => void) | undefined = undefined;
+  /*  操作 op と、それを取り消す操作 inverse を登録  */
+  registerUndo(op: UndoOp, inverse: UndoOp) {
+    if (this.busy) {
+      return;
+    }
+    if (this.temporaryOps.length == 0) {
+      this.pendingSave = new Promise<void>((resolve) => {
+        nextTick(async () => {
+          await this.saveStep();
+          resolve();
+        });
+      });
+    }
+    this.temporaryOps.push(op);
+    this.temporaryInverses.push(inverse);
+  }
 
-  /*  undo を１段階実行  */
-  doUndo() {
-    this.undoOrRedo = 1;
-    let actions = this.undoStack.pop();
-    if (actions) {
-      if (this.beforeUndoOrRedo !== undefined) {
-        this.beforeUndoOrRedo(true);
-      }
-      while (actions.length > 0) {
-        let action = actions.pop();
-        if (action) {
-          action();
-        }
-      }
-      if (this.afterUndoOrRedo !== undefined) {
-        this.afterUndoOrRedo(true);
+  /*  登録した操作を１段階として保存する  */
+  async saveStep() {
+    const ops = this.temporaryOps;
+    const inverses = this.temporaryInverses.reverse();  /* 逆順に実行する */
+    this.temporaryOps = [];
+    this.temporaryInverses = [];
+    if (ops.length == 0) {
+      return;
+    }
+    if (this.store !== undefined) {
+      const st = await this.store.record(ops, inverses);
+      this.undoAvailable = st.canUndo;
+      this.redoAvailable = st.canRedo;
+    } else {
+      this.undoStack.push([ops, inverses]);
+      if (this.undoStack.length > this.maxLocalSteps) {
+        this.undoStack.shift();
       }
+      this.redoStack.length = 0;
+      await this.refresh();
     }
-    this.undoOrRedo = 0;
   }
 
-  /*  redo を１段階実行  */
-  doRedo() {
-    this.undoOrRedo = 2;
-    let actions = this.redoStack.pop();
-    if (actions) {
+  async doUndoOrRedo(isUndoing: boolean) {
+    if (this.busy) {
+      return;
+    }
+    if (this.pendingSave !== undefined) {
+      await this.pendingSave;
+      this.pendingSave = undefined;
+    }
+    let ops: UndoOp[] | undefined;
+    if (this.store !== undefined) {
+      const res = await (isUndoing ? this.store.undo() : this.store.redo());
+      this.undoAvailable = res.canUndo;
+      this.redoAvailable = res.canRedo;
+      ops = res.ops;
+    } else {
+      const step = (isUndoing ? this.undoStack : this.redoStack).pop();
+      if (step) {
+        (isUndoing ? this.redoStack : this.undoStack).push(step);
+        ops = (isUndoing ? step[1] : step[0]);
+      }
+      await this.refresh();
+    }
+    if (ops === undefined || ops.length == 0) {
+      return;
+    }
+    this.busy = true;
+    try {
       if (this.beforeUndoOrRedo !== undefined) {
-        this.beforeUndoOrRedo(false);
+        this.beforeUndoOrRedo(isUndoing);
       }
-      while (actions.length > 0) {
-        let action = actions.pop();
-        if (action) {
-          action();
+      for (const op of ops) {
+        if (this.applyOp !== undefined) {
+          this.applyOp(op, isUndoing);
         }
       }
       if (this.afterUndoOrRedo !== undefined) {
-        this.afterUndoOrRedo(false);
+        this.afterUndoOrRedo(isUndoing);
       }
+    } finally {
+      this.busy = false;
     }
-    this.undoOrRedo = 0;
+  }
+
+  /*  undo を１段階実行  */
+  async doUndo() {
+    await this.doUndoOrRedo(true);
+  }
+
+  /*  redo を１段階実行  */
+  async doRedo() {
+    await this.doUndoOrRedo(false);
   }
 
   /*  undo可能か？  */
   canUndo(): boolean {
-    return (this.undoStack.length > 0);
+    return this.undoAvailable || this.temporaryOps.length > 0;
   }
 
   /*  redo可能か？  */
   canRedo(): boolean {
-    return (this.redoStack.length > 0);
+    return this.redoAvailable && this.temporaryOps.length == 0;
   }
 }
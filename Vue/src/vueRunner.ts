@@ -1,3 +1,6 @@
+import type { DataEntry, DataType, Settings } from "./types.ts"
+import type { UndoOp, UndoStatus, UndoResult, UndoStore } from "./undoManager.ts"
+
 let vueRunnerId: string | null;
 
 //  If id is specified in the document URL, then update vueRunnerId
@@ -9,15 +12,15 @@ if (id !== undefined) {
 }
 
 function fetchVueRunner(args: object) {
-  if (vueRunnerId !== undefined) {
-    args = {...args, id: vueRunnerId};
+  /*  id はヘッダで送る（サーバは本体を読む前に、接続ごとに一度だけ確かめる）  */
+  const headers: Record<string, string> = { "Content-Type": "application/json" };
+  if (vueRunnerId) {
+    headers["X-VueRunner-Id"] = vueRunnerId;
   }
   return fetch("/@vueRunner/", {
     method: "POST",
     body: JSON.stringify(args),
-    headers: {
-      "Content-Type": "application/json",
-    }
+    headers: headers
   })
 }
 
@@ -66,6 +69,33 @@ export async function vExists(path: string): Promise<boolean> {
   }
 }
 
+export interface FileStat {
+  exists: boolean;
+  type?: string;    /* "file" または "dir" */
+  size?: number;
+  mtime?: number;   /* 更新時刻（1970年からの秒数） */
+}
+
+/*  ファイルの情報を得る（~/kakeibo 以下はサーバ側でキャッシュされる）  */
+export async function vStat(path: string): Promise<FileStat> {
+  const res = await fetchVueRunner({ cmd: "stat", path: path });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { exists: false };
+  }
+}
+
+/*  複数のファイルの情報を一度に得る  */
+export async function vStatMany(paths: string[]): Promise<FileStat[]> {
+  const res = await fetchVueRunner({ cmd: "stat", paths: paths });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return paths.map(() => ({ exists: false }));
+  }
+}
+
 export async function vCreate(path: string): Promise<boolean> {
   const res = await fetchVueRunner({ cmd: "create", path: path });
   if (res.ok) {
@@ -84,6 +114,32 @@ export async function vRename(oldPath: string, newPath: string): Promise<boolean
   }
 }
 
+/*  path の現在の内容を backup として残す（書き込み待ちの内容は先に書き込む）。
+    可能ならハードリンクにするので、内容が同じなら容量を使わない  */
+export async function vBackup(path: string, backup: string): Promise<boolean> {
+  const res = await fetchVueRunner({ cmd: "backup", path: path, backup: backup });
+  if (res.ok) {
+    return (await res.json()).ok === true;
+  } else {
+    return false;
+  }
+}
+
+export interface MaintenanceStatus {
+  jobs: { name: string; runs: number; slices: number; cpuUsec: number; lastRun: number; nextRun: number }[];
+  problems: { [path: string]: string };   /* 読み込めない家計簿ファイルとその理由 */
+}
+
+/*  サーバ側の定期保守（バックアップ・ローテーションなど）の状態。run を指定するとそのジョブをすぐに予定する  */
+export async function vMaintenance(run?: string): Promise<MaintenanceStatus | undefined> {
+  const res = await fetchVueRunner({ cmd: "maintenance", run: run });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return undefined;
+  }
+}
+
 export async function vRemove(path: string): Promise<boolean> {
   const res = await fetchVueRunner({ cmd: "remove", path: path });
   if (res.ok) {
@@ -102,6 +158,134 @@ export async function vReadTextFile(path: string): Promise<string> {
   }
 }
 
+/*  手元のデータと一致している家計簿の版（changesSince の起点）  */
+/*  version はサーバを起動してから数えるので、epoch（サーバの起動ごとに変わる）と組で使う  */
+interface BookSyncPoint {
+  epoch: number;
+  version: number;
+}
+const bookSyncPoints: { [path: string]: BookSyncPoint } = {};
+
+/*  こちらの編集を反映した版が返されたら、起点をそこまで進める（自分の編集を changesSince で受け取り直さない）  */
+/*  epoch が変わっていれば、サーバ側の家計簿はこちらの送った内容で作り直されている  */
+function advanceSyncPoint(path: string, epoch?: number, version?: number) {
+  const point = bookSyncPoints[path];
+  if (point === undefined || epoch === undefined || version === undefined || !(epoch > 0 && version > 0)) {
+    return;
+  }
+  if (epoch !== point.epoch || version > point.version) {
+    bookSyncPoints[path] = { epoch: epoch, version: version };
+  }
+}
+
+/*  家計簿ファイルを読む（サーバ側でも解析して保持する）  */
+export async function vOpenBook(path: string): Promise<string> {
+  const res = await fetchVueRunner({ cmd: "openBook", path: path });
+  if (res.ok) {
+    const epoch = Number(res.headers.get("X-Book-Epoch"));
+    const version = Number(res.headers.get("X-Book-Version"));
+    if (epoch > 0 && version > 0) {
+      bookSyncPoints[path] = { epoch: epoch, version: version };
+    } else {
+      delete bookSyncPoints[path];
+    }
+    return await res.text();
+  } else if (res.status === 500) {
+    /*  年ごと・ログ形式で保存した家計簿の一部が壊れている  */
+    throw new Error(await res.text());
+  } else {
+    return "";
+  }
+}
+
+/*  家計簿の保存形式。"single" は kakeibo.csv １つ、"sharded" は年（yearStart 月始まり）ごとのファイルに分ける、  */
+/*  "log" は変わった月だけをログに追記する（ログが大きくなるとバックグラウンドでまとめ直す）  */
+export type BookLayoutName = "single" | "sharded" | "log";
+export interface BookLayout {
+  layout: BookLayoutName;
+  yearStart?: number;
+  segments?: { key: string, file: string, size: number, rows: number, xxh64: string }[];
+  generation?: number;
+  logBytes?: number;
+  deadBytes?: number;
+  months?: number;
+  error?: string;
+}
+
+/*  家計簿の保存形式を調べる。layout を指定すると変換する（内容は変わらない）  */
+export async function vBookLayout(path: string, layout?: BookLayoutName, yearStart?: number): Promise<BookLayout | undefined> {
+  const res = await fetchVueRunner({ cmd: "bookLayout", path: path, layout: layout, yearStart: yearStart });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return undefined;
+  }
+}
+
+/*  wxvuerunner.log に書く水準  */
+export type LogLevelName = "off" | "error" | "warn" | "info" | "debug" | "trace";
+
+/*  ログの水準を調べる。level を指定すると変更する  */
+export async function vLogLevel(level?: LogLevelName): Promise<LogLevelName | undefined> {
+  const res = await fetchVueRunner({ cmd: "logLevel", level: level });
+  if (res.ok) {
+    const obj = await res.json();
+    return obj.level;
+  } else {
+    return undefined;
+  }
+}
+
+/*  ある版以降に変わった月（行はすべて）と、なくなった月  */
+export interface BookChanges {
+  epoch: number;
+  version?: number;
+  current?: boolean;        /* 手元の版が最新 */
+  full?: boolean;           /* 差分が作れないので、openBook で読み直す必要がある */
+  pages?: { ym: number, version: number, rows: DataEntry[] }[];
+  removed?: number[];
+  settings?: Settings;      /* 収入・支出の内訳かカードが変わったときだけ */
+  error?: string;
+}
+
+/*  vOpenBook で読んだ後に変わった部分を得る。refresh ならサーバはファイルを読み直してから比べる  */
+/*  （アプリの外で編集された場合）。起点がなければ undefined  */
+export async function vChangesSince(path: string, refresh?: boolean): Promise<BookChanges | undefined> {
+  const point = bookSyncPoints[path];
+  if (point === undefined) {
+    return undefined;
+  }
+  const res = await fetchVueRunner({ cmd: "changesSince", book: path, epoch: point.epoch, version: point.version, refresh: refresh ?? false });
+  if (!res.ok) {
+    return undefined;
+  }
+  const changes: BookChanges = await res.json();
+  if (changes.version !== undefined && !changes.full && changes.error === undefined) {
+    bookSyncPoints[path] = { epoch: changes.epoch, version: changes.version };
+  }
+  return changes;
+}
+
+/*  vChangesSince の結果を data に反映する。何か変わったら true  */
+/*  keep(ym) が true の月（サーバ側にまだ反映されていない編集がある月）はそのまま残す  */
+export function applyBookChanges(data: DataType, changes: BookChanges, keep?: (ym: number) => boolean): boolean {
+  let changed = false;
+  for (const page of changes.pages ?? []) {
+    if (keep?.(page.ym)) {
+      continue;
+    }
+    data[page.ym] = page.rows;   /* date が 0 の行には date がない (undefined) */
+    changed = true;
+  }
+  for (const ym of changes.removed ?? []) {
+    if (data[ym] !== undefined && !keep?.(ym)) {
+      delete data[ym];
+      changed = true;
+    }
+  }
+  return changed;
+}
+
 export async function vWriteTextFile(path: string, text: string): Promise<boolean> {
   const res = await fetchVueRunner({ cmd: "writeTextFile", path: path, text: text });
   if (res.ok) {
@@ -111,6 +295,36 @@ export async function vWriteTextFile(path: string, text: string): Promise<boolea
   }
 }
 
+export interface SaveStatus {
+  generation: number;       /* この書き込み要求の世代番号 */
+  savedGeneration: number;  /* ディスクに書き込み済みの世代番号 */
+  epoch?: number;           /* scheduleSave のみ：内容がサーバ側の家計簿に反映された後の版 */
+  version?: number;
+}
+
+/*  サーバ側で書き込みを予約する（まとめて書き込まれる）  */
+/*  応答は内容がサーバ側の家計簿 (BookStore) に反映されてから返る  */
+export async function vScheduleSave(path: string, text: string): Promise<SaveStatus | undefined> {
+  const res = await fetchVueRunner({ cmd: "scheduleSave", path: path, text: text });
+  if (res.ok) {
+    const status: SaveStatus = await res.json();
+    advanceSyncPoint(path, status.epoch, status.version);
+    return status;
+  } else {
+    return undefined;
+  }
+}
+
+/*  予約された書き込みを直ちに実行する（path を省略するとすべて）  */
+export async function vFlushSaves(path?: string): Promise<boolean> {
+  const res = await fetchVueRunner({ cmd: "flushSaves", path: path });
+  if (res.ok) {
+    return (await res.json()).ok === true;
+  } else {
+    return false;
+  }
+}
+
 export async function vReadDir(path: string): Promise<string[]> {
   const res = await fetchVueRunner({ cmd: "readDir", path: path });
   if (res.ok) {
@@ -121,8 +335,26 @@ export async function vReadDir(path: string): Promise<string[]> {
   }
 }
 
-export async function vSaveDialog(options?: object): Promise<string> {
-  const res = await fetchVueRunner({ cmd: "saveDialog", options: options });
+export interface DirStatEntry {
+  name: string;
+  type: string;   /* "file", "dir", "link", "other" */
+  size: number;
+  mtime: number;  /* 更新時刻（1970年からの秒数） */
+}
+
+/*  ディレクトリの内容を種類・サイズ・更新時刻付きで得る（pattern は * と ? が使えるグロブ）  */
+export async function vReadDirStat(path: string, pattern?: string): Promise<DirStatEntry[]> {
+  const res = await fetchVueRunner({ cmd: "readDirStat", path: path, pattern: pattern });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return [];
+  }
+}
+
+/*  ファイルダイアログ (cmd は saveDialog または openDialog)  */
+async function vFileDialog(cmd: string, options?: object): Promise<string> {
+  const res = await fetchVueRunner({ cmd: cmd, options: options });
   //  res は event-stream
   const reader = res.body?.getReader();
   const decoder = new TextDecoder();
@@ -130,7 +362,7 @@ export async function vSaveDialog(options?: object): Promise<string> {
     if (reader !== undefined) {
       while (true) {
         const {done, value} = await reader.read();
-        console.log(`vSaveDialog: done=${done}, value=${value}\n`);
+        console.log(`${cmd}: done=${done}, value=${value}\n`);
         if (done)
           break;
         if (!value)
@@ -138,9 +370,9 @@ export async function vSaveDialog(options?: object): Promise<string> {
         const lines = decoder.decode(value);
         let [ type, text ] = lines.split(": ");
         if (type === "data") {
-          //  text may be an empty string (the save dialog was canceled)
+          //  text may be an empty string (the dialog was canceled)
           text = text.trim();
-          console.log(`vSaveDialog: resolve(${text})\n`);
+          console.log(`${cmd}: resolve(${text})\n`);
           resolve(text);
           return;
         }
@@ -151,6 +383,294 @@ export async function vSaveDialog(options?: object): Promise<string> {
   });
 }
 
+export async function vSaveDialog(options?: object): Promise<string> {
+  return vFileDialog("saveDialog", options);
+}
+
+export async function vOpenDialog(options?: object): Promise<string> {
+  return vFileDialog("openDialog", options);
+}
+
+/*  書き出す範囲（省略した項目はすべて）  */
+export interface ExportOptions {
+  from?: number;          /* 開始年月 (YYYYMM) */
+  to?: number;            /* 終了年月 (YYYYMM, この月を含む) */
+  isIncome?: boolean;
+  kinds?: string[];
+  cards?: string[];
+  withSettings?: boolean; /* 費目・カードの設定も書き出す（既定値は true） */
+  gzip?: boolean;
+}
+
+export interface ExportSummary {
+  ok: boolean;
+  rows: number;
+  bytes: number;
+  fileBytes: number;
+  error?: string;
+}
+
+/*  サーバ側で保持している家計簿 (book) をファイル (path) に直接書き出す  */
+export async function vExportRange(book: string, path: string, options?: ExportOptions): Promise<ExportSummary> {
+  const res = await fetchVueRunner({ ...options, cmd: "exportRange", book: book, path: path });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { ok: false, rows: 0, bytes: 0, fileBytes: 0 };
+  }
+}
+
+/*  行の検索条件（省略した項目は条件なし）  */
+export interface RowQuery {
+  from?: string | number;   /* 開始日 ("2024-01-05" または 20240105) */
+  to?: string | number;     /* 終了日（この日を含む） */
+  isIncome?: boolean;
+  minAmount?: number;
+  maxAmount?: number;
+  kinds?: string[];
+  cards?: string[];
+  item?: string;            /* 項目に含まれる文字列 */
+  sort?: "date" | "amount";
+  descending?: boolean;
+  offset?: number;
+  limit?: number;           /* 既定値は 100 */
+}
+
+/*  検索結果の１行。ym, index は data.value[ym][index] の位置  */
+export interface FoundRow extends DataEntry {
+  ym: number;
+  index: number;
+}
+
+export interface QueryResult {
+  rows: FoundRow[];
+  total: number;            /* offset, limit を適用する前の件数 */
+  version?: number;
+}
+
+/*  サーバ側で保持している家計簿 (book) から行を検索する  */
+export async function vQueryRows(book: string, query: RowQuery): Promise<QueryResult> {
+  const res = await fetchVueRunner({ ...query, cmd: "queryRows", book: book });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { rows: [], total: 0 };
+  }
+}
+
+export interface SumResult {
+  sum: number;
+  count: number;
+  /* groupBy を指定したとき：費目名・カード名・年月 (YYYYMM) ごとの集計 */
+  groups?: {[key: string]: { sum: number, count: number }};
+  version?: number;
+}
+
+/*  条件に合う行の金額の合計（サーバ側のビットマップ索引を使う）  */
+export async function vSumRows(book: string, query: RowQuery, groupBy?: "kind" | "card" | "month"): Promise<SumResult> {
+  const res = await fetchVueRunner({ ...query, cmd: "sumRows", book: book, groupBy: groupBy });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { sum: 0, count: 0 };
+  }
+}
+
+/*  月ごと・年度ごとの集計。kinds の金額は収入が正、支出が負  */
+export interface RollupTotals {
+  income: number;
+  payment: number;
+  balance: number;
+  rows: number;
+  kinds: {[kind: string]: number};
+}
+
+export interface FiscalRollupResult {
+  /*  キーは年月 (YYYYMM)  */
+  months: {[ym: string]: RollupTotals};
+  /*  キーは年度（4月始まり）  */
+  years: {[year: string]: RollupTotals};
+  version?: number;
+  usec?: number;
+}
+
+/*  年度 from〜to の集計（サーバ側で月ごとに並列に集計する）  */
+export async function vFiscalRollup(book: string, from?: number, to?: number, parallel?: boolean): Promise<FiscalRollupResult> {
+  const res = await fetchVueRunner({ cmd: "fiscalRollup", book: book, from: from, to: to, parallel: parallel });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { months: {}, years: {} };
+  }
+}
+
+/*  家計簿の集計（月・年度・カードの月ごと）。ファイルが変わっていなければ
+    サイドカー (rollup.cache) から読むので、家計簿の読み込みを待たずに使える  */
+export interface CachedRollupResult extends FiscalRollupResult {
+  /*  カード名 → 年月 (YYYYMM) → その月の請求額（CardTab の cardSum と同じ行の合計）  */
+  cards: {[card: string]: {[ym: string]: number}};
+  source?: "store" | "sidecar" | "file";
+  error?: string;
+}
+
+export async function vCachedRollup(book: string): Promise<CachedRollupResult> {
+  const res = await fetchVueRunner({ cmd: "cachedRollup", book: book });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { months: {}, years: {}, cards: {} };
+  }
+}
+
+/*  全家計簿の集計。kindMap で費目名を読み替える：
+    { "外食": "食費", ..., books: { "家計簿名": { "おやつ": "食費" } } }
+    （省略時は ~/kakeibo/kindMap.json）  */
+export interface ConsolidatedResult extends FiscalRollupResult {
+  books: { name: string, rows?: number, source?: "store" | "cache" | "file", error?: string }[];
+}
+
+export async function vConsolidatedRollup(kindMap?: object, from?: number, to?: number): Promise<ConsolidatedResult> {
+  const res = await fetchVueRunner({ cmd: "consolidatedRollup", kindMap: kindMap, from: from, to: to });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return { months: {}, years: {}, books: [] };
+  }
+}
+
+/*  undo 履歴（サーバ側で家計簿ごとにファイルに保存される）  */
+/*  recordUndo, undo, redo の操作がサーバ側の家計簿に適用されたら、その版 (epoch, version) も返される  */
+async function fetchUndo(cmd: string, book: string, params?: object): Promise<any> {
+  const res = await fetchVueRunner({ ...params, cmd: cmd, book: book });
+  if (res.ok) {
+    const result = await res.json();
+    advanceSyncPoint(book, result.epoch, result.version);
+    return result;
+  } else {
+    return { canUndo: false, canRedo: false, ops: [] };
+  }
+}
+
+export async function vRecordUndo(book: string, ops: UndoOp[], inverse: UndoOp[]): Promise<UndoStatus> {
+  return await fetchUndo("recordUndo", book, { ops: ops, inverse: inverse });
+}
+
+export async function vUndo(book: string): Promise<UndoResult> {
+  return await fetchUndo("undo", book);
+}
+
+export async function vRedo(book: string): Promise<UndoResult> {
+  return await fetchUndo("redo", book);
+}
+
+export async function vUndoStatus(book: string): Promise<UndoStatus> {
+  return await fetchUndo("undoStatus", book);
+}
+
+export async function vClearUndo(book: string): Promise<UndoStatus> {
+  return await fetchUndo("clearUndo", book);
+}
+
+/*  最近の n 段階（新しい順）  */
+export async function vUndoHistory(book: string, n: number): Promise<UndoStatus & { steps: { seq: number, ops: UndoOp[], undone: boolean }[] }> {
+  return await fetchUndo("history", book, { n: n });
+}
+
+/*  UndoManager の保存先。book() は現在の家計簿ファイルのパスを返す  */
+export function vUndoStore(book: () => Promise<string>): UndoStore {
+  return {
+    record: async (ops: UndoOp[], inverse: UndoOp[]) => vRecordUndo(await book(), ops, inverse),
+    undo: async () => vUndo(await book()),
+    redo: async () => vRedo(await book()),
+    status: async () => vUndoStatus(await book())
+  };
+}
+
+/*  明細読み込みの設定（銀行・カード会社ごとの列の配置）  */
+export interface ImportProfile {
+  name: string;
+  encoding?: string;       /* "auto", "UTF-8", "CP932" */
+  delimiter?: string;
+  skipLines?: number;
+  dateColumn?: number;     /* 列番号は 0 から数える。なければ -1 */
+  itemColumn?: number;
+  amountColumn?: number;
+  incomeColumn?: number;
+  kindColumn?: number;
+  kind?: string;
+  card?: string;
+  kindRules?: { match: string, kind: string }[];
+}
+
+/*  読み込んだ明細の１行  */
+export type ImportedRow = DataEntry & { ym: number };
+
+export interface ImportSummary {
+  ok: boolean;
+  count: number;
+  skipped: number;
+  badLines?: number;   /* 文字コードを変換できずに読み飛ばした行（skipped に含まれる） */
+  firstYm: number;
+  lastYm: number;
+  encoding: string;
+}
+
+export async function vImportProfiles(): Promise<ImportProfile[]> {
+  const res = await fetchVueRunner({ cmd: "importProfiles" });
+  if (res.ok) {
+    return await res.json();
+  } else {
+    return [];
+  }
+}
+
+export async function vSaveImportProfile(profile: ImportProfile): Promise<boolean> {
+  const res = await fetchVueRunner({ cmd: "saveImportProfile", profile: profile });
+  if (res.ok) {
+    return (await res.text() === "ok");
+  } else {
+    return false;
+  }
+}
+
+/*  明細ファイルを読み込む。行はまとめて onRows に渡される  */
+export async function vImportStatement(path: string, profile: string | ImportProfile,
+  onRows: (rows: ImportedRow[]) => void): Promise<ImportSummary | undefined> {
+  const res = await fetchVueRunner({ cmd: "importStatement", path: path, profile: profile });
+  const reader = res.body?.getReader();
+  if (!res.ok || reader === undefined) {
+    return undefined;
+  }
+  //  res は１行に１つの JSON (application/x-ndjson)
+  const decoder = new TextDecoder();
+  let buf = "";
+  let summary: ImportSummary | undefined = undefined;
+  while (true) {
+    const {done, value} = await reader.read();
+    if (value) {
+      buf += decoder.decode(value, { stream: true });
+    }
+    let nl;
+    while ((nl = buf.indexOf("\n")) >= 0) {
+      const line = buf.slice(0, nl);
+      buf = buf.slice(nl + 1);
+      if (line === "") {
+        continue;
+      }
+      const obj = JSON.parse(line);
+      if (obj.rows !== undefined) {
+        onRows(obj.rows);
+      } else if (obj.done) {
+        summary = obj;
+      }
+    }
+    if (done) {
+      break;
+    }
+  }
+  return summary;
+}
+
 export function vTerminate() {
   fetchVueRunner({ cmd: "terminate" });
 }
@@ -0,0 +1,149 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Arena.h"
+
+#include <stdlib.h>
+
+static const size_t kAlign = 16;
+static const size_t kHeader = 16;  //  Tag before each block; keeps the alignment
+
+enum { kFromHeap = 0x48454150, kFromArena = 0x4152454e };
+
+static thread_local Arena *tArena = NULL;
+static thread_local uint64_t tHeapAllocations = 0;
+
+Arena::Arena(size_t chunkSize)
+  : m_ptr(NULL), m_end(NULL), m_used(0), m_chunkSize(chunkSize)
+{
+}
+
+Arena::~Arena()
+{
+  for (size_t i = 0; i < m_chunks.size(); i++)
+    free(m_chunks[i].base);
+}
+
+void
+Arena::NewChunk(size_t size)
+{
+  Chunk chunk;
+  chunk.base = (char *)malloc(size);
+  if (chunk.base == NULL)
+    throw std::bad_alloc();
+  tHeapAllocations++;
+  chunk.size = size;
+  m_chunks.push_back(chunk);
+  m_ptr = chunk.base;
+  m_end = chunk.base + size;
+}
+
+void *
+Arena::Allocate(size_t size)
+{
+  size = (size + kAlign - 1) & ~(kAlign - 1);
+  if (m_ptr == NULL || (size_t)(m_end - m_ptr) < size)
+    NewChunk(size > m_chunkSize ? size : m_chunkSize);
+  void *p = m_ptr;
+  m_ptr += size;
+  m_used += size;
+  return p;
+}
+
+size_t
+Arena::Capacity() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < m_chunks.size(); i++)
+    n += m_chunks[i].size;
+  return n;
+}
+
+void
+Arena::Reset()
+{
+  if (m_chunks.size() > 1) {
+    //  Replace the chunks with one that holds them all, so that the next
+    //  request of this size fits in a single chunk
+    size_t total = Capacity();
+    for (size_t i = 0; i < m_chunks.size(); i++)
+      free(m_chunks[i].base);
+    m_chunks.clear();
+    NewChunk(total);
+  } else if (!m_chunks.empty()) {
+    m_ptr = m_chunks[0].base;
+  }
+  m_used = 0;
+}
+
+ArenaScope::ArenaScope(Arena *arena)
+  : m_previous(tArena)
+{
+  tArena = arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+  tArena = m_previous;
+}
+
+void *
+arenaAllocate(size_t size)
+{
+  char *p;
+  uint32_t tag;
+  if (tArena != NULL) {
+    p = (char *)tArena->Allocate(size + kHeader);
+    tag = kFromArena;
+  } else {
+    p = (char *)malloc(size + kHeader);
+    if (p == NULL)
+      throw std::bad_alloc();
+    tag = kFromHeap;
+    tHeapAllocations++;
+  }
+  *(uint32_t *)p = tag;
+  return p + kHeader;
+}
+
+void
+arenaDeallocate(void *ptr)
+{
+  if (ptr == NULL)
+    return;
+  char *p = (char *)ptr - kHeader;
+  if (*(uint32_t *)p == kFromHeap)
+    free(p);
+  //  Blocks in an arena are released by Arena::Reset()
+}
+
+uint64_t
+arenaHeapAllocations()
+{
+  return tHeapAllocations;
+}
+
+#if DEBUG
+//  Count every allocation of the program (std::string, wxString, ...), so
+//  that what a request really costs can be seen and checked
+void *
+operator new(size_t size)
+{
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL)
+    throw std::bad_alloc();
+  tHeapAllocations++;
+  return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+  free(p);
+}
+#endif
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ARENA_H
+#define ARENA_H
+
+//  Monotonic arena for the objects that live during one request. Memory is
+//  taken from large chunks and never freed individually; Reset() makes the
+//  whole arena available again. After a few requests the arena settles to
+//  one chunk large enough for a request, and no more heap allocations are
+//  made for it.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <new>
+
+class Arena
+{
+public:
+  explicit Arena(size_t chunkSize = 64 * 1024);
+  ~Arena();
+  void *Allocate(size_t size);  //  Aligned to 16 bytes
+  void Reset();
+  size_t BytesUsed() const { return m_used; }
+  size_t Capacity() const;
+private:
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+  struct Chunk {
+    char *base;
+    size_t size;
+  };
+  void NewChunk(size_t size);
+  std::vector<Chunk> m_chunks;
+  char *m_ptr;
+  char *m_end;
+  size_t m_used;
+  size_t m_chunkSize;
+};
+
+//  While an ArenaScope is alive, ArenaAllocator in this thread allocates
+//  from the arena (or from the heap if the arena is NULL). Anything that
+//  must outlive the arena has to be made (copied) under ArenaScope(NULL).
+class ArenaScope
+{
+public:
+  explicit ArenaScope(Arena *arena);
+  ~ArenaScope();
+private:
+  Arena *m_previous;
+};
+
+void *arenaAllocate(size_t size);
+void arenaDeallocate(void *p);
+
+//  Allocations made on the heap by this thread: blocks made outside an
+//  arena, and new chunks of an arena. A DEBUG build also counts every
+//  operator new (std::string etc.).
+uint64_t arenaHeapAllocations();
+
+//  Stateless allocator: each block carries a tag telling where it came
+//  from, so a block is freed correctly whatever the arena is at that time
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  ArenaAllocator() {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &) {}
+  T *allocate(size_t n) { return static_cast<T *>(arenaAllocate(n * sizeof(T))); }
+  void deallocate(T *p, size_t) { arenaDeallocate(p); }
+  template <typename U> struct rebind { typedef ArenaAllocator<U> other; };
+  template <typename U> bool operator==(const ArenaAllocator<U> &) const { return true; }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &) const { return false; }
+};
+
+#endif // ARENA_H
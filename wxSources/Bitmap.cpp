@@ -0,0 +1,324 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Bitmap.h"
+
+#include <algorithm>
+
+static inline int
+popcount64(uint64_t w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(w);
+#else
+  w = w - ((w >> 1) & 0x5555555555555555ULL);
+  w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+  w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline int
+ctz64(uint64_t w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(w);
+#else
+  int n = 0;
+  while ((w & 1) == 0) {
+    w >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+void
+Bitmap::Chunk::ToBitset()
+{
+  bits.assign(kWords, 0);
+  for (size_t i = 0; i < array.size(); i++)
+    bits[array[i] >> 6] |= (1ULL << (array[i] & 63));
+  std::vector<uint16_t>().swap(array);
+}
+
+void
+Bitmap::Chunk::ToArray()
+{
+  array.clear();
+  array.reserve(count);
+  for (int i = 0; i < kWords; i++) {
+    uint64_t w = bits[i];
+    while (w != 0) {
+      array.push_back((uint16_t)(i * 64 + ctz64(w)));
+      w &= w - 1;
+    }
+  }
+  std::vector<uint64_t>().swap(bits);
+}
+
+Bitmap::Chunk &
+Bitmap::ChunkFor(uint16_t key)
+{
+  if (m_chunks.empty() || m_chunks.back().key < key) {
+    m_chunks.push_back(Chunk(key));
+    return m_chunks.back();
+  }
+  if (m_chunks.back().key == key)
+    return m_chunks.back();
+  std::vector<Chunk>::iterator it = std::lower_bound(m_chunks.begin(), m_chunks.end(), key,
+    [](const Chunk &c, uint16_t k) { return c.key < k; });
+  if (it == m_chunks.end() || it->key != key)
+    it = m_chunks.insert(it, Chunk(key));
+  return *it;
+}
+
+Bitmap
+Bitmap::Range(uint32_t lo, uint32_t hi)
+{
+  Bitmap bm;
+  while (lo < hi) {
+    uint32_t chunkEnd = (lo | 0xFFFF) + 1;
+    uint32_t e = (hi < chunkEnd || chunkEnd == 0 ? hi : chunkEnd);
+    Chunk c((uint16_t)(lo >> 16));
+    c.count = e - lo;
+    if (c.count <= kArrayMax) {
+      for (uint32_t x = lo; x < e; x++)
+        c.array.push_back((uint16_t)x);
+    } else {
+      c.bits.assign(kWords, 0);
+      for (uint32_t x = lo; x < e; x++)
+        c.bits[(x & 0xFFFF) >> 6] |= (1ULL << (x & 63));
+    }
+    bm.m_chunks.push_back(c);
+    if (e == hi)
+      break;
+    lo = e;
+  }
+  return bm;
+}
+
+void
+Bitmap::Add(uint32_t x)
+{
+  Chunk &c = ChunkFor((uint16_t)(x >> 16));
+  uint16_t low = (uint16_t)x;
+  if (c.IsBitset()) {
+    uint64_t &w = c.bits[low >> 6];
+    uint64_t m = 1ULL << (low & 63);
+    if ((w & m) == 0) {
+      w |= m;
+      c.count++;
+    }
+    return;
+  }
+  if (c.array.empty() || c.array.back() < low) {
+    c.array.push_back(low);
+  } else {
+    std::vector<uint16_t>::iterator it = std::lower_bound(c.array.begin(), c.array.end(), low);
+    if (*it == low)
+      return;
+    c.array.insert(it, low);
+  }
+  c.count++;
+  if (c.count > kArrayMax)
+    c.ToBitset();
+}
+
+bool
+Bitmap::Contains(uint32_t x) const
+{
+  uint16_t key = (uint16_t)(x >> 16);
+  std::vector<Chunk>::const_iterator it = std::lower_bound(m_chunks.begin(), m_chunks.end(), key,
+    [](const Chunk &c, uint16_t k) { return c.key < k; });
+  if (it == m_chunks.end() || it->key != key)
+    return false;
+  uint16_t low = (uint16_t)x;
+  if (it->IsBitset())
+    return (it->bits[low >> 6] >> (low & 63)) & 1;
+  return std::binary_search(it->array.begin(), it->array.end(), low);
+}
+
+uint64_t
+Bitmap::Cardinality() const
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i < m_chunks.size(); i++)
+    n += m_chunks[i].count;
+  return n;
+}
+
+Bitmap::Chunk
+Bitmap::AndChunk(const Chunk &a, const Chunk &b)
+{
+  Chunk c(a.key);
+  if (a.IsBitset() && b.IsBitset()) {
+    c.bits.resize(kWords);
+    uint32_t n = 0;
+    for (int i = 0; i < kWords; i++) {
+      c.bits[i] = a.bits[i] & b.bits[i];
+      n += popcount64(c.bits[i]);
+    }
+    c.count = n;
+    if (n <= kArrayMax)
+      c.ToArray();
+  } else if (a.IsBitset() || b.IsBitset()) {
+    const Chunk &arr = (a.IsBitset() ? b : a);
+    const Chunk &bs = (a.IsBitset() ? a : b);
+    for (size_t i = 0; i < arr.array.size(); i++) {
+      uint16_t v = arr.array[i];
+      if ((bs.bits[v >> 6] >> (v & 63)) & 1)
+        c.array.push_back(v);
+    }
+    c.count = (uint32_t)c.array.size();
+  } else {
+    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                          std::back_inserter(c.array));
+    c.count = (uint32_t)c.array.size();
+  }
+  return c;
+}
+
+Bitmap::Chunk
+Bitmap::OrChunk(const Chunk &a, const Chunk &b)
+{
+  Chunk c(a.key);
+  if (!a.IsBitset() && !b.IsBitset() && a.count + b.count <= kArrayMax) {
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                   std::back_inserter(c.array));
+    c.count = (uint32_t)c.array.size();
+    return c;
+  }
+  c.bits.assign(kWords, 0);
+  const Chunk *src[2] = { &a, &b };
+  for (int k = 0; k < 2; k++) {
+    const Chunk &s = *src[k];
+    if (s.IsBitset()) {
+      for (int i = 0; i < kWords; i++)
+        c.bits[i] |= s.bits[i];
+    } else {
+      for (size_t i = 0; i < s.array.size(); i++)
+        c.bits[s.array[i] >> 6] |= (1ULL << (s.array[i] & 63));
+    }
+  }
+  uint32_t n = 0;
+  for (int i = 0; i < kWords; i++)
+    n += popcount64(c.bits[i]);
+  c.count = n;
+  if (n <= kArrayMax)
+    c.ToArray();
+  return c;
+}
+
+Bitmap
+Bitmap::And(const Bitmap &a, const Bitmap &b)
+{
+  Bitmap r;
+  size_t i = 0, j = 0;
+  while (i < a.m_chunks.size() && j < b.m_chunks.size()) {
+    uint16_t ka = a.m_chunks[i].key, kb = b.m_chunks[j].key;
+    if (ka < kb)
+      i++;
+    else if (kb < ka)
+      j++;
+    else {
+      Chunk c = AndChunk(a.m_chunks[i++], b.m_chunks[j++]);
+      if (c.count > 0)
+        r.m_chunks.push_back(c);
+    }
+  }
+  return r;
+}
+
+Bitmap
+Bitmap::Or(const Bitmap &a, const Bitmap &b)
+{
+  Bitmap r;
+  size_t i = 0, j = 0;
+  while (i < a.m_chunks.size() || j < b.m_chunks.size()) {
+    if (j == b.m_chunks.size() || (i < a.m_chunks.size() && a.m_chunks[i].key < b.m_chunks[j].key))
+      r.m_chunks.push_back(a.m_chunks[i++]);
+    else if (i == a.m_chunks.size() || b.m_chunks[j].key < a.m_chunks[i].key)
+      r.m_chunks.push_back(b.m_chunks[j++]);
+    else
+      r.m_chunks.push_back(OrChunk(a.m_chunks[i++], b.m_chunks[j++]));
+  }
+  return r;
+}
+
+void
+Bitmap::ForEach(std::function<void(uint32_t)> fn) const
+{
+  for (size_t k = 0; k < m_chunks.size(); k++) {
+    const Chunk &c = m_chunks[k];
+    uint32_t base = (uint32_t)c.key << 16;
+    if (c.IsBitset()) {
+      for (int i = 0; i < kWords; i++) {
+        uint64_t w = c.bits[i];
+        while (w != 0) {
+          fn(base + i * 64 + ctz64(w));
+          w &= w - 1;
+        }
+      }
+    } else {
+      for (size_t i = 0; i < c.array.size(); i++)
+        fn(base + c.array[i]);
+    }
+  }
+}
+
+int64_t
+Bitmap::Sum(const int64_t *values) const
+{
+  int64_t sum = 0;
+  for (size_t k = 0; k < m_chunks.size(); k++) {
+    const Chunk &c = m_chunks[k];
+    const int64_t *v = values + ((size_t)c.key << 16);
+    if (c.IsBitset()) {
+      for (int i = 0; i < kWords; i++) {
+        uint64_t w = c.bits[i];
+        const int64_t *vw = v + i * 64;
+        if (w == ~0ULL) {
+          //  Contiguous run: vectorized by the compiler
+          int64_t s = 0;
+          for (int b = 0; b < 64; b++)
+            s += vw[b];
+          sum += s;
+        } else {
+          while (w != 0) {
+            sum += vw[ctz64(w)];
+            w &= w - 1;
+          }
+        }
+      }
+    } else {
+      const uint16_t *a = c.array.data();
+      size_t n = c.array.size(), i = 0;
+      int64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      for ( ; i + 4 <= n; i += 4) {
+        s0 += v[a[i]];
+        s1 += v[a[i + 1]];
+        s2 += v[a[i + 2]];
+        s3 += v[a[i + 3]];
+      }
+      for ( ; i < n; i++)
+        s0 += v[a[i]];
+      sum += s0 + s1 + s2 + s3;
+    }
+  }
+  return sum;
+}
+
+size_t
+Bitmap::MemoryUsage() const
+{
+  size_t n = m_chunks.capacity() * sizeof(Chunk);
+  for (size_t i = 0; i < m_chunks.size(); i++)
+    n += m_chunks[i].array.capacity() * sizeof(uint16_t) + m_chunks[i].bits.capacity() * sizeof(uint64_t);
+  return n;
+}
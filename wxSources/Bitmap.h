@@ -0,0 +1,65 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <functional>
+
+//  Compressed bitmap of row positions, in the manner of Roaring bitmaps.
+//  The 32-bit positions are split into chunks of 65536 by the upper 16 bits.
+//  A chunk with at most 4096 members keeps them as a sorted array of the
+//  lower 16 bits; a denser chunk keeps a plain bitset (1024 words).
+class Bitmap
+{
+public:
+  Bitmap() {}
+
+  //  Positions in [lo, hi)
+  static Bitmap Range(uint32_t lo, uint32_t hi);
+
+  //  Add a position. Fast when the positions are added in increasing order.
+  void Add(uint32_t x);
+  bool Contains(uint32_t x) const;
+  bool Empty() const { return m_chunks.empty(); }
+  uint64_t Cardinality() const;
+
+  static Bitmap And(const Bitmap &a, const Bitmap &b);
+  static Bitmap Or(const Bitmap &a, const Bitmap &b);
+
+  //  Call fn for each position in increasing order
+  void ForEach(std::function<void(uint32_t)> fn) const;
+
+  //  Sum of values[x] for all members x. Fully set words of the bitsets
+  //  are summed as contiguous runs, which the compiler vectorizes.
+  int64_t Sum(const int64_t *values) const;
+
+  size_t MemoryUsage() const;
+
+private:
+  enum { kArrayMax = 4096, kWords = 1024 };
+  struct Chunk {
+    uint16_t key;                 //  Upper 16 bits
+    uint32_t count;
+    std::vector<uint16_t> array;  //  Used if bits is empty
+    std::vector<uint64_t> bits;
+    Chunk(uint16_t k = 0) : key(k), count(0) {}
+    bool IsBitset() const { return !bits.empty(); }
+    void ToBitset();
+    void ToArray();
+  };
+  Chunk &ChunkFor(uint16_t key);
+  static Chunk AndChunk(const Chunk &a, const Chunk &b);
+  static Chunk OrChunk(const Chunk &a, const Chunk &b);
+  std::vector<Chunk> m_chunks;  //  Sorted by key
+};
+
+#endif // BITMAP_H
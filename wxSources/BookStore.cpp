@@ -0,0 +1,406 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "BookStore.h"
+#include "KakeiboParser.h"
+#include "Metrics.h"
+
+#include <chrono>
+#include <atomic>
+
+
+BookStore::BookStore()
+  : m_slots(std::make_shared<SlotMap>())
+{
+  m_epoch = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+BookStore &
+BookStore::Get()
+{
+  static BookStore sBookStore;
+  return sBookStore;
+}
+
+std::shared_ptr<BookStore::Slot>
+BookStore::FindSlot(const std::string &path)
+{
+  std::shared_ptr<const SlotMap> slots = std::atomic_load(&m_slots);
+  SlotMap::const_iterator it = slots->find(path);
+  return (it == slots->end() ? std::shared_ptr<Slot>() : it->second);
+}
+
+//  Called with m_writeMutex locked
+std::shared_ptr<BookStore::Slot>
+BookStore::SlotFor(const std::string &path)
+{
+  std::shared_ptr<Slot> slot = FindSlot(path);
+  if (!slot) {
+    std::shared_ptr<SlotMap> slots = std::make_shared<SlotMap>(*std::atomic_load(&m_slots));
+    slot = std::make_shared<Slot>();
+    (*slots)[path] = slot;
+    std::atomic_store(&m_slots, std::shared_ptr<const SlotMap>(slots));
+  }
+  return slot;
+}
+
+static bool
+sameMeta(const Ledger &a, const Ledger &b)
+{
+  if (a.incomeKinds != b.incomeKinds || a.paymentKinds != b.paymentKinds || a.cards.size() != b.cards.size())
+    return false;
+  for (size_t i = 0; i < a.cards.size(); i++) {
+    if (a.cards[i].name != b.cards[i].name || a.cards[i].closing != b.cards[i].closing)
+      return false;
+  }
+  return true;
+}
+
+//  Called with m_writeMutex locked
+void
+BookStore::Publish(Slot &slot, std::shared_ptr<const Ledger> ledger)
+{
+  BookSnapshotPtr old = std::atomic_load(&slot.current);
+  std::shared_ptr<BookSnapshot> snap = std::make_shared<BookSnapshot>();
+  snap->version = (old ? old->version + 1 : 1);
+  snap->ledger = ledger;
+
+  //  A page keeps its version while its rows are those of the previous
+  //  version (usually the same page, shared; Apply may copy a page and
+  //  leave it as it was)
+  snap->metaVersion = (old && sameMeta(*old->ledger, *ledger) ? old->metaVersion : snap->version);
+  if (old)
+    snap->removed = old->removed;
+  for (LedgerMonths::const_iterator it = ledger->months.begin(); it != ledger->months.end(); ++it) {
+    LedgerMonths::const_iterator pit;
+    bool same = false;
+    if (old && (pit = old->ledger->months.find(it->first)) != old->ledger->months.end())
+      same = (pit->second == it->second || *pit->second == *it->second);
+    if (same)
+      snap->pageVersions[it->first] = old->pageVersions.at(it->first);
+    else
+      snap->pageVersions[it->first] = snap->version;
+    snap->removed.erase(it->first);
+  }
+  if (old) {
+    for (LedgerMonths::const_iterator pit = old->ledger->months.begin(); pit != old->ledger->months.end(); ++pit) {
+      if (ledger->months.count(pit->first) == 0)
+        snap->removed[pit->first] = snap->version;
+    }
+  }
+  std::atomic_store(&slot.current, BookSnapshotPtr(snap));
+  metricsAdd("store.versions");
+}
+
+bool
+BookStore::Update(const std::string &path, const char *buf, size_t len, std::string *error)
+{
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  std::shared_ptr<Slot> slot = SlotFor(path);
+  BookSnapshotPtr old = std::atomic_load(&slot->current);
+  std::shared_ptr<Ledger> ledger;
+  if (!Parse(old, buf, len, ledger, error))
+    return false;
+  SharePages(old, *ledger);
+  Publish(*slot, ledger);
+  return true;
+}
+
+//  Parse the text into a new Ledger. Does not touch the store.
+bool
+BookStore::Parse(const BookSnapshotPtr &old, const char *buf, size_t len, std::shared_ptr<Ledger> &ledger, std::string *error)
+{
+  //  Start from the strings of the current version so that the ids are kept
+  ledger.reset(new Ledger);
+  if (old)
+    ledger->strings = old->ledger->strings;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  bool ok = parseKakeibo(buf, len, *ledger, error);
+  int64_t ns = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+  metricsAdd("parse.count");
+  metricsAdd("parse.bytes", (int64_t)len);
+  metricsAdd("parse.ns", ns);
+  if (ns > 0)
+    metricsSet("parse.lastMBps", (int64_t)((double)len * 1000.0 / (double)ns));
+  if (!ok) {
+    metricsAdd("parse.failed");
+    return false;
+  }
+  metricsSet("parse.lastRows", (int64_t)ledger->NumberOfRows());
+  return true;
+}
+
+//  Share the unchanged pages of old (and the string table if no string was
+//  added). ledger must have been parsed with the strings of old.
+void
+BookStore::SharePages(const BookSnapshotPtr &old, Ledger &ledger)
+{
+  if (old) {
+    const Ledger &prev = *old->ledger;
+    int64_t shared = 0;
+    for (LedgerMonths::iterator it = ledger.months.begin(); it != ledger.months.end(); ++it) {
+      LedgerMonths::const_iterator pit = prev.months.find(it->first);
+      if (pit != prev.months.end() && *pit->second == *it->second) {
+        it->second = pit->second;
+        shared++;
+      }
+    }
+    if (ledger.strings->Size() == prev.strings->Size())
+      ledger.strings = prev.strings;
+    metricsAdd("store.pagesShared", shared);
+    metricsAdd("store.pagesCopied", (int64_t)ledger.months.size() - shared);
+  }
+}
+
+//  Copy-on-write view of a Ledger while the operations are applied
+class LedgerEditor
+{
+public:
+  LedgerEditor(const Ledger &base) : m_ledger(new Ledger(base)) {}
+  LedgerPage *Page(int ym, bool create) {
+    std::map<int, std::shared_ptr<LedgerPage> >::iterator it = m_owned.find(ym);
+    if (it != m_owned.end())
+      return it->second.get();
+    LedgerMonths::iterator mit = m_ledger->months.find(ym);
+    if (mit == m_ledger->months.end() && !create)
+      return NULL;
+    std::shared_ptr<LedgerPage> page(mit == m_ledger->months.end() ? new LedgerPage : new LedgerPage(*mit->second));
+    m_owned[ym] = page;
+    m_ledger->months[ym] = page;
+    return page.get();
+  }
+  bool HasPage(int ym) const { return m_ledger->months.count(ym) != 0; }
+  void RemovePage(int ym) {
+    m_owned.erase(ym);
+    m_ledger->months.erase(ym);
+  }
+  uint32_t Intern(const std::string &s) {
+    uint32_t id;
+    if (m_ledger->strings->Find(s, id))
+      return id;
+    if (!m_strings) {
+      m_strings.reset(new StringTable(*m_ledger->strings));
+      m_ledger->strings = m_strings;
+    }
+    return m_strings->Intern(s);
+  }
+  std::shared_ptr<const Ledger> Result() { return m_ledger; }
+private:
+  std::shared_ptr<Ledger> m_ledger;
+  std::map<int, std::shared_ptr<LedgerPage> > m_owned;  //  Pages already copied
+  std::shared_ptr<StringTable> m_strings;               //  Set when copied
+};
+
+static int64_t
+numberOrZero(const json &j, const char *key)
+{
+  return (j.contains(key) && j[key].is_number() ? j[key].get<int64_t>() : 0);
+}
+
+static std::string
+stringOrEmpty(const json &j, const char *key)
+{
+  return (j.contains(key) && j[key].is_string() ? j[key].get<std::string>() : "");
+}
+
+//  Apply the operation records to the book being edited; false if one
+//  does not fit
+static bool
+applyOps(LedgerEditor &ed, const json &ops)
+{
+  for (const json &op : ops) {
+    std::string name = stringOrEmpty(op, "op");
+    int ym = (int)numberOrZero(op, "page");
+    size_t row = (size_t)numberOrZero(op, "row");
+    if (name == "insertPage") {
+      ed.Page(ym, true);
+    } else if (name == "deletePage") {
+      LedgerPage *page = ed.Page(ym, false);
+      if (page != NULL && page->empty())
+        ed.RemovePage(ym);
+    } else if (name == "insertRow" || name == "deleteRow" || name == "setValue") {
+      LedgerPage *page = ed.Page(ym, false);
+      if (page == NULL || row > page->size() || (name != "insertRow" && row == page->size()))
+        return false;
+      if (name == "deleteRow") {
+        page->erase(page->begin() + row);
+      } else if (name == "insertRow") {
+        const json &e = (op.contains("entry") ? op["entry"] : json::object());
+        LedgerRow r;
+        r.date = (uint8_t)numberOrZero(e, "date");
+        r.item = ed.Intern(stringOrEmpty(e, "item"));
+        r.kind = ed.Intern(stringOrEmpty(e, "kind"));
+        r.isIncome = (e.contains("isIncome") && e["isIncome"].is_boolean() && e["isIncome"].get<bool>());
+        r.amount = numberOrZero(e, "amount");
+        r.card = ed.Intern(stringOrEmpty(e, "card"));
+        page->insert(page->begin() + row, r);
+      } else {
+        LedgerRow &r = (*page)[row];
+        std::string key = stringOrEmpty(op, "key");
+        if (key == "date")
+          r.date = (uint8_t)numberOrZero(op, "value");
+        else if (key == "amount")
+          r.amount = numberOrZero(op, "value");
+        else if (key == "isIncome")
+          r.isIncome = (op.contains("value") && op["value"].is_boolean() && op["value"].get<bool>());
+        else if (key == "item")
+          r.item = ed.Intern(stringOrEmpty(op, "value"));
+        else if (key == "kind")
+          r.kind = ed.Intern(stringOrEmpty(op, "value"));
+        else if (key == "card")
+          r.card = ed.Intern(stringOrEmpty(op, "value"));
+      }
+    }
+  }
+  return true;
+}
+
+bool
+BookStore::Apply(const std::string &path, const json &ops)
+{
+  const size_t kMaxApplied = 256;
+  if (!ops.is_array())
+    return false;
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  std::shared_ptr<Slot> slot = FindSlot(path);
+  BookSnapshotPtr old = (slot ? std::atomic_load(&slot->current) : BookSnapshotPtr());
+  if (!old)
+    return false;
+  LedgerEditor ed(*old->ledger);
+  if (!applyOps(ed, ops)) {
+    metricsAdd("store.applyFailed");
+    return false;
+  }
+  Publish(*slot, ed.Result());
+  //  Kept for UpdateRebased()
+  slot->applied.push_back(std::make_pair(old->version + 1, ops));
+  if (slot->applied.size() > kMaxApplied)
+    slot->applied.pop_front();
+  metricsAdd("store.applied", (int64_t)ops.size());
+  return true;
+}
+
+bool
+BookStore::UpdateRebased(const std::string &path, const char *buf, size_t len, uint64_t base)
+{
+  //  The text is parsed with the strings of the version it is published
+  //  on; if another version comes while parsing, parse again (in the lock
+  //  at the last try, so that this ends)
+  const int kMaxTries = 3;
+  std::unique_lock<std::mutex> lock(m_writeMutex, std::defer_lock);
+  std::shared_ptr<Slot> slot;
+  BookSnapshotPtr old;
+  std::shared_ptr<Ledger> ledger;
+  for (int tries = 1; ; tries++) {
+    if (tries == kMaxTries)
+      lock.lock();
+    old = Snapshot(path);
+    if (!Parse(old, buf, len, ledger, NULL))
+      return false;
+    if (!lock.owns_lock())
+      lock.lock();
+    slot = SlotFor(path);
+    if (std::atomic_load(&slot->current) == old)
+      break;
+    lock.unlock();
+    metricsAdd("store.parseRetried");
+  }
+  std::shared_ptr<const Ledger> result = ledger;
+  if (old && old->version > base) {
+    //  Edits applied after the text was sent
+    LedgerEditor ed(*ledger);
+    bool ok = true;
+    int64_t n = 0;
+    for (size_t i = 0; ok && i < slot->applied.size(); i++) {
+      if (slot->applied[i].first > base) {
+        ok = applyOps(ed, slot->applied[i].second);
+        n++;
+      }
+    }
+    if (ok) {
+      result = ed.Result();
+      metricsAdd("store.rebasedOps", n);
+    } else {
+      metricsAdd("store.rebaseFailed");  //  The text alone; the next save brings the rest
+    }
+  }
+  if (result != ledger)
+    ledger.reset(new Ledger(*result));
+  SharePages(old, *ledger);
+  Publish(*slot, ledger);
+  return true;
+}
+
+BookSnapshotPtr
+BookStore::Snapshot(const std::string &path)
+{
+  std::shared_ptr<Slot> slot = FindSlot(path);
+  return (slot ? std::atomic_load(&slot->current) : BookSnapshotPtr());
+}
+
+std::shared_ptr<const Ledger>
+BookStore::Find(const std::string &path)
+{
+  BookSnapshotPtr snap = Snapshot(path);
+  return (snap ? snap->ledger : std::shared_ptr<const Ledger>());
+}
+
+uint64_t
+BookStore::Version(const std::string &path)
+{
+  BookSnapshotPtr snap = Snapshot(path);
+  return (snap ? snap->version : 0);
+}
+
+BookChanges
+BookStore::ChangesSince(const std::string &path, uint64_t epoch, uint64_t version)
+{
+  BookChanges changes;
+  changes.snapshot = Snapshot(path);
+  const BookSnapshot *snap = changes.snapshot.get();
+  if (snap == NULL)
+    return changes;
+  if (epoch != m_epoch || version == 0 || version > snap->version) {
+    changes.full = true;
+    return changes;
+  }
+  changes.meta = (snap->metaVersion > version);
+  for (std::map<int, uint64_t>::const_iterator it = snap->pageVersions.begin(); it != snap->pageVersions.end(); ++it) {
+    if (it->second > version)
+      changes.pages.push_back(it->first);
+  }
+  for (std::map<int, uint64_t>::const_iterator it = snap->removed.begin(); it != snap->removed.end(); ++it) {
+    if (it->second > version)
+      changes.removed.push_back(it->first);
+  }
+  return changes;
+}
+
+std::shared_ptr<const LedgerIndex>
+BookStore::Index(const std::string &path)
+{
+  std::shared_ptr<Slot> slot = FindSlot(path);
+  if (!slot)
+    return std::shared_ptr<const LedgerIndex>();
+  BookSnapshotPtr snap = std::atomic_load(&slot->current);
+  if (!snap)
+    return std::shared_ptr<const LedgerIndex>();
+  std::shared_ptr<const LedgerIndex> index = std::atomic_load(&slot->index);
+  if (index && &index->GetLedger() == snap->ledger.get())
+    return index;
+  //  Build for this version. If two threads race, both indexes are valid.
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  index.reset(new LedgerIndex(snap->ledger));
+  metricsAdd("index.built");
+  metricsSet("index.lastMsec", (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - startTime).count());
+  std::atomic_store(&slot->index, index);
+  return index;
+}
@@ -0,0 +1,118 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef BOOKSTORE_H
+#define BOOKSTORE_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include "Json.h"
+#include "Ledger.h"
+#include "LedgerIndex.h"
+
+//  One version of a book. Never modified after it is published.
+//  The version of each month page is the version where the page last
+//  changed; a month that disappeared leaves a tombstone with the version
+//  where it was removed. These let a client that holds version N fetch
+//  only what changed since (BookStore::ChangesSince).
+struct BookSnapshot {
+  uint64_t version;
+  uint64_t metaVersion;                 //  Last change of the kinds and cards
+  std::map<int, uint64_t> pageVersions; //  YYYYMM -> version
+  std::map<int, uint64_t> removed;      //  YYYYMM -> version (tombstones)
+  std::shared_ptr<const Ledger> ledger;
+};
+typedef std::shared_ptr<const BookSnapshot> BookSnapshotPtr;
+
+//  The difference between a version held by a client and the current one
+struct BookChanges {
+  BookSnapshotPtr snapshot;   //  NULL if the book is not loaded
+  bool full;                  //  The client must reload the whole book
+  bool meta;                  //  The kinds or cards changed
+  std::vector<int> pages;     //  Months changed or added
+  std::vector<int> removed;   //  Months removed
+  BookChanges() : full(false), meta(false) {}
+};
+
+//  Parsed books kept on the server, keyed by the path of kakeibo.csv.
+//  The client remains the owner of the data; the store is refreshed every
+//  time the client opens or saves the book, and the edits recorded for undo
+//  are applied as they come.
+//
+//  Each change publishes a new BookSnapshot by swapping a pointer
+//  atomically. A new version copies only the month pages that changed and
+//  shares the rest with the previous one. Readers (queries, exports and
+//  reports on worker threads) take a snapshot without any lock and see a
+//  consistent book however long they keep it; only the writers are
+//  serialized.
+class BookStore
+{
+public:
+  static BookStore &Get();
+
+  //  Parse the text and publish it as the new version. Pages equal to
+  //  those of the current version are shared. Returns false (and keeps
+  //  the current version) if the text is malformed.
+  bool Update(const std::string &path, const char *buf, size_t len, std::string *error = NULL);
+
+  //  Same as Update(), but the text is parsed without blocking the other
+  //  writers. The text reflects the book at version base (0: not loaded);
+  //  the operations applied by Apply() after base are applied again on top
+  //  of it, so that neither the text nor those edits are lost.
+  bool UpdateRebased(const std::string &path, const char *buf, size_t len, uint64_t base);
+
+  //  Apply the operation records of DataMethods ({op: "setValue", page,
+  //  row, key, value} etc.; see undoManager.ts). Returns false (and keeps
+  //  the current version) if an operation does not fit the book.
+  bool Apply(const std::string &path, const json &ops);
+
+  //  The current version (NULL if the book is not loaded). Lock-free.
+  BookSnapshotPtr Snapshot(const std::string &path);
+
+  //  Shortcuts for Snapshot(path)->ledger and Snapshot(path)->version
+  std::shared_ptr<const Ledger> Find(const std::string &path);
+  uint64_t Version(const std::string &path);
+
+  //  Identifies this run of the store. Versions are counted from 1 when
+  //  the server starts, so a version is meaningful only with its epoch.
+  uint64_t Epoch() const { return m_epoch; }
+
+  //  What changed after the given version. full is set if the epoch is
+  //  not the current one or the version is not one that was published.
+  BookChanges ChangesSince(const std::string &path, uint64_t epoch, uint64_t version);
+
+  //  Index of the current version, built on the first request
+  //  (returns NULL if the book is not loaded)
+  std::shared_ptr<const LedgerIndex> Index(const std::string &path);
+
+private:
+  struct Slot {
+    BookSnapshotPtr current;                   //  Accessed by std::atomic_load/store
+    std::shared_ptr<const LedgerIndex> index;  //  Ditto
+    std::deque<std::pair<uint64_t, json> > applied;  //  Recent Apply(): version made, ops (writers only)
+  };
+  typedef std::map<std::string, std::shared_ptr<Slot> > SlotMap;
+
+  BookStore();
+  std::shared_ptr<Slot> FindSlot(const std::string &path);
+  std::shared_ptr<Slot> SlotFor(const std::string &path);  //  Writers only
+  void Publish(Slot &slot, std::shared_ptr<const Ledger> ledger);
+  bool Parse(const BookSnapshotPtr &old, const char *buf, size_t len, std::shared_ptr<Ledger> &ledger, std::string *error);
+  void SharePages(const BookSnapshotPtr &old, Ledger &ledger);
+
+  std::shared_ptr<const SlotMap> m_slots;  //  Replaced (copied) when a book is added
+  std::mutex m_writeMutex;
+  uint64_t m_epoch;
+};
+
+#endif // BOOKSTORE_H
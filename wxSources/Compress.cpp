@@ -0,0 +1,130 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Compress.h"
+#include "Metrics.h"
+
+#include <string.h>
+#include <zlib.h>
+#include <chrono>
+
+//  Deflate streams of one thread (made on the first use)
+class DeflateContext
+{
+public:
+  DeflateContext() {
+    m_ready[0] = m_ready[1] = false;
+  }
+  ~DeflateContext() {
+    for (int i = 0; i < 2; i++) {
+      if (m_ready[i])
+        deflateEnd(&m_zs[i]);
+    }
+  }
+  z_stream *Stream(int coding) {
+    int i = (coding == kCodingGzip ? 0 : 1);
+    if (!m_ready[i]) {
+      memset(&m_zs[i], 0, sizeof(z_stream));
+      //  windowBits 15 + 16: gzip header and trailer; 15: zlib format
+      if (deflateInit2(&m_zs[i], kCompressLevel, Z_DEFLATED, (i == 0 ? 15 + 16 : 15), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+      m_ready[i] = true;
+    } else if (deflateReset(&m_zs[i]) != Z_OK) {
+      return NULL;
+    }
+    return &m_zs[i];
+  }
+private:
+  z_stream m_zs[2];
+  bool m_ready[2];
+};
+
+static thread_local DeflateContext tDeflate;
+
+//  q=0 in Accept-Encoding means "not acceptable"
+static bool
+accepts(struct mg_str header, const char *coding)
+{
+  size_t i = 0;
+  while (i < header.len) {
+    while (i < header.len && (header.buf[i] == ' ' || header.buf[i] == ','))
+      i++;
+    size_t start = i;
+    while (i < header.len && header.buf[i] != ',' && header.buf[i] != ';' && header.buf[i] != ' ')
+      i++;
+    bool match = (mg_strcasecmp(mg_str_n(header.buf + start, i - start), mg_str(coding)) == 0);
+    bool zero = false;
+    while (i < header.len && header.buf[i] != ',') {
+      if (header.buf[i] == 'q' && i + 2 < header.len && header.buf[i + 1] == '=') {
+        const char *q = header.buf + i + 2;
+        const char *end = header.buf + header.len;
+        zero = (*q == '0');
+        for (q++; zero && q < end && *q != ',' && *q != ';' && *q != ' '; q++) {
+          if (*q != '.' && *q != '0')
+            zero = false;
+        }
+      }
+      i++;
+    }
+    if (match && !zero)
+      return true;
+  }
+  return false;
+}
+
+int
+acceptedCoding(struct mg_http_message *hm)
+{
+  struct mg_str *h = mg_http_get_header(hm, "Accept-Encoding");
+  if (h == NULL)
+    return kCodingIdentity;
+  if (accepts(*h, "gzip"))
+    return kCodingGzip;
+  if (accepts(*h, "deflate"))
+    return kCodingDeflate;
+  return kCodingIdentity;
+}
+
+const char *
+codingName(int coding)
+{
+  switch (coding) {
+    case kCodingGzip: return "gzip";
+    case kCodingDeflate: return "deflate";
+    default: return NULL;
+  }
+}
+
+bool
+compressBody(const char *data, size_t len, int coding, std::string &out)
+{
+  if (coding == kCodingIdentity || len < kCompressThreshold)
+    return false;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  z_stream *zs = tDeflate.Stream(coding);
+  if (zs == NULL)
+    return false;
+  out.resize(deflateBound(zs, (uLong)len) + 32);  //  Room for the gzip header
+  zs->next_in = (Bytef *)data;
+  zs->avail_in = (uInt)len;
+  zs->next_out = (Bytef *)&out[0];
+  zs->avail_out = (uInt)out.size();
+  int r = deflate(zs, Z_FINISH);
+  int64_t usec = (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+  if (r != Z_STREAM_END || zs->total_out >= len) {
+    metricsAdd("compress.skipped");
+    return false;
+  }
+  out.resize(zs->total_out);
+  metricsAdd("compress.count");
+  metricsAdd("compress.bytesIn", (int64_t)len);
+  metricsAdd("compress.bytesOut", (int64_t)out.size());
+  metricsAdd("compress.usec", usec);
+  return true;
+}
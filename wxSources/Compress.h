@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+//  Content-Encoding of the RPC responses. The client tells what it accepts
+//  in Accept-Encoding; a response of kCompressThreshold bytes or more is
+//  compressed at kCompressLevel (the fastest level: the time saved on the
+//  wire must not be spent in deflate). Each thread keeps its deflate
+//  streams and resets them between responses, so the 256KB of zlib state
+//  is allocated once per thread.
+
+#include <stddef.h>
+#include <string>
+#include "mongoose.h"
+
+enum {
+  kCodingIdentity = 0,
+  kCodingGzip = 1,
+  kCodingDeflate = 2
+};
+
+static const size_t kCompressThreshold = 1024;
+static const int kCompressLevel = 1;
+
+//  The coding to use for the response to hm (gzip preferred)
+int acceptedCoding(struct mg_http_message *hm);
+
+//  "gzip", "deflate" (NULL for identity)
+const char *codingName(int coding);
+
+//  Compress data into out. Returns false if the data is below the
+//  threshold, the result is not smaller, or coding is identity.
+bool compressBody(const char *data, size_t len, int coding, std::string &out);
+
+#endif // COMPRESS_H
@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/dir.h>
+
+#include "Consolidation.h"
+#include "BookStore.h"
+#include "KakeiboParser.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "ShardedBook.h"
+
+#include <chrono>
+#include <algorithm>
+
+
+Consolidation &
+Consolidation::Get()
+{
+  static Consolidation sConsolidation;
+  return sConsolidation;
+}
+
+std::string
+Consolidation::RootDir()
+{
+  wxString sep = wxFileName::GetPathSeparator();
+  return (wxGetHomeDir() + sep + wxT("kakeibo")).ToStdString(*wxConvFileName);
+}
+
+json
+Consolidation::LoadKindMap()
+{
+  wxString sep = wxFileName::GetPathSeparator();
+  wxFFile file(wxGetHomeDir() + sep + wxT("kakeibo") + sep + wxT("kindMap.json"), "rt");
+  wxString contents;
+  if (file.IsOpened() && file.ReadAll(&contents, wxConvUTF8)) {
+    json j = json::parse(contents.ToStdString(wxConvUTF8), nullptr, false);
+    if (j.is_object())
+      return j;
+  }
+  return json::object();
+}
+
+void
+Consolidation::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_cache.clear();
+}
+
+//  Called on the pool threads, one book each
+void
+Consolidation::LoadBook(Book &book)
+{
+  Entry entry;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, Entry>::iterator it = m_cache.find(book.path);
+    if (it != m_cache.end())
+      entry = it->second;
+  }
+
+  //  The book open in the app: its snapshot is newer than the file
+  BookSnapshotPtr snap = BookStore::Get().Snapshot(book.path);
+  if (snap) {
+    if (entry.rollup && entry.fromStore && entry.version == snap->version) {
+      book.rollup = entry.rollup;
+      book.source = "cache";
+      return;
+    }
+    entry.fromStore = true;
+    entry.version = snap->version;
+    entry.rollup = std::make_shared<FiscalRollup>(rollupLedger(*snap->ledger, 0, 0, false));
+    book.rollup = entry.rollup;
+    book.source = "store";
+  } else {
+    //  In any layout (see ShardedBook.h)
+    time_t mtime = bookModificationTime(book.path);
+    if (entry.rollup && !entry.fromStore && entry.mtime == mtime) {
+      book.rollup = entry.rollup;
+      book.source = "cache";
+      return;
+    }
+    std::string error;
+    FileBlobPtr blob = openBookFile(book.path, &error);
+    if (!blob) {
+      book.error = (error.empty() ? std::string("cannot open") : error);
+      return;
+    }
+    uint64_t hash = StringTable::Hash(blob->Data(), blob->Size());
+    if (entry.rollup && !entry.fromStore && entry.hash == hash) {
+      //  Touched but not changed
+      book.rollup = entry.rollup;
+      book.source = "cache";
+    } else {
+      Ledger ledger;
+      if (!parseKakeibo(blob->Data(), blob->Size(), ledger, &error)) {
+        book.error = error;
+        return;
+      }
+      entry.rollup = std::make_shared<FiscalRollup>(rollupLedger(ledger, 0, 0, false));
+      book.rollup = entry.rollup;
+      book.source = "file";
+    }
+    entry.fromStore = false;
+    entry.mtime = mtime;
+    entry.hash = hash;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_cache[book.path] = entry;
+}
+
+//  Rename the kinds of t by map
+static void
+mergeMapped(RollupTotals &dest, const RollupTotals &t, const json &bookMap, const json &kindMap)
+{
+  for (std::map<std::string, int64_t>::const_iterator it = t.kinds.begin(); it != t.kinds.end(); ++it) {
+    const std::string *name = &it->first;
+    if (bookMap.is_object() && bookMap.contains(*name) && bookMap[*name].is_string())
+      name = bookMap[*name].get_ptr<const std::string *>();
+    else if (kindMap.contains(*name) && kindMap[*name].is_string())
+      name = kindMap[*name].get_ptr<const std::string *>();
+    dest.kinds[*name] += it->second;
+  }
+  dest.income += t.income;
+  dest.payment += t.payment;
+  dest.rows += t.rows;
+}
+
+json
+Consolidation::Run(const json &kindMapArg, int fromYear, int toYear)
+{
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  json kindMap = (kindMapArg.is_object() ? kindMapArg : LoadKindMap());
+  json bookMaps = (kindMap.contains("books") && kindMap["books"].is_object() ? kindMap["books"] : json::object());
+
+  //  The books are the folders with kakeibo.csv (as initializeBookNames()
+  //  in MainWindow.vue, but "default" is included)
+  std::vector<Book> books;
+  std::string root = RootDir();
+  wxString sep = wxFileName::GetPathSeparator();
+  wxString wroot(root.c_str(), *wxConvFileName);
+  wxDir dir(wroot);
+  if (dir.IsOpened()) {
+    wxString fname;
+    bool b = dir.GetFirst(&fname, wxEmptyString, wxDIR_DIRS);
+    while (b) {
+      wxString wpath = wroot + sep + fname + sep + wxT("kakeibo.csv");
+      std::string path = wpath.ToStdString(*wxConvFileName);
+      if (bookStat(path).exists) {
+        Book book;
+        book.name = fname.ToStdString(wxConvUTF8);
+        book.path = path;
+        books.push_back(book);
+      }
+      b = dir.GetNext(&fname);
+    }
+  }
+
+  std::sort(books.begin(), books.end(), [](const Book &a, const Book &b) { return a.name < b.name; });
+
+  ThreadPool::Get().ParallelFor(books.size(), [&](size_t i) { LoadBook(books[i]); });
+
+  FiscalRollup r;
+  json bookList = json::array();
+  int hits = 0;
+  for (size_t i = 0; i < books.size(); i++) {
+    const Book &book = books[i];
+    json b;
+    b["name"] = book.name;
+    if (!book.rollup) {
+      b["error"] = book.error;
+      bookList.push_back(b);
+      continue;
+    }
+    const json &bookMap = (bookMaps.contains(book.name) ? bookMaps[book.name] : json());
+    uint64_t rows = 0;
+    const std::map<int, RollupTotals> &months = book.rollup->months;
+    for (std::map<int, RollupTotals>::const_iterator it = months.begin(); it != months.end(); ++it) {
+      int fy = fiscalYearOf(it->first);
+      if ((fromYear > 0 && fy < fromYear) || (toYear > 0 && fy > toYear))
+        continue;
+      mergeMapped(r.months[it->first], it->second, bookMap, kindMap);
+      mergeMapped(r.years[fy], it->second, bookMap, kindMap);
+      rows += it->second.rows;
+    }
+    if (book.source == "cache")
+      hits++;
+    b["rows"] = rows;
+    b["source"] = book.source;
+    bookList.push_back(b);
+  }
+
+  json res = r.toJson();
+  res["books"] = bookList;
+  int64_t usec = (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+  res["usec"] = usec;
+  metricsAdd("consolidated.count");
+  metricsAdd("consolidated.usec", usec);
+  metricsAdd("consolidated.books", (int64_t)books.size());
+  metricsAdd("consolidated.cacheHits", hits);
+  return res;
+}
@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef CONSOLIDATION_H
+#define CONSOLIDATION_H
+
+//  Totals over all the books in ~/kakeibo (each <bookName>/kakeibo.csv).
+//  A book open in BookStore is taken from its current snapshot; the others
+//  are read from the files. The rollup of each book is cached, and reused
+//  while the snapshot version, or the modification time of the file, is
+//  unchanged (or the contents hash the same after the file is touched).
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "Json.h"
+#include "Rollup.h"
+
+class Consolidation
+{
+public:
+  static Consolidation &Get();
+
+  //  Month and fiscal year totals of all the books in [fromYear, toYear]
+  //  (0 = unbounded). The kinds are renamed by kindMap:
+  //    {"外食": "食費", ..., "books": {"<bookName>": {"お小遣い": "娯楽"}}}
+  //  where the entries under "books" apply to that book only (and take
+  //  precedence). If kindMap is null, ~/kakeibo/kindMap.json is used.
+  json Run(const json &kindMap, int fromYear, int toYear);
+
+  //  Drop the cached rollups
+  void Clear();
+
+  static std::string RootDir();
+  static json LoadKindMap();
+
+private:
+  struct Entry {
+    bool fromStore;     //  Made from a BookStore snapshot
+    uint64_t version;   //  Snapshot version (fromStore)
+    time_t mtime;       //  File modification time (!fromStore)
+    uint64_t hash;      //  Hash of the file contents (!fromStore)
+    std::shared_ptr<const FiscalRollup> rollup;
+    Entry() : fromStore(false), version(0), mtime(0), hash(0) {}
+  };
+  struct Book {
+    std::string name;
+    std::string path;
+    std::shared_ptr<const FiscalRollup> rollup;
+    std::string source;  //  "store", "cache" or "file"
+    std::string error;
+  };
+  Consolidation() {}
+  void LoadBook(Book &book);
+  std::mutex m_mutex;
+  std::map<std::string, Entry> m_cache;  //  Key is the path
+};
+
+#endif // CONSOLIDATION_H
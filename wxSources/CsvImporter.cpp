@@ -0,0 +1,472 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/strconv.h>
+
+#include "CsvImporter.h"
+#include "SimdScan.h"
+#include "Metrics.h"
+
+#include <string.h>
+#include <chrono>
+
+
+static int
+intOrDefault(const json &j, const char *key, int def)
+{
+  return (j.contains(key) && j[key].is_number() ? j[key].get<int>() : def);
+}
+
+static std::string
+stringOrDefault(const json &j, const char *key, const std::string &def)
+{
+  return (j.contains(key) && j[key].is_string() ? j[key].get<std::string>() : def);
+}
+
+ImportProfile
+ImportProfile::fromJson(const json &j)
+{
+  ImportProfile p;
+  p.name = stringOrDefault(j, "name", "");
+  p.encoding = stringOrDefault(j, "encoding", "auto");
+  std::string delim = stringOrDefault(j, "delimiter", ",");
+  p.delimiter = (delim == "\\t" || delim == "tab" ? '\t' : (delim.empty() ? ',' : delim[0]));
+  p.skipLines = intOrDefault(j, "skipLines", 0);
+  p.dateColumn = intOrDefault(j, "dateColumn", 0);
+  p.itemColumn = intOrDefault(j, "itemColumn", 1);
+  p.amountColumn = intOrDefault(j, "amountColumn", 2);
+  p.incomeColumn = intOrDefault(j, "incomeColumn", -1);
+  p.kindColumn = intOrDefault(j, "kindColumn", -1);
+  p.kind = stringOrDefault(j, "kind", "");
+  p.card = stringOrDefault(j, "card", "");
+  if (j.contains("kindRules") && j["kindRules"].is_array()) {
+    for (const json &r : j["kindRules"]) {
+      std::string match = stringOrDefault(r, "match", "");
+      if (!match.empty())
+        p.kindRules.push_back(std::make_pair(match, stringOrDefault(r, "kind", "")));
+    }
+  }
+  return p;
+}
+
+json
+ImportProfile::toJson() const
+{
+  json j;
+  j["name"] = name;
+  j["encoding"] = encoding;
+  j["delimiter"] = (delimiter == '\t' ? std::string("\\t") : std::string(1, delimiter));
+  j["skipLines"] = skipLines;
+  j["dateColumn"] = dateColumn;
+  j["itemColumn"] = itemColumn;
+  j["amountColumn"] = amountColumn;
+  j["incomeColumn"] = incomeColumn;
+  j["kindColumn"] = kindColumn;
+  j["kind"] = kind;
+  j["card"] = card;
+  j["kindRules"] = json::array();
+  for (size_t i = 0; i < kindRules.size(); i++)
+    j["kindRules"].push_back({{"match", kindRules[i].first}, {"kind", kindRules[i].second}});
+  return j;
+}
+
+//  CSV Tokenizer
+
+void
+CsvTokenizer::EndField()
+{
+  m_fields.push_back(m_field);
+  m_field.clear();
+  m_afterQuote = false;
+}
+
+void
+CsvTokenizer::EndRow()
+{
+  EndField();
+  std::string &last = m_fields.back();
+  if (!last.empty() && last[last.size() - 1] == '\r')
+    last.erase(last.size() - 1);
+  if (m_fields.size() > 1 || !m_fields[0].empty())
+    m_handler(m_fields);  //  Skip empty lines
+  m_fields.clear();
+}
+
+void
+CsvTokenizer::Feed(const char *p, size_t len)
+{
+  const char *end = p + len;
+  while (p < end) {
+    if (m_inQuote) {
+      const char *q = (const char *)memchr(p, '"', end - p);
+      if (q == NULL) {
+        m_field.append(p, end);
+        return;
+      }
+      m_field.append(p, q);
+      p = q + 1;
+      m_inQuote = false;
+      m_afterQuote = true;
+      continue;
+    }
+    const char *q = scanFor(p, end, m_delimiter, '"', '\n');
+    if (q > p) {
+      if (!m_afterQuote || q - p > 1 || *p != '\r')
+        m_field.append(p, q);  //  (CR after the closing quote is dropped)
+      m_afterQuote = false;
+    }
+    if (q == end)
+      return;
+    char c = *q;
+    p = q + 1;
+    if (c == '"') {
+      if (m_afterQuote)
+        m_field += '"';  //  Doubled quote in a quoted field
+      m_inQuote = true;
+      m_afterQuote = false;
+    } else if (c == m_delimiter) {
+      EndField();
+    } else {
+      EndRow();
+    }
+  }
+}
+
+void
+CsvTokenizer::Finish()
+{
+  if (m_inQuote || m_afterQuote || !m_field.empty() || !m_fields.empty())
+    EndRow();
+  m_inQuote = m_afterQuote = false;
+}
+
+//  Field Parsers
+
+//  Accepts 2024/01/05, 2024-1-5, 2024.01.05, 20240105, 2024年1月5日, 24/01/05
+//  Returns yyyymmdd, or 0 if not a date
+static int
+parseDate(const std::string &s)
+{
+  int nums[3] = {0, 0, 0};
+  int digits[3] = {0, 0, 0};
+  int n = 0;
+  bool inNum = false;
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c >= '0' && c <= '9') {
+      if (!inNum) {
+        if (n == 3)
+          return 0;
+        inNum = true;
+        n++;
+      }
+      nums[n - 1] = nums[n - 1] * 10 + (c - '0');
+      if (++digits[n - 1] > 8)
+        return 0;
+    } else {
+      inNum = false;
+      if (n > 0 && (c == ' ' || c == 'T'))
+        break;  //  Time may follow
+    }
+  }
+  int y, m, d;
+  if (n == 1 && digits[0] == 8) {
+    y = nums[0] / 10000;
+    m = nums[0] / 100 % 100;
+    d = nums[0] % 100;
+  } else if (n == 3) {
+    y = nums[0];
+    m = nums[1];
+    d = nums[2];
+    if (digits[0] <= 2)
+      y += 2000;
+  } else {
+    return 0;
+  }
+  if (y < 1900 || y > 2999 || m < 1 || m > 12 || d < 1 || d > 31)
+    return 0;
+  return y * 10000 + m * 100 + d;
+}
+
+//  Accepts "1,234", "¥1,234", "1234円", "-1234", "△1,234", full-width digits
+static bool
+parseAmount(const std::string &s, long long &amount)
+{
+  long long v = 0;
+  bool neg = false, hasDigit = false;
+  const unsigned char *p = (const unsigned char *)s.data();
+  const unsigned char *end = p + s.size();
+  while (p < end) {
+    unsigned char c = *p;
+    if (c >= '0' && c <= '9') {
+      v = v * 10 + (c - '0');
+      hasDigit = true;
+      p++;
+    } else if (c == 0xEF && end - p >= 3 && p[1] == 0xBC && p[2] >= 0x90 && p[2] <= 0x99) {
+      v = v * 10 + (p[2] - 0x90);  //  Full-width digit
+      hasDigit = true;
+      p += 3;
+    } else if (c == '.') {
+      break;  //  Ignore fractions
+    } else {
+      if (!hasDigit) {
+        if (c == '-')
+          neg = true;
+        else if (c == 0xE2 && end - p >= 3 && p[1] == 0x96 && (p[2] == 0xB3 || p[2] == 0xB2))
+          neg = true;  //  U+25B3 △, U+25B2 ▲
+        else if (c == 0xE3 && end - p >= 3 && p[1] == 0x83 && p[2] == 0xBC)
+          neg = true;  //  U+30FC ー
+      }
+      p++;
+    }
+  }
+  if (!hasDigit)
+    return false;
+  amount = (neg ? -v : v);
+  return true;
+}
+
+//  Validate UTF-8; an incomplete sequence at the end is allowed
+static bool
+isValidUtf8(const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)s;
+  const unsigned char *end = p + len;
+  while (p < end) {
+    unsigned char c = *p;
+    int n;
+    if (c < 0x80)
+      n = 0;
+    else if (c >= 0xC2 && c <= 0xDF)
+      n = 1;
+    else if (c >= 0xE0 && c <= 0xEF)
+      n = 2;
+    else if (c >= 0xF0 && c <= 0xF4)
+      n = 3;
+    else
+      return false;
+    p++;
+    for (int i = 0; i < n; i++, p++) {
+      if (p >= end)
+        return true;
+      if ((*p & 0xC0) != 0x80)
+        return false;
+    }
+  }
+  return true;
+}
+
+//  Import
+
+bool
+importStatement(const std::string &path, const ImportProfile &profile, size_t batchSize,
+                std::function<void(const json &rows)> onBatch, json &summary)
+{
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  wxFFile file(wxString(path.c_str(), *wxConvFileName), "rb");
+  if (!file.IsOpened())
+    return false;
+  if (batchSize == 0)
+    batchSize = 1000;
+
+  int lineNo = 0, count = 0, skipped = 0;
+  int firstYm = 0, lastYm = 0;
+  json batch = json::array();
+  CsvTokenizer tokenizer(profile.delimiter, [&](const std::vector<std::string> &f) {
+    if (lineNo++ < profile.skipLines)
+      return;
+    int ymd = 0;
+    long long amount = 0, income = 0;
+    if (profile.dateColumn >= 0 && profile.dateColumn < (int)f.size())
+      ymd = parseDate(f[profile.dateColumn]);
+    bool hasAmount = (profile.amountColumn >= 0 && profile.amountColumn < (int)f.size()
+                      && parseAmount(f[profile.amountColumn], amount));
+    bool hasIncome = (profile.incomeColumn >= 0 && profile.incomeColumn < (int)f.size()
+                      && parseAmount(f[profile.incomeColumn], income) && income != 0);
+    if (ymd == 0 || (!hasAmount && !hasIncome)) {
+      skipped++;  //  Header, footer, or total lines
+      return;
+    }
+    json row;
+    std::string item = (profile.itemColumn >= 0 && profile.itemColumn < (int)f.size() ? f[profile.itemColumn] : "");
+    std::string kind;
+    if (profile.kindColumn >= 0 && profile.kindColumn < (int)f.size())
+      kind = f[profile.kindColumn];
+    for (size_t i = 0; kind.empty() && i < profile.kindRules.size(); i++) {
+      if (item.find(profile.kindRules[i].first) != std::string::npos)
+        kind = profile.kindRules[i].second;
+    }
+    if (kind.empty())
+      kind = profile.kind;
+    int ym = ymd / 100;
+    row["ym"] = ym;
+    row["date"] = ymd % 100;
+    row["item"] = item;
+    row["kind"] = kind;
+    row["isIncome"] = hasIncome;
+    row["amount"] = (hasIncome ? income : amount);
+    row["card"] = profile.card;
+    batch.push_back(row);
+    if (firstYm == 0 || ym < firstYm)
+      firstYm = ym;
+    if (ym > lastYm)
+      lastYm = ym;
+    count++;
+    if (batch.size() >= batchSize) {
+      onBatch(batch);
+      batch = json::array();
+    }
+  });
+
+  //  Read in chunks. Shift_JIS is converted up to the last newline of the chunk
+  //  (a newline is never a part of a multibyte character), and the rest is
+  //  carried over to the next chunk.
+  const size_t kChunkSize = 256 * 1024;
+  std::vector<char> buf(kChunkSize);
+  std::string carry;
+  std::string encoding = profile.encoding;
+  wxCSConv cp932(wxT("CP932"));
+  int badLines = 0;
+  //  wxCSConv gives an empty string if any byte cannot be converted; then
+  //  the lines are converted one by one, and those that fail are skipped
+  //  (so one bad line does not lose the whole chunk)
+  auto feedCp932 = [&](const char *s, size_t len) {
+    wxString ws(s, cp932, len);
+    if (!ws.IsEmpty()) {
+      wxScopedCharBuffer u = ws.utf8_str();
+      tokenizer.Feed(u.data(), u.length());
+      return;
+    }
+    const char *end = s + len;
+    while (s < end) {
+      const char *e = (const char *)memchr(s, '\n', end - s);
+      e = (e == NULL ? end : e + 1);
+      wxString wl(s, cp932, e - s);
+      if (wl.IsEmpty()) {
+        badLines++;
+        skipped++;
+      } else {
+        wxScopedCharBuffer u = wl.utf8_str();
+        tokenizer.Feed(u.data(), u.length());
+      }
+      s = e;
+    }
+  };
+  long long bytes = 0;
+  bool first = true;
+  while (1) {
+    size_t n = file.Read(buf.data(), kChunkSize);
+    bool eof = (n < kChunkSize);
+    const char *p = buf.data();
+    bytes += n;
+    if (first) {
+      first = false;
+      if (n >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        encoding = "UTF-8";  //  Skip BOM
+        p += 3;
+        n -= 3;
+      } else if (encoding == "auto") {
+        encoding = (isValidUtf8(p, n) ? "UTF-8" : "CP932");
+      }
+    }
+    if (encoding == "UTF-8") {
+      tokenizer.Feed(p, n);
+    } else {
+      carry.append(p, n);
+      size_t len = carry.size();
+      if (!eof) {
+        size_t nl = carry.rfind('\n');
+        len = (nl == std::string::npos ? 0 : nl + 1);
+      }
+      if (len > 0) {
+        feedCp932(carry.data(), len);
+        carry.erase(0, len);
+      }
+    }
+    if (eof)
+      break;
+  }
+  tokenizer.Finish();
+  if (!batch.empty())
+    onBatch(batch);
+
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+  summary["count"] = count;
+  summary["skipped"] = skipped;
+  summary["badLines"] = badLines;  //  Included in skipped
+  summary["firstYm"] = firstYm;
+  summary["lastYm"] = lastYm;
+  summary["encoding"] = encoding;
+  summary["bytes"] = bytes;
+  summary["elapsedMs"] = elapsed;
+  metricsAdd("import.files");
+  metricsAdd("import.rows", count);
+  metricsAdd("import.bytes", bytes);
+  metricsAdd("import.badLines", badLines);
+  return true;
+}
+
+//  Profiles
+
+static wxString
+profilesPath(void)
+{
+  wxString sep = wxFileName::GetPathSeparator();
+  return wxGetHomeDir() + sep + wxT("kakeibo") + sep + wxT("importProfiles.json");
+}
+
+json
+loadImportProfiles(void)
+{
+  wxFFile file(profilesPath(), "rt");
+  wxString contents;
+  if (file.IsOpened() && file.ReadAll(&contents, wxConvUTF8)) {
+    json j = json::parse(contents.ToStdString(wxConvUTF8), nullptr, false);
+    if (j.is_array())
+      return j;
+  }
+  return json::array();
+}
+
+bool
+saveImportProfile(const json &profile)
+{
+  json p = ImportProfile::fromJson(profile).toJson();  //  Normalize
+  if (p["name"] == "")
+    return false;
+  json profiles = loadImportProfiles();
+  bool replaced = false;
+  for (json &q : profiles) {
+    if (q.contains("name") && q["name"] == p["name"]) {
+      q = p;
+      replaced = true;
+    }
+  }
+  if (!replaced)
+    profiles.push_back(p);
+  wxFFile file(profilesPath(), "wt");
+  if (!file.IsOpened())
+    return false;
+  return file.Write(wxString(profiles.dump(2).c_str(), wxConvUTF8), wxConvUTF8);
+}
+
+bool
+findImportProfile(const std::string &name, ImportProfile &profile)
+{
+  json profiles = loadImportProfiles();
+  for (const json &q : profiles) {
+    if (q.contains("name") && q["name"] == name) {
+      profile = ImportProfile::fromJson(q);
+      return true;
+    }
+  }
+  return false;
+}
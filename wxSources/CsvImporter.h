@@ -0,0 +1,75 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef CSVIMPORTER_H
+#define CSVIMPORTER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "Json.h"
+
+//  Importer for the statements (CSV files) from banks and credit card companies.
+//  The file is read in chunks, converted to UTF-8 if necessary, split into
+//  fields, and mapped to the kakeibo rows according to an ImportProfile.
+
+//  Column layout of a bank or a card company (column numbers are 0-based, -1 if none)
+struct ImportProfile {
+  std::string name;
+  std::string encoding;   //  "auto", "UTF-8" or "CP932" (Shift_JIS)
+  char delimiter;
+  int skipLines;          //  Header lines
+  int dateColumn;
+  int itemColumn;
+  int amountColumn;       //  Payment (or signed amount)
+  int incomeColumn;       //  Deposit (bank statements)
+  int kindColumn;
+  std::string kind;       //  Default kind
+  std::string card;       //  Card name for all rows
+  std::vector<std::pair<std::string, std::string> > kindRules;  //  (substring of item, kind)
+
+  ImportProfile() : encoding("auto"), delimiter(','), skipLines(0), dateColumn(0),
+    itemColumn(1), amountColumn(2), incomeColumn(-1), kindColumn(-1) {}
+  static ImportProfile fromJson(const json &j);
+  json toJson() const;
+};
+
+//  RFC 4180 CSV tokenizer which accepts the input in pieces.
+//  Quoted fields may contain delimiters, newlines and doubled quotes.
+class CsvTokenizer
+{
+public:
+  typedef std::function<void(const std::vector<std::string> &fields)> RowHandler;
+  CsvTokenizer(char delimiter, RowHandler handler)
+    : m_delimiter(delimiter), m_handler(handler), m_inQuote(false), m_afterQuote(false) {}
+  void Feed(const char *p, size_t len);
+  void Finish();
+private:
+  void EndField();
+  void EndRow();
+  char m_delimiter;
+  RowHandler m_handler;
+  std::vector<std::string> m_fields;
+  std::string m_field;
+  bool m_inQuote;
+  bool m_afterQuote;  //  Just after the closing quote
+};
+
+//  Import the statement file. Rows are passed to onBatch as JSON arrays of
+//  at most batchSize entries ({ym, date, item, kind, isIncome, amount, card}).
+//  Returns false if the file cannot be read; summary has the counts.
+bool importStatement(const std::string &path, const ImportProfile &profile, size_t batchSize,
+                     std::function<void(const json &rows)> onBatch,
+                     json &summary);
+
+//  Profiles are kept in ~/kakeibo/importProfiles.json
+json loadImportProfiles(void);
+bool saveImportProfile(const json &profile);
+bool findImportProfile(const std::string &name, ImportProfile &profile);
+
+#endif // CSVIMPORTER_H
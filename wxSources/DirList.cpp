@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "DirList.h"
+#include "mongoose.h"
+
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#endif
+
+DirLister::DirLister()
+  : m_handle(NULL)
+{
+#if defined(_WIN32)
+  m_first = false;
+  m_data = new WIN32_FIND_DATAW;
+#endif
+}
+
+DirLister::~DirLister()
+{
+  Close();
+#if defined(_WIN32)
+  delete (WIN32_FIND_DATAW *)m_data;
+#endif
+}
+
+bool
+DirLister::Matches(const std::string &name) const
+{
+  if (name == "." || name == "..")
+    return false;
+  return m_pattern.empty() || mg_match(mg_str_n(name.data(), name.size()), mg_str_n(m_pattern.data(), m_pattern.size()), NULL);
+}
+
+#if defined(_WIN32)
+
+bool
+DirLister::Open(const std::string &dir, const std::string &pattern)
+{
+  Close();
+  m_pattern = pattern;
+  std::string spec = dir + "\\*";
+  int n = ::MultiByteToWideChar(CP_UTF8, 0, spec.c_str(), -1, NULL, 0);
+  if (n == 0)
+    return false;
+  std::wstring wspec(n, L'\0');
+  ::MultiByteToWideChar(CP_UTF8, 0, spec.c_str(), -1, &wspec[0], n);
+  HANDLE h = ::FindFirstFileExW(wspec.c_str(), FindExInfoBasic, (WIN32_FIND_DATAW *)m_data,
+                                FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+  if (h == INVALID_HANDLE_VALUE)
+    return false;
+  m_handle = h;
+  m_first = true;
+  return true;
+}
+
+bool
+DirLister::Next(DirEntry &entry)
+{
+  if (m_handle == NULL)
+    return false;
+  WIN32_FIND_DATAW *fd = (WIN32_FIND_DATAW *)m_data;
+  while (true) {
+    if (m_first)
+      m_first = false;
+    else if (!::FindNextFileW((HANDLE)m_handle, fd))
+      return false;
+    int n = ::WideCharToMultiByte(CP_UTF8, 0, fd->cFileName, -1, NULL, 0, NULL, NULL);
+    if (n <= 1)
+      continue;
+    entry.name.assign(n - 1, '\0');
+    ::WideCharToMultiByte(CP_UTF8, 0, fd->cFileName, -1, &entry.name[0], n, NULL, NULL);
+    if (!Matches(entry.name))
+      continue;
+    if (fd->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+      entry.type = "link";
+    else if (fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      entry.type = "dir";
+    else
+      entry.type = "file";
+    entry.size = ((int64_t)fd->nFileSizeHigh << 32) | fd->nFileSizeLow;
+    //  FILETIME counts 100ns from 1601-01-01
+    int64_t t = ((int64_t)fd->ftLastWriteTime.dwHighDateTime << 32) | fd->ftLastWriteTime.dwLowDateTime;
+    entry.mtime = t / 10000000 - 11644473600LL;
+    return true;
+  }
+}
+
+void
+DirLister::Close()
+{
+  if (m_handle != NULL)
+    ::FindClose((HANDLE)m_handle);
+  m_handle = NULL;
+}
+
+#else
+
+bool
+DirLister::Open(const std::string &dir, const std::string &pattern)
+{
+  Close();
+  m_pattern = pattern;
+  DIR *d = ::opendir(dir.c_str());
+  if (d == NULL)
+    return false;
+  m_handle = d;
+  return true;
+}
+
+bool
+DirLister::Next(DirEntry &entry)
+{
+  if (m_handle == NULL)
+    return false;
+  DIR *d = (DIR *)m_handle;
+  struct dirent *de;
+  while ((de = ::readdir(d)) != NULL) {
+    entry.name = de->d_name;
+    if (!Matches(entry.name))
+      continue;
+    struct stat st;
+    if (::fstatat(::dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+      continue;  //  Removed in the meantime
+    if (S_ISREG(st.st_mode))
+      entry.type = "file";
+    else if (S_ISDIR(st.st_mode))
+      entry.type = "dir";
+    else if (S_ISLNK(st.st_mode))
+      entry.type = "link";
+    else
+      entry.type = "other";
+    entry.size = (int64_t)st.st_size;
+    entry.mtime = (int64_t)st.st_mtime;
+    return true;
+  }
+  return false;
+}
+
+void
+DirLister::Close()
+{
+  if (m_handle != NULL)
+    ::closedir((DIR *)m_handle);
+  m_handle = NULL;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef DIRLIST_H
+#define DIRLIST_H
+
+//  Directory listing with the type, size and mtime of each entry, read in
+//  one pass: readdir() (getdents64 on Linux) plus fstatat() relative to the
+//  open directory on UNIX, FindFirstFileExW() on Windows (which returns the
+//  metadata with the names).
+
+#include <stdint.h>
+#include <string>
+
+struct DirEntry {
+  std::string name;   //  UTF-8
+  const char *type;   //  "file", "dir", "link" or "other"
+  int64_t size;
+  int64_t mtime;      //  Seconds since the epoch
+};
+
+class DirLister
+{
+public:
+  DirLister();
+  ~DirLister();
+
+  //  pattern is a glob (* and ?) matched against the names; empty for all
+  bool Open(const std::string &dir, const std::string &pattern = std::string());
+
+  //  The next entry ("." and ".." are skipped); false at the end
+  bool Next(DirEntry &entry);
+
+  void Close();
+
+private:
+  DirLister(const DirLister &);
+  DirLister &operator=(const DirLister &);
+  bool Matches(const std::string &name) const;
+  std::string m_pattern;
+  void *m_handle;
+#if defined(_WIN32)
+  bool m_first;
+  void *m_data;   //  WIN32_FIND_DATAW
+#endif
+};
+
+#endif // DIRLIST_H
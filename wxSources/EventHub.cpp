@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "EventHub.h"
+#include "Metrics.h"
+#include "mongoose.h"
+
+#include <unordered_map>
+
+EventHub &
+EventHub::Get()
+{
+  static EventHub sInstance;
+  return sInstance;
+}
+
+EventHub::EventHub()
+  : m_ring(kRingSize), m_head(1)
+{
+}
+
+void
+EventHub::Publish(const std::string &data)
+{
+  //  Format the SSE message only once; multi-line data needs one "data:"
+  //  field per line
+  std::string msg;
+  size_t pos = 0, nl;
+  while ((nl = data.find('\n', pos)) != std::string::npos) {
+    msg += "data: " + data.substr(pos, nl - pos) + "\n";
+    pos = nl + 1;
+  }
+  msg += "data: " + data.substr(pos) + "\n\n";
+  std::lock_guard<std::mutex> lock(m_mutex);
+  msg = "id: " + std::to_string(m_head) + "\n" + msg;
+  m_ring[m_head % kRingSize] = std::make_shared<const std::string>(msg);
+  m_head++;
+  metricsAdd("event.published");
+}
+
+void
+EventHub::Subscribe(struct mg_connection *c, uint64_t lastEventId)
+{
+  Subscriber sub;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  uint64_t oldest = (m_head > kRingSize ? m_head - kRingSize : 1);
+  sub.id = c->id;
+  if (lastEventId > 0 && lastEventId + 1 >= oldest && lastEventId < m_head)
+    sub.cursor = lastEventId + 1;  //  Resume after reconnection
+  else
+    sub.cursor = m_head;
+  m_subscribers.push_back(sub);
+  metricsSet("event.subscribers", (int64_t)m_subscribers.size());
+}
+
+void
+EventHub::Pump(struct mg_mgr *mgr)
+{
+  if (m_subscribers.empty())
+    return;
+  std::unordered_map<unsigned long, struct mg_connection *> conns;
+  for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next)
+    conns[c->id] = c;
+  int64_t sent = 0;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<Subscriber>::iterator it = m_subscribers.begin();
+  while (it != m_subscribers.end()) {
+    std::unordered_map<unsigned long, struct mg_connection *>::iterator ci = conns.find(it->id);
+    if (ci == conns.end() || ci->second->is_closing || ci->second->is_draining) {
+      it = m_subscribers.erase(it);  //  Connection is gone
+      continue;
+    }
+    struct mg_connection *c = ci->second;
+    if (m_head - it->cursor > kRingSize) {
+      //  Too slow: the events it has not received are already overwritten
+      c->is_draining = 1;
+      it = m_subscribers.erase(it);
+      metricsAdd("event.dropped");
+      continue;
+    }
+    while (it->cursor < m_head && c->send.len < kMaxBacklog) {
+      const std::string &msg = *m_ring[it->cursor % kRingSize];
+      mg_send(c, msg.data(), msg.size());
+      it->cursor++;
+      sent++;
+    }
+    ++it;
+  }
+  metricsSet("event.subscribers", (int64_t)m_subscribers.size());
+  if (sent > 0)
+    metricsAdd("event.sent", sent);
+}
@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef EVENTHUB_H
+#define EVENTHUB_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+struct mg_connection;
+struct mg_mgr;
+
+//  Broadcasts the server events to all the SSE connections
+//  (GET /@vueRunner/event).
+//  Every event is formatted once and stored in a ring buffer with a sequence
+//  number. Each subscriber has its own cursor in the ring, so a slow client
+//  does not hold back the others. A subscriber whose send buffer is full is
+//  skipped until it drains; if it falls behind by more than the ring size,
+//  the connection is closed (EventSource reconnects and resumes with the
+//  Last-Event-ID header as long as the events are still in the ring).
+class EventHub
+{
+public:
+  static EventHub &Get();
+
+  //  Called from any thread
+  void Publish(const std::string &data);
+
+  //  Called from the server thread only
+  void Subscribe(struct mg_connection *c, uint64_t lastEventId = 0);
+  void Pump(struct mg_mgr *mgr);
+  size_t NumSubscribers() const { return m_subscribers.size(); }
+
+private:
+  struct Subscriber {
+    unsigned long id;  //  mg_connection::id
+    uint64_t cursor;   //  Sequence number of the next event to send
+  };
+
+  EventHub();
+
+  enum { kRingSize = 256, kMaxBacklog = 64 * 1024 };
+
+  std::vector<std::shared_ptr<const std::string> > m_ring;
+  uint64_t m_head;  //  Sequence number of the next event to publish
+  std::mutex m_mutex;
+  std::vector<Subscriber> m_subscribers;
+};
+
+#endif // EVENTHUB_H
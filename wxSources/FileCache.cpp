@@ -0,0 +1,328 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "FileCache.h"
+#include "Metrics.h"
+
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class StringBlob : public FileBlob
+{
+public:
+  StringBlob(const std::string &s) : m_string(s) {
+    m_data = m_string.data();
+    m_size = m_string.size();
+  }
+private:
+  std::string m_string;
+};
+
+class MappedBlob : public FileBlob
+{
+public:
+  MappedBlob(const char *data, size_t size) {
+    m_data = data;
+    m_size = size;
+  }
+  ~MappedBlob() {
+#if defined(_WIN32)
+    ::UnmapViewOfFile(m_data);
+#else
+    ::munmap((void *)m_data, m_size);
+#endif
+  }
+};
+
+FileBlobPtr
+makeStringBlob(const std::string &text)
+{
+  return std::make_shared<StringBlob>(text);
+}
+
+//  Map the whole file (size > 0)
+static FileBlobPtr
+mapFile(const std::string &path, size_t size)
+{
+#if defined(_WIN32)
+  wchar_t wpath[MG_PATH_MAX];
+  if (::MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wpath, MG_PATH_MAX) == 0)
+    return FileBlobPtr();
+  HANDLE file = ::CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return FileBlobPtr();
+  HANDLE mapping = ::CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  ::CloseHandle(file);
+  if (mapping == NULL)
+    return FileBlobPtr();
+  void *p = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+  ::CloseHandle(mapping);  //  The view keeps the mapping
+  if (p == NULL)
+    return FileBlobPtr();
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return FileBlobPtr();
+  void *p = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  //  The mapping stays
+  if (p == MAP_FAILED)
+    return FileBlobPtr();
+#if defined(MADV_SEQUENTIAL)
+  ::madvise(p, size, MADV_SEQUENTIAL);
+#endif
+#endif
+  metricsAdd("fs.mapped");
+  return std::make_shared<MappedBlob>((const char *)p, size);
+}
+
+//  Read a small file in one call
+static FileBlobPtr
+readFile(const std::string &path, size_t size)
+{
+  void *fd = mg_fs_posix.op(path.c_str(), MG_FS_READ);
+  if (fd == NULL)
+    return FileBlobPtr();
+  std::string buf(size, '\0');
+  size_t n = (size > 0 ? mg_fs_posix.rd(fd, &buf[0], size) : 0);
+  mg_fs_posix.cl(fd);
+  buf.resize(n);
+  metricsAdd("fs.readCalls");
+  return makeStringBlob(buf);
+}
+
+FileCache &
+FileCache::Get()
+{
+  static FileCache sFileCache;
+  return sFileCache;
+}
+
+FileBlobPtr
+FileCache::Open(const std::string &path, bool useCache, bool mayMap)
+{
+  size_t size = 0;
+  time_t mtime = 0;
+  int flags = mg_fs_posix.st(path.c_str(), &size, &mtime);
+  if (flags == 0 || (flags & MG_FS_DIR) != 0)
+    return FileBlobPtr();
+  if (size > kMaxCached)
+    return (mayMap ? mapFile(path, size) : readFile(path, size));
+  if (!useCache)
+    return readFile(path, size);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::map<std::string, Entry>::iterator it = m_entries.find(path);
+  if (it != m_entries.end()) {
+    if (it->second.blob->Size() == size && it->second.mtime == mtime) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+      metricsAdd("fs.cacheHits");
+      return it->second.blob;
+    }
+    m_total -= it->second.blob->Size();
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+  }
+  lock.unlock();
+  metricsAdd("fs.cacheMisses");
+  FileBlobPtr blob = readFile(path, size);
+  if (!blob || blob->Size() != size)
+    return blob;  //  Changed while reading: do not cache
+  lock.lock();
+  if (m_entries.find(path) != m_entries.end())
+    return blob;  //  Another thread has read it
+  m_lru.push_front(path);
+  Entry &e = m_entries[path];
+  e.blob = blob;
+  e.mtime = mtime;
+  e.lru = m_lru.begin();
+  m_total += size;
+  //  Evict the least recently used files (those in use are kept alive by
+  //  their references)
+  while (m_total > kBudget && m_lru.size() > 1) {
+    std::map<std::string, Entry>::iterator last = m_entries.find(m_lru.back());
+    m_total -= last->second.blob->Size();
+    m_entries.erase(last);
+    m_lru.pop_back();
+    metricsAdd("fs.evicted");
+  }
+  return blob;
+}
+
+void
+FileCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_lru.clear();
+  m_total = 0;
+}
+
+//  mg_fs_cached
+
+struct CachedFd {
+  FileBlobPtr blob;   //  Reading
+  size_t pos;
+  void *posixFd;      //  Writing (through mg_fs_posix)
+};
+
+static int
+cachedSt(const char *path, size_t *size, time_t *mtime)
+{
+  return mg_fs_posix.st(path, size, mtime);
+}
+
+static void
+cachedLs(const char *path, void (*fn)(const char *, void *), void *userdata)
+{
+  mg_fs_posix.ls(path, fn, userdata);
+}
+
+static void *
+cachedOp(const char *path, int flags)
+{
+  CachedFd *fd;
+  if (flags & MG_FS_WRITE) {
+    void *pfd = mg_fs_posix.op(path, flags);
+    if (pfd == NULL)
+      return NULL;
+    fd = new CachedFd;
+    fd->posixFd = pfd;
+  } else {
+    FileBlobPtr blob = FileCache::Get().Open(path, true, true);  //  The assets in dist
+    if (!blob)
+      return NULL;
+    fd = new CachedFd;
+    fd->blob = blob;
+    fd->posixFd = NULL;
+  }
+  fd->pos = 0;
+  return fd;
+}
+
+static void
+cachedCl(void *p)
+{
+  CachedFd *fd = (CachedFd *)p;
+  if (fd->posixFd != NULL)
+    mg_fs_posix.cl(fd->posixFd);
+  delete fd;
+}
+
+static size_t
+cachedRd(void *p, void *buf, size_t len)
+{
+  CachedFd *fd = (CachedFd *)p;
+  if (fd->posixFd != NULL)
+    return mg_fs_posix.rd(fd->posixFd, buf, len);
+  size_t n = fd->blob->Size() - fd->pos;
+  if (n > len)
+    n = len;
+  memcpy(buf, fd->blob->Data() + fd->pos, n);
+  fd->pos += n;
+  metricsAdd("fs.bytesServed", (int64_t)n);
+  return n;
+}
+
+static size_t
+cachedWr(void *p, const void *buf, size_t len)
+{
+  CachedFd *fd = (CachedFd *)p;
+  return (fd->posixFd != NULL ? mg_fs_posix.wr(fd->posixFd, buf, len) : 0);
+}
+
+static size_t
+cachedSk(void *p, size_t offset)
+{
+  CachedFd *fd = (CachedFd *)p;
+  if (fd->posixFd != NULL)
+    return mg_fs_posix.sk(fd->posixFd, offset);
+  fd->pos = (offset < fd->blob->Size() ? offset : fd->blob->Size());
+  return fd->pos;
+}
+
+static bool
+cachedMv(const char *from, const char *to)
+{
+  return mg_fs_posix.mv(from, to);
+}
+
+static bool
+cachedRm(const char *path)
+{
+  return mg_fs_posix.rm(path);
+}
+
+static bool
+cachedMkd(const char *path)
+{
+  return mg_fs_posix.mkd(path);
+}
+
+struct mg_fs mg_fs_cached = {
+  cachedSt, cachedLs, cachedOp, cachedCl, cachedRd, cachedWr, cachedSk, cachedMv, cachedRm, cachedMkd
+};
+
+void
+prepareFileSend(struct mg_connection *c)
+{
+  //  While a file is being sent, mg_http_serve_file() keeps its mg_fd in
+  //  pfn_data, and the reader fills as much of c->send as is free
+  struct mg_fd *fd = (struct mg_fd *)c->pfn_data;
+  if (fd == NULL || fd->fs != &mg_fs_cached)
+    return;
+  CachedFd *cfd = (CachedFd *)fd->fd;
+  if (cfd->blob && cfd->blob->Size() > FileCache::kMaxCached && c->send.size < FileCache::kSendChunk)
+    mg_iobuf_resize(&c->send, FileCache::kSendChunk);
+}
+
+//  Replies being sent: connection id -> blob and the position
+static std::map<unsigned long, std::pair<FileBlobPtr, size_t> > sSending;
+
+void
+replyWithBlob(struct mg_connection *c, const char *headers, FileBlobPtr blob)
+{
+  mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %lu\r\n\r\n", headers, (unsigned long)blob->Size());
+  sSending[c->id] = std::make_pair(blob, (size_t)0);
+  pumpBlob(c);
+}
+
+void
+pumpBlob(struct mg_connection *c)
+{
+  std::map<unsigned long, std::pair<FileBlobPtr, size_t> >::iterator it = sSending.find(c->id);
+  if (it == sSending.end())
+    return;
+  const FileBlob &blob = *it->second.first;
+  size_t &pos = it->second.second;
+  //  Fill the send buffer up to kSendChunk; the rest waits until it drains
+  if (c->send.len < FileCache::kSendChunk && pos < blob.Size()) {
+    size_t n = FileCache::kSendChunk - c->send.len;
+    if (n > blob.Size() - pos)
+      n = blob.Size() - pos;
+    mg_send(c, blob.Data() + pos, n);
+    pos += n;
+    metricsAdd("fs.bytesServed", (int64_t)n);
+  }
+  if (pos >= blob.Size()) {
+    sSending.erase(it);
+    c->is_resp = 0;  //  Reply complete: the next request may be handled
+  }
+}
+
+void
+dropBlob(struct mg_connection *c)
+{
+  sSending.erase(c->id);
+}
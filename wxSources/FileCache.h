@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+//  Read path for the files served by the HTTP server. Small files (the
+//  assets of the client, mostly) are kept in an LRU cache in memory and
+//  revalidated by size and mtime; larger assets are memory-mapped, and
+//  other large files are read into memory. Either way the contents are
+//  copied straight into the send buffer of the connection, without read()
+//  calls or intermediate buffers.
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "mongoose.h"
+
+//  Read-only contents of a file
+class FileBlob
+{
+public:
+  FileBlob() : m_data(NULL), m_size(0) {}
+  virtual ~FileBlob() {}
+  const char *Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+protected:
+  const char *m_data;
+  size_t m_size;
+};
+typedef std::shared_ptr<const FileBlob> FileBlobPtr;
+
+//  Blob holding a string (e.g. the text not yet saved)
+FileBlobPtr makeStringBlob(const std::string &text);
+
+class FileCache
+{
+public:
+  static FileCache &Get();
+
+  //  The contents of the file, or NULL if it cannot be read. The blob stays
+  //  valid while it is referenced, even after it is evicted or the file is
+  //  replaced. If useCache is false, a small file is read without the cache.
+  //  A large file is mapped only if mayMap: a mapped file that is truncated
+  //  while it is sent raises SIGBUS, and on Windows the view keeps it from
+  //  being replaced. So only the assets of the client (dist, which nobody
+  //  writes) are mapped; the books, which writeTextFile, the append of
+  //  LedgerLog or an editor may rewrite in place, are read.
+  FileBlobPtr Open(const std::string &path, bool useCache = true, bool mayMap = false);
+
+  void Clear();
+
+  static const size_t kMaxCached = 256 * 1024;        //  Larger files are mapped (or read)
+  static const size_t kBudget = 32 * 1024 * 1024;     //  Total of the cached files
+  static const size_t kSendChunk = 256 * 1024;        //  Send buffer for large files
+
+private:
+  struct Entry {
+    FileBlobPtr blob;
+    time_t mtime;
+    std::list<std::string>::iterator lru;
+  };
+  FileCache() : m_total(0) {}
+  std::mutex m_mutex;
+  std::map<std::string, Entry> m_entries;
+  std::list<std::string> m_lru;  //  Most recently used first
+  size_t m_total;
+};
+
+//  Same as mg_fs_posix, except that files opened for reading come from
+//  FileCache
+extern struct mg_fs mg_fs_cached;
+
+//  Enlarge the send buffer if the connection is now serving a large file
+//  from mg_fs_cached (call after mg_http_serve_dir()), so that it is sent
+//  in kSendChunk pieces instead of MG_IO_SIZE.
+void prepareFileSend(struct mg_connection *c);
+
+//  Reply with the blob as the body. The blob is sent in kSendChunk pieces
+//  as the send buffer drains; pumpBlob() should be called on MG_EV_WRITE
+//  and MG_EV_POLL, and dropBlob() on MG_EV_CLOSE. Server thread only.
+void replyWithBlob(struct mg_connection *c, const char *headers, FileBlobPtr blob);
+void pumpBlob(struct mg_connection *c);
+void dropBlob(struct mg_connection *c);
+
+#endif // FILECACHE_H
@@ -0,0 +1,23 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+//  XXH64 (the 64-bit xxHash by Yann Collet); gives the same values as the
+//  reference implementation, so the hashes stored in files stay valid.
+uint64_t xxh64(const void *p, size_t len, uint64_t seed = 0);
+
+//  16 hex digits, as stored in the sidecar files
+std::string hashToString(uint64_t h);
+
+#endif // HASH_H
@@ -0,0 +1,27 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef JSON_H
+#define JSON_H
+
+//  json is the JSON type used throughout the server.
+//
+//  request_json is for the parsed RPC request and the reply built from it
+//  in handlePost() only: its objects and arrays are allocated with
+//  ArenaAllocator, i.e. from the arena of the request, which is reset as
+//  soon as the reply is sent. A request_json must never be kept after the
+//  request; anything passed on (to a worker, a cache, the main thread) is
+//  converted to json, which is an ordinary heap copy.
+
+#include <nlohmann/json.hpp>
+#include "Arena.h"
+
+typedef nlohmann::json json;
+typedef nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t, double, ArenaAllocator> request_json;
+
+#endif // JSON_H
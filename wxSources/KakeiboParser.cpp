@@ -0,0 +1,248 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "KakeiboParser.h"
+#include "SimdScan.h"
+
+#include <string.h>
+
+//  Value of a hex digit, or -1
+static const signed char sHexValue[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+//  Trim like String.prototype.trim(): ASCII white spaces, U+00A0, U+3000 and U+FEFF
+static inline void
+trim(const char *&b, const char *&e)
+{
+  while (b < e) {
+    unsigned char c = (unsigned char)*b;
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+      b++;
+    else if (c == 0xC2 && e - b >= 2 && (unsigned char)b[1] == 0xA0)
+      b += 2;
+    else if (c == 0xE3 && e - b >= 3 && (unsigned char)b[1] == 0x80 && (unsigned char)b[2] == 0x80)
+      b += 3;
+    else if (c == 0xEF && e - b >= 3 && (unsigned char)b[1] == 0xBB && (unsigned char)b[2] == 0xBF)
+      b += 3;
+    else
+      break;
+  }
+  while (b < e) {
+    unsigned char c = (unsigned char)e[-1];
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+      e--;
+    else if (c == 0xA0 && e - b >= 2 && (unsigned char)e[-2] == 0xC2)
+      e -= 2;
+    else if (c == 0x80 && e - b >= 3 && (unsigned char)e[-2] == 0x80 && (unsigned char)e[-3] == 0xE3)
+      e -= 3;
+    else if (c == 0xBF && e - b >= 3 && (unsigned char)e[-2] == 0xBB && (unsigned char)e[-3] == 0xEF)
+      e -= 3;
+    else
+      break;
+  }
+}
+
+//  Same as decodeHex(): %xx is replaced with the character
+static void
+decodeHex(std::string &out, const char *b, const char *e)
+{
+  out.clear();
+  while (b < e) {
+    const char *q = scanFor(b, e, '%', '%', '%');
+    out.append(b, q);
+    if (q == e)
+      break;
+    int hi, lo;
+    if (e - q >= 3 && (hi = sHexValue[(unsigned char)q[1]]) >= 0 && (lo = sHexValue[(unsigned char)q[2]]) >= 0) {
+      //  String.fromCharCode() gives U+0000..U+00FF, so write it in UTF-8
+      int c = hi * 16 + lo;
+      if (c < 0x80)
+        out += (char)c;
+      else {
+        out += (char)(0xC0 | (c >> 6));
+        out += (char)(0x80 | (c & 0x3F));
+      }
+      b = q + 3;
+    } else {
+      out += '%';
+      b = q + 1;
+    }
+  }
+}
+
+//  Same as parseInt(s) for decimal numbers, except that NaN gives 0.
+//  (The caller has already trimmed the field.)
+static inline int64_t
+parseInteger(const char *b, const char *e)
+{
+  bool neg = false;
+  if (b < e && (*b == '-' || *b == '+')) {
+    neg = (*b == '-');
+    b++;
+  }
+  int64_t v = 0;
+  while (b < e && (unsigned)(*b - '0') < 10) {
+    v = v * 10 + (*b - '0');
+    b++;
+  }
+  return (neg ? -v : v);
+}
+
+static inline uint32_t
+internField(StringTable &strings, const char *b, const char *e, bool escaped, std::string &buf)
+{
+  trim(b, e);
+  if (!escaped)
+    return strings.Intern(b, e - b);
+  decodeHex(buf, b, e);
+  return strings.Intern(buf);
+}
+
+static inline bool
+isLine(const char *b, const char *e, const char *s)
+{
+  size_t n = strlen(s);
+  return ((size_t)(e - b) == n && memcmp(b, s, n) == 0);
+}
+
+bool
+parseKakeibo(const char *buf, size_t len, Ledger &ledger, std::string *error)
+{
+  enum { kMaxFields = 6 };
+  const char *fb[kMaxFields], *fe[kMaxFields];  //  Beginning and end of the fields
+  bool fesc[kMaxFields];                        //  The field contains '%'
+  const char *p = buf;
+  const char *end = buf + len;
+  std::string tmp;
+  int stage = 0;
+  int lineNo = 0;
+  std::shared_ptr<StringTable> strings(new StringTable(*ledger.strings));
+  std::map<int, std::shared_ptr<LedgerPage> > pages;
+  LedgerPage *page = NULL;
+  int pageYm = -1;
+
+  while (p < end) {
+    //  Split one line into fields. Newlines, commas and '%' are found in
+    //  one pass with the SIMD scanner.
+    const char *lineStart = p, *lineEnd;
+    const char *fieldStart = p;
+    bool escaped = false, anyEscaped = false;
+    int nf = 0;
+    lineNo++;
+    while (1) {
+      const char *q = scanFor(p, end, ',', '\n', '%');
+      if (q < end && *q == '%') {
+        escaped = anyEscaped = true;
+        p = q + 1;
+        continue;
+      }
+      if (nf < kMaxFields) {
+        fb[nf] = fieldStart;
+        fe[nf] = q;
+        fesc[nf] = escaped;
+      }
+      nf++;
+      if (q == end || *q == '\n') {
+        lineEnd = q;
+        p = (q == end ? end : q + 1);
+        break;
+      }
+      p = fieldStart = q + 1;
+      escaped = false;
+    }
+    const char *lb = lineStart, *le = lineEnd;
+    trim(lb, le);
+    if (lb == le)
+      continue;
+    if (*lb == '[') {
+      int newStage = 0;
+      if (isLine(lb, le, "[incomeKinds]"))
+        newStage = 1;
+      else if (isLine(lb, le, "[paymentKinds]"))
+        newStage = 2;
+      else if (isLine(lb, le, "[cards]"))
+        newStage = 3;
+      else if (isLine(lb, le, "[data]"))
+        newStage = 4;
+      if (newStage != 0) {
+        stage = newStage;
+        continue;
+      }
+    }
+    if (stage == 1 || stage == 2) {
+      //  The whole line is a kind
+      if (anyEscaped)
+        decodeHex(tmp, lb, le);
+      else
+        tmp.assign(lb, le);
+      (stage == 1 ? ledger.incomeKinds : ledger.paymentKinds).push_back(tmp);
+    } else if (stage == 3) {
+      if (nf < 2)
+        goto bad;
+      const char *b = fb[0], *e = fe[0];
+      trim(b, e);
+      LedgerCard card;
+      if (fesc[0])
+        decodeHex(card.name, b, e);
+      else
+        card.name.assign(b, e);
+      b = fb[1];
+      e = fe[1];
+      trim(b, e);
+      card.closing = (int)parseInteger(b, e);
+      ledger.cards.push_back(card);
+    } else if (stage == 4) {
+      if (nf < 6)
+        goto bad;
+      const char *b = fb[0], *e = fe[0];
+      trim(b, e);
+      int64_t m = parseInteger(b, e);
+      int ym = (int)(m / 100);
+      LedgerRow row;
+      row.date = (uint8_t)(m % 100);
+      row.item = internField(*strings, fb[1], fe[1], fesc[1], tmp);
+      row.kind = internField(*strings, fb[2], fe[2], fesc[2], tmp);
+      b = fb[3];
+      e = fe[3];
+      trim(b, e);
+      row.isIncome = (e - b == 1 && *b == '1');
+      b = fb[4];
+      e = fe[4];
+      trim(b, e);
+      row.amount = parseInteger(b, e);
+      row.card = internField(*strings, fb[5], fe[5], fesc[5], tmp);
+      if (ym != pageYm) {
+        std::shared_ptr<LedgerPage> &pp = pages[ym];
+        if (!pp)
+          pp.reset(new LedgerPage);
+        page = pp.get();
+        pageYm = ym;
+      }
+      page->push_back(row);
+    } else {
+      goto bad;
+    }
+  }
+  for (std::map<int, std::shared_ptr<LedgerPage> >::iterator it = pages.begin(); it != pages.end(); ++it)
+    ledger.months[it->first] = it->second;
+  ledger.strings = strings;
+  return true;
+
+bad:
+  if (error != NULL)
+    *error = "Bad CSV input at line " + std::to_string(lineNo);
+  return false;
+}
@@ -0,0 +1,24 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KAKEIBOPARSER_H
+#define KAKEIBOPARSER_H
+
+#include <string>
+#include "Ledger.h"
+
+//  Parse the contents of kakeibo.csv into ledger (which should be empty).
+//  The string table starts from a copy of ledger.strings, so that the ids
+//  of the strings in the previous version of the book do not change.
+//  This accepts exactly what readDataFromString() in MainWindow.vue accepts:
+//  [incomeKinds], [paymentKinds], [cards] and [data] sections, the fields
+//  trimmed, and the strings escaped as %xx by encodeHex().
+//  Returns false (with a message in error) if the contents are malformed.
+bool parseKakeibo(const char *buf, size_t len, Ledger &ledger, std::string *error = NULL);
+
+#endif // KAKEIBOPARSER_H
@@ -0,0 +1,251 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "KakeiboWriter.h"
+#include "Metrics.h"
+
+#include <zlib.h>
+#include <chrono>
+
+
+static const size_t kChunkSize = 256 * 1024;
+
+ExportFilter
+ExportFilter::fromJson(const json &j)
+{
+  ExportFilter f;
+  if (j.contains("from") && j["from"].is_number())
+    f.fromYm = j["from"].get<int>();
+  if (j.contains("to") && j["to"].is_number())
+    f.toYm = j["to"].get<int>();
+  if (j.contains("isIncome") && j["isIncome"].is_boolean())
+    f.isIncome = (j["isIncome"].get<bool>() ? 1 : 0);
+  if (j.contains("kinds") && j["kinds"].is_array()) {
+    for (const json &k : j["kinds"])
+      if (k.is_string())
+        f.kinds.insert(k.get<std::string>());
+  }
+  if (j.contains("cards") && j["cards"].is_array()) {
+    for (const json &k : j["cards"])
+      if (k.is_string())
+        f.cards.insert(k.get<std::string>());
+  }
+  if (j.contains("withSettings") && j["withSettings"].is_boolean())
+    f.withSettings = j["withSettings"].get<bool>();
+  return f;
+}
+
+//  Characters escaped by encodeHex(): control characters, '%', ',' and '"'
+static inline bool
+needsEscape(unsigned char c)
+{
+  return (c < 0x20 || c == '%' || c == ',' || c == '"');
+}
+
+static void
+appendEncoded(std::string &out, const std::string &s)
+{
+  static const char sHex[] = "0123456789abcdef";
+  const char *p = s.data(), *end = p + s.size();
+  while (p < end) {
+    const char *q = p;
+    while (q < end && !needsEscape((unsigned char)*q))
+      q++;
+    out.append(p, q);
+    if (q == end)
+      break;
+    out += '%';
+    out += sHex[(unsigned char)*q >> 4];
+    out += sHex[(unsigned char)*q & 15];
+    p = q + 1;
+  }
+}
+
+static inline void
+appendInteger(std::string &out, int64_t v)
+{
+  char buf[24];
+  char *p = buf + sizeof(buf);
+  uint64_t u = (v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v);
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (v < 0)
+    *--p = '-';
+  out.append(p, buf + sizeof(buf) - p);
+}
+
+//  Ids of the strings in the set (strings not in the ledger never match)
+static std::vector<bool>
+idFilter(const Ledger &ledger, const std::set<std::string> &names)
+{
+  std::vector<bool> ok;
+  if (names.empty())
+    return ok;
+  ok.assign(ledger.strings->Size(), false);
+  for (std::set<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    uint32_t id;
+    if (ledger.strings->Find(*it, id))
+      ok[id] = true;
+  }
+  return ok;
+}
+
+size_t
+writeKakeibo(const Ledger &ledger, const ExportFilter &filter,
+             std::function<bool(const char *p, size_t len)> sink)
+{
+  std::string buf;
+  buf.reserve(kChunkSize + 4096);
+  if (filter.withSettings) {
+    buf += "[incomeKinds]\n";
+    for (size_t i = 0; i < ledger.incomeKinds.size(); i++) {
+      appendEncoded(buf, ledger.incomeKinds[i]);
+      buf += '\n';
+    }
+    buf += "[paymentKinds]\n";
+    for (size_t i = 0; i < ledger.paymentKinds.size(); i++) {
+      appendEncoded(buf, ledger.paymentKinds[i]);
+      buf += '\n';
+    }
+    buf += "[cards]\n";
+    for (size_t i = 0; i < ledger.cards.size(); i++) {
+      appendEncoded(buf, ledger.cards[i].name);
+      buf += ',';
+      appendInteger(buf, ledger.cards[i].closing);
+      buf += '\n';
+    }
+  }
+  buf += "[data]\n";
+
+  std::vector<bool> kindOk = idFilter(ledger, filter.kinds);
+  std::vector<bool> cardOk = idFilter(ledger, filter.cards);
+  size_t nrows = 0;
+  LedgerMonths::const_iterator it, itEnd;
+  it = (filter.fromYm > 0 ? ledger.months.lower_bound(filter.fromYm) : ledger.months.begin());
+  itEnd = (filter.toYm > 0 ? ledger.months.upper_bound(filter.toYm) : ledger.months.end());
+  for ( ; it != itEnd; ++it) {
+    const LedgerPage &page = *it->second;
+    int64_t base = (int64_t)it->first * 100;
+    for (size_t i = 0; i < page.size(); i++) {
+      const LedgerRow &row = page[i];
+      if (filter.isIncome >= 0 && (int)row.isIncome != filter.isIncome)
+        continue;
+      if (!kindOk.empty() && !kindOk[row.kind])
+        continue;
+      if (!cardOk.empty() && !cardOk[row.card])
+        continue;
+      appendInteger(buf, base + row.date);
+      buf += ',';
+      appendEncoded(buf, ledger.strings->At(row.item));
+      buf += ',';
+      appendEncoded(buf, ledger.strings->At(row.kind));
+      buf += (row.isIncome ? ",1," : ",0,");
+      appendInteger(buf, row.amount);
+      buf += ',';
+      appendEncoded(buf, ledger.strings->At(row.card));
+      buf += '\n';
+      nrows++;
+      if (buf.size() >= kChunkSize) {
+        if (!sink(buf.data(), buf.size()))
+          return nrows;
+        buf.clear();
+      }
+    }
+  }
+  if (!buf.empty())
+    sink(buf.data(), buf.size());
+  return nrows;
+}
+
+bool
+exportKakeibo(const Ledger &ledger, const std::string &path, const ExportFilter &filter,
+              bool gzip, json &summary)
+{
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  wxString wpath(path.c_str(), *wxConvFileName);
+  wxString wtemp = wpath + wxT(".saving");
+  wxFFile file(wtemp, (gzip ? "wb" : "wt"));
+  if (!file.IsOpened())
+    return false;
+
+  bool ok = true;
+  size_t bytes = 0, fileBytes = 0;
+  z_stream zs;
+  std::vector<unsigned char> zbuf;
+  if (gzip) {
+    memset(&zs, 0, sizeof(zs));
+    //  windowBits 15 + 16: gzip header and trailer
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      file.Close();
+      ::wxRemoveFile(wtemp);
+      return false;
+    }
+    zbuf.resize(kChunkSize);
+  }
+
+  //  Compress (if necessary) and write one piece. flush is Z_FINISH for the last call.
+  std::function<bool(const char *, size_t, int)> put = [&](const char *p, size_t len, int flush) -> bool {
+    if (!gzip) {
+      if (file.Write(p, len) != len)
+        return false;
+      fileBytes += len;
+      return true;
+    }
+    zs.next_in = (Bytef *)p;
+    zs.avail_in = (uInt)len;
+    do {
+      zs.next_out = &zbuf[0];
+      zs.avail_out = (uInt)zbuf.size();
+      int r = deflate(&zs, flush);
+      if (r == Z_STREAM_ERROR)
+        return false;
+      size_t n = zbuf.size() - zs.avail_out;
+      if (n > 0 && file.Write(&zbuf[0], n) != n)
+        return false;
+      fileBytes += n;
+    } while (zs.avail_out == 0);
+    return true;
+  };
+
+  size_t nrows = writeKakeibo(ledger, filter, [&](const char *p, size_t len) -> bool {
+    bytes += len;
+    if (!put(p, len, Z_NO_FLUSH))
+      ok = false;
+    return ok;
+  });
+  if (ok && gzip)
+    ok = put(NULL, 0, Z_FINISH);
+  if (gzip)
+    deflateEnd(&zs);
+  if (!file.Close())
+    ok = false;
+  if (ok)
+    ok = ::wxRenameFile(wtemp, wpath, true);
+  if (!ok)
+    ::wxRemoveFile(wtemp);
+
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+  metricsAdd("export.count");
+  metricsAdd("export.rows", (int64_t)nrows);
+  metricsAdd("export.bytes", (int64_t)bytes);
+  metricsAdd("export.fileBytes", (int64_t)fileBytes);
+  metricsAdd("export.msec", (int64_t)elapsed);
+  if (!ok)
+    metricsAdd("export.failed");
+  summary["rows"] = nrows;
+  summary["bytes"] = bytes;
+  summary["fileBytes"] = fileBytes;
+  summary["elapsedMs"] = elapsed;
+  return ok;
+}
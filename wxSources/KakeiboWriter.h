@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef KAKEIBOWRITER_H
+#define KAKEIBOWRITER_H
+
+#include <string>
+#include <set>
+#include <functional>
+#include "Json.h"
+#include "Ledger.h"
+
+//  Which rows to write. Empty sets mean "all".
+struct ExportFilter {
+  int fromYm;                  //  YYYYMM, 0 if unbounded
+  int toYm;                    //  YYYYMM (inclusive), 0 if unbounded
+  int isIncome;                //  0 or 1, -1 for both
+  std::set<std::string> kinds;
+  std::set<std::string> cards;
+  bool withSettings;           //  Write [incomeKinds], [paymentKinds] and [cards]
+
+  ExportFilter() : fromYm(0), toYm(0), isIncome(-1), withSettings(true) {}
+  static ExportFilter fromJson(const json &j);
+};
+
+//  Serialize the ledger in the kakeibo.csv format, same as
+//  writeDataToString() in MainWindow.vue. The text is passed to sink in
+//  pieces of about 256 KB. Returns the number of rows written.
+size_t writeKakeibo(const Ledger &ledger, const ExportFilter &filter,
+                    std::function<bool(const char *p, size_t len)> sink);
+
+//  Write the ledger to a file (gzip compressed if gzip is true).
+//  summary gets {rows, bytes, fileBytes, elapsedMs}.
+bool exportKakeibo(const Ledger &ledger, const std::string &path, const ExportFilter &filter,
+                   bool gzip, json &summary);
+
+#endif // KAKEIBOWRITER_H
@@ -0,0 +1,137 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef LEDGER_H
+#define LEDGER_H
+
+//  In-memory representation of one kakeibo book (kakeibo.csv) on the server.
+//  This mirrors DataType/Settings in Vue/src/types.ts. The strings (item, kind
+//  and card) are interned in a StringTable and the rows hold their ids.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <string.h>
+
+//  Append-only table of unique strings. Lookup does not allocate: the hash
+//  table (open addressing) holds the ids, and the keys are compared with the
+//  stored strings.
+class StringTable
+{
+public:
+  StringTable() : m_slots(64, 0) { Intern("", 0); }  //  Id 0 is always the empty string
+  uint32_t Intern(const char *s, size_t len) {
+    size_t mask = m_slots.size() - 1;
+    size_t i = (size_t)Hash(s, len) & mask;
+    while (m_slots[i] != 0) {
+      const std::string &t = m_strings[m_slots[i] - 1];
+      if (t.size() == len && memcmp(t.data(), s, len) == 0)
+        return m_slots[i] - 1;
+      i = (i + 1) & mask;
+    }
+    uint32_t id = (uint32_t)m_strings.size();
+    m_strings.push_back(std::string(s, len));
+    m_slots[i] = id + 1;
+    if (m_strings.size() * 2 > m_slots.size())
+      Rehash();
+    return id;
+  }
+  uint32_t Intern(const std::string &s) { return Intern(s.data(), s.size()); }
+  //  Returns false if the string is not in the table
+  bool Find(const std::string &s, uint32_t &id) const {
+    size_t mask = m_slots.size() - 1;
+    size_t i = (size_t)Hash(s.data(), s.size()) & mask;
+    while (m_slots[i] != 0) {
+      if (m_strings[m_slots[i] - 1] == s) {
+        id = m_slots[i] - 1;
+        return true;
+      }
+      i = (i + 1) & mask;
+    }
+    return false;
+  }
+  const std::string &At(uint32_t id) const { return m_strings[id]; }
+  size_t Size() const { return m_strings.size(); }
+
+  static uint64_t Hash(const char *s, size_t n) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+    uint64_t v;
+    while (n >= 8) {
+      memcpy(&v, s, 8);
+      h = (h ^ v) * 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 32;
+      s += 8;
+      n -= 8;
+    }
+    v = 0;
+    memcpy(&v, s, n);
+    h = (h ^ v) * 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 29);
+  }
+
+private:
+  void Rehash() {
+    std::vector<uint32_t> slots(m_slots.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < m_strings.size(); id++) {
+      size_t i = (size_t)Hash(m_strings[id].data(), m_strings[id].size()) & mask;
+      while (slots[i] != 0)
+        i = (i + 1) & mask;
+      slots[i] = id + 1;
+    }
+    m_slots.swap(slots);
+  }
+  std::vector<std::string> m_strings;
+  std::vector<uint32_t> m_slots;  //  id + 1, or 0 if empty
+};
+
+struct LedgerRow {
+  int64_t amount;
+  uint32_t item;   //  Ids in Ledger::strings
+  uint32_t kind;
+  uint32_t card;
+  uint8_t date;    //  Day of the month (0 if undefined)
+  bool isIncome;
+  bool operator==(const LedgerRow &r) const {
+    return amount == r.amount && item == r.item && kind == r.kind && card == r.card
+      && date == r.date && isIncome == r.isIncome;
+  }
+};
+
+struct LedgerCard {
+  std::string name;
+  int closing;
+};
+
+//  The rows of one month. A page is never modified once it is in a Ledger;
+//  a new version of the book copies only the pages that changed and shares
+//  the others.
+typedef std::vector<LedgerRow> LedgerPage;
+typedef std::shared_ptr<const LedgerPage> LedgerPagePtr;
+typedef std::map<int, LedgerPagePtr> LedgerMonths;  //  Key is YYYYMM
+
+struct Ledger {
+  std::vector<std::string> incomeKinds;
+  std::vector<std::string> paymentKinds;
+  std::vector<LedgerCard> cards;
+  LedgerMonths months;
+  std::shared_ptr<const StringTable> strings;  //  Shared between versions until a new string appears
+
+  Ledger() : strings(std::make_shared<StringTable>()) {}
+
+  size_t NumberOfRows() const {
+    size_t n = 0;
+    for (LedgerMonths::const_iterator it = months.begin(); it != months.end(); ++it)
+      n += it->second->size();
+    return n;
+  }
+};
+
+#endif // LEDGER_H
@@ -0,0 +1,335 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "LedgerIndex.h"
+
+#include <algorithm>
+
+
+//  "2024-01-05", "2024/1/5" or 20240105 as YYYYMMDD
+static uint32_t
+dateFromJson(const json &j)
+{
+  if (j.is_number())
+    return j.get<uint32_t>();
+  if (!j.is_string())
+    return 0;
+  std::string s = j.get<std::string>();
+  uint32_t v[3] = { 0, 0, 0 };
+  int n = 0;
+  bool inNumber = false;
+  for (size_t i = 0; i < s.size() && n < 3; i++) {
+    if (s[i] >= '0' && s[i] <= '9') {
+      v[n] = v[n] * 10 + (s[i] - '0');
+      inNumber = true;
+    } else if (inNumber) {
+      n++;
+      inNumber = false;
+    }
+  }
+  if (n == 0 && v[0] > 9999)
+    return v[0];  //  Digits only
+  return v[0] * 10000 + v[1] * 100 + v[2];
+}
+
+static void
+stringSet(const json &j, const char *key, std::set<std::string> &out)
+{
+  if (j.contains(key) && j[key].is_array()) {
+    for (const json &k : j[key])
+      if (k.is_string())
+        out.insert(k.get<std::string>());
+  }
+}
+
+RowQuery
+RowQuery::fromJson(const json &j)
+{
+  RowQuery q;
+  if (j.contains("from"))
+    q.fromDate = dateFromJson(j["from"]);
+  if (j.contains("to"))
+    q.toDate = dateFromJson(j["to"]);
+  if (j.contains("isIncome") && j["isIncome"].is_boolean())
+    q.isIncome = (j["isIncome"].get<bool>() ? 1 : 0);
+  if (j.contains("minAmount") && j["minAmount"].is_number()) {
+    q.hasMinAmount = true;
+    q.minAmount = j["minAmount"].get<int64_t>();
+  }
+  if (j.contains("maxAmount") && j["maxAmount"].is_number()) {
+    q.hasMaxAmount = true;
+    q.maxAmount = j["maxAmount"].get<int64_t>();
+  }
+  stringSet(j, "kinds", q.kinds);
+  stringSet(j, "cards", q.cards);
+  if (j.contains("item") && j["item"].is_string())
+    q.item = j["item"].get<std::string>();
+  if (j.contains("sort") && j["sort"].is_string())
+    q.byAmount = (j["sort"].get<std::string>() == "amount");
+  if (j.contains("descending") && j["descending"].is_boolean())
+    q.descending = j["descending"].get<bool>();
+  if (j.contains("offset") && j["offset"].is_number_unsigned())
+    q.offset = j["offset"].get<size_t>();
+  if (j.contains("limit") && j["limit"].is_number_unsigned())
+    q.limit = j["limit"].get<size_t>();
+  return q;
+}
+
+LedgerIndex::LedgerIndex(std::shared_ptr<const Ledger> ledger) : m_ledger(ledger)
+{
+  size_t n = ledger->NumberOfRows();
+  dateKey.reserve(n);
+  rowIndex.reserve(n);
+  amount.reserve(n);
+  item.reserve(n);
+  kind.reserve(n);
+  card.reserve(n);
+  isIncome.reserve(n);
+  byKind.resize(ledger->strings->Size());
+  byCard.resize(ledger->strings->Size());
+  kindBits.resize(ledger->strings->Size());
+  cardBits.resize(ledger->strings->Size());
+
+  //  The months are already in order; only the rows in a month need sorting
+  std::vector<uint32_t> order;
+  for (LedgerMonths::const_iterator it = ledger->months.begin(); it != ledger->months.end(); ++it) {
+    const LedgerPage &page = *it->second;
+    order.resize(page.size());
+    for (uint32_t i = 0; i < page.size(); i++)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&page](uint32_t a, uint32_t b) {
+      return page[a].date < page[b].date;
+    });
+    uint32_t base = (uint32_t)it->first * 100;
+    for (size_t k = 0; k < order.size(); k++) {
+      const LedgerRow &row = page[order[k]];
+      uint32_t pos = (uint32_t)dateKey.size();
+      dateKey.push_back(base + row.date);
+      rowIndex.push_back(order[k]);
+      amount.push_back(row.amount);
+      item.push_back(row.item);
+      kind.push_back(row.kind);
+      card.push_back(row.card);
+      isIncome.push_back(row.isIncome ? 1 : 0);
+      byKind[row.kind].push_back(pos);
+      byCard[row.card].push_back(pos);
+      kindBits[row.kind].Add(pos);
+      cardBits[row.card].Add(pos);
+      (row.isIncome ? incomeBits : paymentBits).Add(pos);
+    }
+  }
+}
+
+//  Union of the posting lists for the names, limited to [lo, hi)
+void
+LedgerIndex::Postings(const std::vector<std::vector<uint32_t> > &lists, const std::set<std::string> &names,
+                      uint32_t lo, uint32_t hi, std::vector<uint32_t> &out) const
+{
+  out.clear();
+  for (std::set<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    uint32_t id;
+    if (!m_ledger->strings->Find(*it, id) || id >= lists.size())
+      continue;
+    const std::vector<uint32_t> &list = lists[id];
+    std::vector<uint32_t>::const_iterator b = std::lower_bound(list.begin(), list.end(), lo);
+    std::vector<uint32_t>::const_iterator e = std::lower_bound(b, list.end(), hi);
+    size_t mid = out.size();
+    out.insert(out.end(), b, e);
+    std::inplace_merge(out.begin(), out.begin() + mid, out.end());
+  }
+}
+
+//  Positions [lo, hi) in the date range of the query
+void
+LedgerIndex::DateRange(const RowQuery &q, uint32_t &lo, uint32_t &hi) const
+{
+  lo = 0;
+  hi = (uint32_t)dateKey.size();
+  if (q.fromDate > 0)
+    lo = (uint32_t)(std::lower_bound(dateKey.begin(), dateKey.end(), q.fromDate) - dateKey.begin());
+  if (q.toDate > 0)
+    hi = (uint32_t)(std::upper_bound(dateKey.begin(), dateKey.end(), q.toDate) - dateKey.begin());
+}
+
+//  Items containing the substring (checked once per distinct string)
+static std::vector<uint8_t>
+itemFilter(const StringTable &strings, const std::string &sub)
+{
+  std::vector<uint8_t> itemOk;
+  if (!sub.empty()) {
+    itemOk.assign(strings.Size(), 0);
+    for (uint32_t id = 0; id < strings.Size(); id++)
+      itemOk[id] = (strings.At(id).find(sub) != std::string::npos);
+  }
+  return itemOk;
+}
+
+json
+LedgerIndex::Query(const RowQuery &q, size_t &total) const
+{
+  uint32_t lo, hi;
+  DateRange(q, lo, hi);
+  std::vector<uint8_t> itemOk = itemFilter(*m_ledger->strings, q.item);
+
+  //  Candidates from the posting lists
+  std::vector<uint32_t> cand, tmp;
+  bool useList = false;
+  if (lo < hi && !q.kinds.empty()) {
+    Postings(byKind, q.kinds, lo, hi, cand);
+    useList = true;
+  }
+  if (lo < hi && !q.cards.empty()) {
+    Postings(byCard, q.cards, lo, hi, tmp);
+    if (useList) {
+      std::vector<uint32_t> both;
+      std::set_intersection(cand.begin(), cand.end(), tmp.begin(), tmp.end(), std::back_inserter(both));
+      cand.swap(both);
+    } else {
+      cand.swap(tmp);
+    }
+    useList = true;
+  }
+
+  std::vector<uint32_t> hits;
+  size_t ncand = (useList ? cand.size() : (lo < hi ? hi - lo : 0));
+  for (size_t k = 0; k < ncand; k++) {
+    uint32_t pos = (useList ? cand[k] : lo + (uint32_t)k);
+    if (q.isIncome >= 0 && isIncome[pos] != q.isIncome)
+      continue;
+    if (q.hasMinAmount && amount[pos] < q.minAmount)
+      continue;
+    if (q.hasMaxAmount && amount[pos] > q.maxAmount)
+      continue;
+    if (!itemOk.empty() && !itemOk[item[pos]])
+      continue;
+    hits.push_back(pos);
+  }
+  total = hits.size();
+
+  if (q.byAmount) {
+    const std::vector<int64_t> &am = amount;
+    if (q.descending)
+      std::stable_sort(hits.begin(), hits.end(), [&am](uint32_t a, uint32_t b) { return am[a] > am[b]; });
+    else
+      std::stable_sort(hits.begin(), hits.end(), [&am](uint32_t a, uint32_t b) { return am[a] < am[b]; });
+  } else if (q.descending) {
+    std::reverse(hits.begin(), hits.end());
+  }
+
+  json rows = json::array();
+  const StringTable &strings = *m_ledger->strings;
+  for (size_t k = q.offset; k < hits.size() && k < q.offset + q.limit; k++) {
+    uint32_t pos = hits[k];
+    json r;
+    r["ym"] = dateKey[pos] / 100;
+    r["index"] = rowIndex[pos];
+    if (dateKey[pos] % 100 != 0)
+      r["date"] = dateKey[pos] % 100;
+    r["item"] = strings.At(item[pos]);
+    r["kind"] = strings.At(kind[pos]);
+    r["isIncome"] = (isIncome[pos] != 0);
+    r["amount"] = amount[pos];
+    r["card"] = strings.At(card[pos]);
+    rows.push_back(r);
+  }
+  return rows;
+}
+
+Bitmap
+LedgerIndex::Union(const std::vector<Bitmap> &bitmaps, const std::set<std::string> &names) const
+{
+  Bitmap bm;
+  for (std::set<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    uint32_t id;
+    if (m_ledger->strings->Find(*it, id) && id < bitmaps.size())
+      bm = Bitmap::Or(bm, bitmaps[id]);
+  }
+  return bm;
+}
+
+Bitmap
+LedgerIndex::Select(const RowQuery &q) const
+{
+  uint32_t lo, hi;
+  DateRange(q, lo, hi);
+  Bitmap bm = Bitmap::Range(lo, hi);
+  if (q.isIncome >= 0)
+    bm = Bitmap::And(bm, (q.isIncome ? incomeBits : paymentBits));
+  if (!q.kinds.empty())
+    bm = Bitmap::And(bm, Union(kindBits, q.kinds));
+  if (!q.cards.empty())
+    bm = Bitmap::And(bm, Union(cardBits, q.cards));
+  if (q.hasMinAmount || q.hasMaxAmount || !q.item.empty()) {
+    //  Conditions without bitmaps are checked on the columns
+    std::vector<uint8_t> itemOk = itemFilter(*m_ledger->strings, q.item);
+    Bitmap sel;
+    bm.ForEach([&](uint32_t pos) {
+      if ((q.hasMinAmount && amount[pos] < q.minAmount) || (q.hasMaxAmount && amount[pos] > q.maxAmount))
+        return;
+      if (!itemOk.empty() && !itemOk[item[pos]])
+        return;
+      sel.Add(pos);
+    });
+    bm = sel;
+  }
+  return bm;
+}
+
+json
+LedgerIndex::Sum(const RowQuery &q, const std::string &groupBy) const
+{
+  Bitmap bm = Select(q);
+  const int64_t *am = amount.data();
+  json res;
+  if (groupBy == "kind" || groupBy == "card") {
+    const std::vector<Bitmap> &bitmaps = (groupBy == "kind" ? kindBits : cardBits);
+    json groups = json::object();
+    for (uint32_t id = 0; id < bitmaps.size(); id++) {
+      if (bitmaps[id].Empty())
+        continue;
+      Bitmap b = Bitmap::And(bm, bitmaps[id]);
+      if (b.Empty())
+        continue;
+      json g;
+      g["sum"] = b.Sum(am);
+      g["count"] = b.Cardinality();
+      groups[m_ledger->strings->At(id)] = g;
+    }
+    res["groups"] = groups;
+  } else if (groupBy == "month") {
+    //  ForEach() goes in the order of the date, so the months come in order
+    json groups = json::object();
+    int curYm = -1;
+    int64_t sum = 0;
+    uint64_t count = 0;
+    std::function<void(void)> flush = [&]() {
+      if (count > 0) {
+        json g;
+        g["sum"] = sum;
+        g["count"] = count;
+        groups[std::to_string(curYm)] = g;
+      }
+    };
+    bm.ForEach([&](uint32_t pos) {
+      int ym = (int)(dateKey[pos] / 100);
+      if (ym != curYm) {
+        flush();
+        curYm = ym;
+        sum = 0;
+        count = 0;
+      }
+      sum += am[pos];
+      count++;
+    });
+    flush();
+    res["groups"] = groups;
+  }
+  res["sum"] = bm.Sum(am);
+  res["count"] = bm.Cardinality();
+  return res;
+}
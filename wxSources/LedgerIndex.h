@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef LEDGERINDEX_H
+#define LEDGERINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include "Json.h"
+#include "Ledger.h"
+#include "Bitmap.h"
+
+//  Search conditions for queryRows. Empty sets and zero dates mean "any".
+struct RowQuery {
+  uint32_t fromDate;     //  YYYYMMDD
+  uint32_t toDate;       //  YYYYMMDD (inclusive)
+  int isIncome;          //  0 or 1, -1 for both
+  bool hasMinAmount, hasMaxAmount;
+  int64_t minAmount, maxAmount;
+  std::set<std::string> kinds;
+  std::set<std::string> cards;
+  std::string item;      //  Substring of the item
+  bool byAmount;         //  Sort by amount instead of date
+  bool descending;
+  size_t offset, limit;
+
+  RowQuery() : fromDate(0), toDate(0), isIncome(-1), hasMinAmount(false), hasMaxAmount(false),
+    minAmount(0), maxAmount(0), byAmount(false), descending(false), offset(0), limit(100) {}
+  static RowQuery fromJson(const json &j);
+};
+
+//  Read-only index over one Ledger. The rows are laid out in columns in the
+//  order of the date, and each kind and card has a posting list (ascending
+//  positions in that order). A query narrows the date range by binary search,
+//  merges the posting lists of the requested kinds and cards, and checks the
+//  remaining conditions on the columns.
+class LedgerIndex
+{
+public:
+  explicit LedgerIndex(std::shared_ptr<const Ledger> ledger);
+
+  //  Matching rows as {ym, index, date, item, kind, isIncome, amount, card}
+  //  where (ym, index) locates the row in DataType. total is the number of
+  //  matches before offset/limit is applied.
+  json Query(const RowQuery &q, size_t &total) const;
+
+  //  Rows matching the query (offset, limit and sort are ignored).
+  //  Date, kinds, cards and isIncome are resolved by the bitmaps.
+  Bitmap Select(const RowQuery &q) const;
+
+  //  Sum and count of the matching rows, grouped by "kind", "card" or
+  //  "month" (or a single total if groupBy is empty)
+  json Sum(const RowQuery &q, const std::string &groupBy) const;
+
+  size_t NumberOfRows() const { return dateKey.size(); }
+  const Ledger &GetLedger() const { return *m_ledger; }
+
+  //  Columns (position = order of the date)
+  std::vector<uint32_t> dateKey;   //  YYYYMMDD (DD is 00 if the date is undefined)
+  std::vector<uint32_t> rowIndex;  //  Index in the month page
+  std::vector<int64_t> amount;
+  std::vector<uint32_t> item, kind, card;
+  std::vector<uint8_t> isIncome;
+  //  Posting lists indexed by the string id
+  std::vector<std::vector<uint32_t> > byKind, byCard;
+  //  Bitmaps indexed by the string id, and for isIncome
+  std::vector<Bitmap> kindBits, cardBits;
+  Bitmap incomeBits, paymentBits;
+
+private:
+  std::shared_ptr<const Ledger> m_ledger;  //  Kept alive as long as the index
+  void Postings(const std::vector<std::vector<uint32_t> > &lists, const std::set<std::string> &names,
+                uint32_t lo, uint32_t hi, std::vector<uint32_t> &out) const;
+  Bitmap Union(const std::vector<Bitmap> &bitmaps, const std::set<std::string> &names) const;
+  void DateRange(const RowQuery &q, uint32_t &lo, uint32_t &hi) const;
+};
+
+#endif // LEDGERINDEX_H
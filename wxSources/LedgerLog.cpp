@@ -0,0 +1,681 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "LedgerLog.h"
+#include "ShardedBook.h"
+#include "FileCache.h"
+#include "StatCache.h"
+#include "DirList.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+#include <zlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+static const char kSep = '\\';
+#else
+static const char kSep = '/';
+#endif
+
+enum {
+  kRecordHead = 1,
+  kRecordPage = 2,
+  kRecordDrop = 3,
+  kRecordText = 4,
+  kRecordCommit = 5
+};
+
+static const size_t kFrameBytes = 8;
+static const uint32_t kMaxRecord = 64 * 1024 * 1024;
+
+static wxString
+toWx(const std::string &path)
+{
+  return wxString(path.c_str(), *wxConvFileName);
+}
+
+static void
+putU32(std::string &out, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    out += (char)((v >> (i * 8)) & 0xff);
+}
+
+static uint32_t
+getU32(const char *p)
+{
+  const unsigned char *u = (const unsigned char *)p;
+  return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static void
+putVarint(std::string &out, uint64_t v)
+{
+  while (v >= 0x80) {
+    out += (char)((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  out += (char)v;
+}
+
+static bool
+getVarint(const char *&p, const char *end, uint64_t &v)
+{
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    unsigned char c = (unsigned char)*p++;
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+static void
+putBytes(std::string &out, const std::string &s)
+{
+  putVarint(out, s.size());
+  out += s;
+}
+
+static bool
+getBytes(const char *&p, const char *end, std::string &s)
+{
+  uint64_t n;
+  if (!getVarint(p, end, n) || n > (uint64_t)(end - p))
+    return false;
+  s.assign(p, (size_t)n);
+  p += n;
+  return true;
+}
+
+//  Frame the payload (type byte and fields) as a record
+static void
+appendRecord(std::string &out, const std::string &payload)
+{
+  putU32(out, (uint32_t)payload.size());
+  putU32(out, (uint32_t)crc32(0, (const Bytef *)payload.data(), (uInt)payload.size()));
+  out += payload;
+}
+
+static std::string
+headRecord(const std::string &head)
+{
+  std::string payload(1, (char)kRecordHead);
+  putBytes(payload, head);
+  std::string out;
+  appendRecord(out, payload);
+  return out;
+}
+
+static std::string
+pageRecord(int ym, const std::string &lines)
+{
+  std::string payload(1, (char)kRecordPage);
+  putVarint(payload, (uint64_t)ym);
+  putBytes(payload, lines);
+  std::string out;
+  appendRecord(out, payload);
+  return out;
+}
+
+static std::string
+simpleRecord(int type, uint64_t value)
+{
+  std::string payload(1, (char)type);
+  putVarint(payload, value);
+  std::string out;
+  appendRecord(out, payload);
+  return out;
+}
+
+static std::string
+textRecord(const std::string &text)
+{
+  std::string payload(1, (char)kRecordText);
+  putBytes(payload, text);
+  std::string out;
+  appendRecord(out, payload);
+  return out;
+}
+
+//  Split the text into the head (up to the [data] line) and the lines of
+//  each month. Lines without a date go with the month they follow (or
+//  the first month). Returns false if the months are not in ascending
+//  order, as the text could not be put together again from the months.
+static bool
+splitMonths(const std::string &text, std::string &head, std::map<int, std::string> &months)
+{
+  size_t p = 0;
+  while (p < text.size()) {
+    size_t e = text.find('\n', p);
+    e = (e == std::string::npos ? text.size() : e + 1);
+    size_t s = p, t = e;
+    while (s < t && (text[s] == ' ' || text[s] == '\t'))
+      s++;
+    while (t > s && isspace((unsigned char)text[t - 1]))
+      t--;
+    p = e;
+    if (t - s == 6 && text.compare(s, 6, "[data]") == 0)
+      break;
+  }
+  head.assign(text, 0, p);
+  months.clear();
+  std::string pending;   //  Undated lines before the first month
+  int current = 0;
+  while (p < text.size()) {
+    size_t e = text.find('\n', p);
+    e = (e == std::string::npos ? text.size() : e + 1);
+    size_t s = p;
+    while (s < e && (text[s] == ' ' || text[s] == '\t'))
+      s++;
+    int ym = 0;
+    size_t i;
+    for (i = 0; i < 6 && s + i < e && isdigit((unsigned char)text[s + i]); i++)
+      ym = ym * 10 + (text[s + i] - '0');
+    if (i == 6 && ym != current) {
+      if (ym < current)
+        return false;
+      current = ym;
+      months[current].swap(pending);
+    }
+    if (current == 0)
+      pending.append(text, p, e - p);
+    else
+      months[current].append(text, p, e - p);
+    p = e;
+  }
+  if (!pending.empty())
+    return false;   //  No dated line at all
+  return true;
+}
+
+static bool
+gzipString(const std::string &in, std::string &out)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  out.resize(deflateBound(&z, (uLong)in.size()) + 32);
+  z.next_in = (Bytef *)in.data();
+  z.avail_in = (uInt)in.size();
+  z.next_out = (Bytef *)&out[0];
+  z.avail_out = (uInt)out.size();
+  int r = deflate(&z, Z_FINISH);
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return r == Z_STREAM_END;
+}
+
+static bool
+gunzipString(const char *p, size_t len, std::string &out)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, 15 + 16) != Z_OK)
+    return false;
+  z.next_in = (Bytef *)p;
+  z.avail_in = (uInt)len;
+  out.clear();
+  char buf[64 * 1024];
+  int r;
+  do {
+    z.next_out = (Bytef *)buf;
+    z.avail_out = sizeof(buf);
+    r = inflate(&z, Z_NO_FLUSH);
+    if (r != Z_OK && r != Z_STREAM_END)
+      break;
+    out.append(buf, sizeof(buf) - z.avail_out);
+  } while (r != Z_STREAM_END);
+  inflateEnd(&z);
+  return r == Z_STREAM_END;
+}
+
+static std::string
+baseName(uint64_t generation)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "base-%08llu.gz", (unsigned long long)generation);
+  return buf;
+}
+
+static std::string
+logName(uint64_t generation)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "log-%08llu", (unsigned long long)generation);
+  return buf;
+}
+
+uint64_t
+LedgerLog::Book::DeadBytes() const
+{
+  uint64_t live = headLogBytes;
+  for (std::map<int, uint32_t>::const_iterator it = pageLogBytes.begin(); it != pageLogBytes.end(); ++it)
+    live += it->second;
+  return (logBytes > live ? logBytes - live : 0);
+}
+
+LedgerLog &
+LedgerLog::Get()
+{
+  static LedgerLog sInstance;
+  return sInstance;
+}
+
+std::string
+LedgerLog::DirOf(const std::string &path)
+{
+  return path + ".log";
+}
+
+bool
+LedgerLog::IsLogBook(const std::string &path)
+{
+  return wxDirExists(toWx(DirOf(path)));
+}
+
+std::string
+LedgerLog::Text(const Book &book)
+{
+  if (book.verbatim)
+    return book.text;
+  std::string text = book.head;
+  for (std::map<int, std::string>::const_iterator it = book.pages.begin(); it != book.pages.end(); ++it)
+    text += it->second;
+  return text;
+}
+
+//  The records that make the state from scratch
+std::string
+LedgerLog::StateRecords(const Book &book)
+{
+  std::string out;
+  if (book.verbatim) {
+    out += textRecord(book.text);
+  } else {
+    out += headRecord(book.head);
+    for (std::map<int, std::string>::const_iterator it = book.pages.begin(); it != book.pages.end(); ++it)
+      out += pageRecord(it->first, it->second);
+  }
+  out += simpleRecord(kRecordCommit, book.seq);
+  return out;
+}
+
+//  Apply the records up to the last commit. Returns the number of bytes
+//  consumed; *bad is set if anything follows that is not a whole group.
+size_t
+LedgerLog::Replay(Book &book, const char *p, size_t len, bool inLog, bool *bad)
+{
+  struct Pending {
+    int type;
+    int ym;
+    std::string bytes;
+    uint32_t size;
+  };
+  std::vector<Pending> group;
+  size_t pos = 0, committed = 0;
+  *bad = false;
+  while (pos + kFrameBytes <= len) {
+    uint32_t size = getU32(p + pos);
+    uint32_t crc = getU32(p + pos + 4);
+    if (size == 0 || size > kMaxRecord || size > len - pos - kFrameBytes)
+      break;
+    const char *q = p + pos + kFrameBytes;
+    const char *end = q + size;
+    if ((uint32_t)crc32(0, (const Bytef *)q, size) != crc)
+      break;
+    Pending r;
+    r.type = (unsigned char)*q++;
+    r.ym = 0;
+    r.size = (uint32_t)(kFrameBytes + size);
+    uint64_t v = 0;
+    bool ok;
+    switch (r.type) {
+      case kRecordHead:
+      case kRecordText:
+        ok = getBytes(q, end, r.bytes);
+        break;
+      case kRecordPage:
+        ok = getVarint(q, end, v) && getBytes(q, end, r.bytes);
+        r.ym = (int)v;
+        break;
+      case kRecordDrop:
+      case kRecordCommit:
+        ok = getVarint(q, end, v);
+        r.ym = (int)v;
+        break;
+      default:
+        ok = false;
+        break;
+    }
+    if (!ok)
+      break;
+    pos += r.size;
+    if (r.type != kRecordCommit) {
+      group.push_back(r);
+      continue;
+    }
+    for (size_t i = 0; i < group.size(); i++) {
+      Pending &g = group[i];
+      uint32_t logBytes = (inLog ? g.size : 0);
+      if (g.type == kRecordText) {
+        book.verbatim = true;
+        book.text.swap(g.bytes);
+        book.head.clear();
+        book.pages.clear();
+        book.pageLogBytes.clear();
+        book.headLogBytes = logBytes;
+      } else if (g.type == kRecordHead) {
+        if (book.verbatim) {
+          book.verbatim = false;
+          std::string().swap(book.text);
+        }
+        book.head.swap(g.bytes);
+        book.headLogBytes = logBytes;
+      } else if (g.type == kRecordPage) {
+        book.pages[g.ym].swap(g.bytes);
+        book.pageLogBytes[g.ym] = logBytes;
+      } else if (g.type == kRecordDrop) {
+        book.pages.erase(g.ym);
+        book.pageLogBytes.erase(g.ym);
+      }
+    }
+    group.clear();
+    book.seq = (uint64_t)r.ym;
+    committed = pos;
+  }
+  *bad = (committed < len);
+  return committed;
+}
+
+//  Called with m_mutex locked
+LedgerLog::BookPtr
+LedgerLog::Load(const std::string &path, std::string *error)
+{
+  std::map<std::string, BookPtr>::iterator it = m_books.find(path);
+  if (it != m_books.end())
+    return it->second;
+  std::string dir = DirOf(path);
+  uint64_t generation = 0;
+  std::vector<std::string> names;
+  DirLister lister;
+  DirEntry e;
+  if (lister.Open(dir)) {
+    while (lister.Next(e)) {
+      names.push_back(e.name);
+      if (strncmp(e.name.c_str(), "base-", 5) == 0) {
+        uint64_t g = strtoull(e.name.c_str() + 5, NULL, 10);
+        if (g > generation)
+          generation = g;
+      }
+    }
+    lister.Close();
+  }
+  if (generation == 0) {
+    if (error != NULL)
+      *error = "no base in the log store";
+    return BookPtr();
+  }
+  BookPtr book = std::make_shared<Book>();
+  book->generation = generation;
+  std::string records;
+  FileBlobPtr blob = FileCache::Get().Open(dir + kSep + baseName(generation), false);
+  bool bad = true;
+  if (blob && gunzipString(blob->Data(), blob->Size(), records))
+    Replay(*book, records.data(), records.size(), false, &bad);
+  if (bad) {
+    metricsAdd("log.baseErrors");
+    LOG_ERROR("%s: broken base %s", path.c_str(), baseName(generation).c_str());
+    if (error != NULL)
+      *error = "broken base: " + baseName(generation);
+    return BookPtr();
+  }
+  blob = FileCache::Get().Open(dir + kSep + logName(generation), false);
+  if (blob) {
+    size_t good = Replay(*book, blob->Data(), blob->Size(), true, &bad);
+    book->logBytes = blob->Size();
+    book->torn = bad;
+    metricsAdd("log.replayedBytes", (int64_t)good);
+    if (bad) {
+      metricsAdd("log.tornTails");
+      LOG_WARN("%s: torn tail dropped (%llu of %llu bytes replayed)", path.c_str(),
+               (unsigned long long)good, (unsigned long long)blob->Size());
+    }
+  }
+  m_books[path] = book;
+
+  //  Leftovers of the older generations (a compaction cut short)
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] != baseName(generation) && names[i] != logName(generation))
+      ::wxRemoveFile(toWx(dir + kSep + names[i]));
+  }
+  //  Appending after a torn tail would hide the records behind it
+  if (book->torn)
+    WriteBase(path, *book, generation + 1);
+  return book;
+}
+
+//  Write the state as the base of a new generation with an empty log, and
+//  remove the files of the current one. Called with m_mutex locked.
+bool
+LedgerLog::WriteBase(const std::string &path, Book &book, uint64_t generation)
+{
+  std::string dir = DirOf(path);
+  std::string z;
+  if (!gzipString(StateRecords(book), z) || !writeFileBinary(dir + kSep + baseName(generation), z)) {
+    metricsAdd("log.compactFailed");
+    LOG_ERROR("%s: cannot write %s", path.c_str(), baseName(generation).c_str());
+    return false;
+  }
+  if (book.generation != 0 && book.generation != generation) {
+    ::wxRemoveFile(toWx(dir + kSep + logName(book.generation)));
+    ::wxRemoveFile(toWx(dir + kSep + baseName(book.generation)));
+  }
+  book.generation = generation;
+  book.logBytes = 0;
+  book.headLogBytes = 0;
+  for (std::map<int, uint32_t>::iterator it = book.pageLogBytes.begin(); it != book.pageLogBytes.end(); ++it)
+    it->second = 0;
+  book.torn = false;
+  metricsSet("log.lastBaseBytes", (int64_t)z.size());
+  return true;
+}
+
+bool
+LedgerLog::Create(const std::string &path, const std::string &text, std::string *error)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::string dir = DirOf(path);
+  if (!wxDirExists(toWx(dir)) && !wxFileName::Mkdir(toWx(dir), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+    if (error != NULL)
+      *error = "cannot create " + dir;
+    return false;
+  }
+  //  Replace whatever is there
+  std::vector<std::string> names;
+  DirLister lister;
+  DirEntry e;
+  if (lister.Open(dir)) {
+    while (lister.Next(e))
+      names.push_back(e.name);
+    lister.Close();
+  }
+  for (size_t i = 0; i < names.size(); i++)
+    ::wxRemoveFile(toWx(dir + kSep + names[i]));
+  m_books.erase(path);
+  BookPtr book = std::make_shared<Book>();
+  if (!splitMonths(text, book->head, book->pages)) {
+    book->verbatim = true;
+    book->text = text;
+    book->head.clear();
+    book->pages.clear();
+  }
+  for (std::map<int, std::string>::const_iterator pit = book->pages.begin(); pit != book->pages.end(); ++pit)
+    book->pageLogBytes[pit->first] = 0;
+  if (!WriteBase(path, *book, 1)) {
+    if (error != NULL)
+      *error = "cannot write the base";
+    return false;
+  }
+  m_books[path] = book;
+  StatCache::Get().Invalidate(dir);
+  return true;
+}
+
+bool
+LedgerLog::Read(const std::string &path, std::string &text, std::string *error)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  BookPtr book = Load(path, error);
+  if (!book)
+    return false;
+  text = Text(*book);
+  return true;
+}
+
+bool
+LedgerLog::Save(const std::string &path, const std::string &text)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  BookPtr book = Load(path, NULL);
+  if (!book)
+    return false;
+
+  //  The records of what changed, and the commit
+  std::string head;
+  std::map<int, std::string> months;
+  std::string records;
+  if (!splitMonths(text, head, months)) {
+    if (!book->verbatim || book->text != text)
+      records += textRecord(text);
+  } else {
+    if (book->verbatim || book->head != head)
+      records += headRecord(head);
+    for (std::map<int, std::string>::const_iterator it = months.begin(); it != months.end(); ++it) {
+      std::map<int, std::string>::const_iterator pit = book->pages.find(it->first);
+      if (book->verbatim || pit == book->pages.end() || pit->second != it->second)
+        records += pageRecord(it->first, it->second);
+    }
+    if (!book->verbatim) {
+      for (std::map<int, std::string>::const_iterator pit = book->pages.begin(); pit != book->pages.end(); ++pit) {
+        if (months.count(pit->first) == 0)
+          records += simpleRecord(kRecordDrop, (uint64_t)pit->first);
+      }
+    }
+  }
+  if (records.empty()) {
+    metricsAdd("log.unchanged");
+    return true;
+  }
+  records += simpleRecord(kRecordCommit, book->seq + 1);
+
+  //  One sequential append
+  std::string logPath = DirOf(path) + kSep + logName(book->generation);
+  wxFFile file(toWx(logPath), "ab");
+  if (!file.IsOpened() || file.Write(records.data(), records.size()) != records.size() || !file.Flush()) {
+    metricsAdd("log.appendFailed");
+    LOG_ERROR("Cannot append to %s", logPath.c_str());
+    m_books.erase(path);   //  Part of it may be there; the next load finds the torn tail
+    return false;
+  }
+  file.Close();
+
+  //  The same records bring the state in memory up to date
+  bool bad;
+  Replay(*book, records.data(), records.size(), true, &bad);
+  book->logBytes += records.size();
+  metricsAdd("log.appends");
+  metricsAdd("log.bytesAppended", (int64_t)records.size());
+  metricsAdd("log.bytesAvoided", (int64_t)text.size() - (int64_t)records.size());
+  return true;
+}
+
+time_t
+LedgerLog::ModificationTime(const std::string &path)
+{
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    BookPtr book = Load(path, NULL);
+    if (!book)
+      return 0;
+    generation = book->generation;
+  }
+  std::string dir = DirOf(path);
+  wxString logPath = toWx(dir + kSep + logName(generation));
+  if (wxFileExists(logPath))
+    return wxFileModificationTime(logPath);
+  return wxFileModificationTime(toWx(dir + kSep + baseName(generation)));
+}
+
+bool
+LedgerLog::NeedsCompaction(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<std::string, BookPtr>::iterator it = m_books.find(path);
+  if (it == m_books.end())
+    return false;
+  uint64_t dead = it->second->DeadBytes();
+  return it->second->torn || (dead >= kCompactBytes && dead * 2 >= it->second->logBytes);
+}
+
+bool
+LedgerLog::Compact(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  BookPtr book = Load(path, NULL);
+  if (!book)
+    return false;
+  uint64_t before = book->logBytes;
+  if (!WriteBase(path, *book, book->generation + 1))
+    return false;
+  metricsAdd("log.compactions");
+  metricsAdd("log.bytesReclaimed", (int64_t)before);
+  return true;
+}
+
+std::vector<std::string>
+LedgerLog::Books()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::string> books;
+  for (std::map<std::string, BookPtr>::const_iterator it = m_books.begin(); it != m_books.end(); ++it)
+    books.push_back(it->first);
+  return books;
+}
+
+void
+LedgerLog::Forget(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_books.erase(path);
+}
+
+json
+LedgerLog::Info(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  json res;
+  BookPtr book = Load(path, NULL);
+  if (book) {
+    res["generation"] = book->generation;
+    res["logBytes"] = book->logBytes;
+    res["deadBytes"] = book->DeadBytes();
+    res["months"] = book->pages.size();
+  }
+  return res;
+}
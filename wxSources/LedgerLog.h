@@ -0,0 +1,104 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef LEDGERLOG_H
+#define LEDGERLOG_H
+
+//  Log-structured layout of a book, for books saved many times a day.
+//  For kakeibo.csv, the directory kakeibo.csv.log holds a compacted base
+//  (base-NNNNNNNN.gz) and the log appended since (log-NNNNNNNN) of the
+//  same generation. Both are sequences of binary records:
+//
+//    u32 length, u32 crc32 of the payload, payload (type byte and fields)
+//
+//  head (the settings, up to the [data] line), page (the lines of one
+//  month), drop (a month removed), text (the whole text, for a file whose
+//  months are not in order) and commit. A save appends the records of
+//  the months that changed and a commit in one write; on loading, the
+//  base and then the log are replayed, and only the groups that end with
+//  a commit are applied, so a torn tail (a crash during the append) is
+//  dropped. The base is the state in month order, gzip compressed.
+//
+//  The state is kept in memory with the size of the live record of each
+//  month in the log; the rest of the log is dead space. Compact() writes
+//  the state as the base of the next generation and starts an empty log;
+//  the maintenance job does this in the background once the dead space
+//  passes kCompactBytes and half of the log.
+
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "Json.h"
+
+class LedgerLog
+{
+public:
+  static LedgerLog &Get();
+
+  //  path + ".log"
+  static std::string DirOf(const std::string &path);
+  static bool IsLogBook(const std::string &path);
+
+  //  Make a new store holding text (any store there is replaced)
+  bool Create(const std::string &path, const std::string &text, std::string *error = NULL);
+
+  bool Read(const std::string &path, std::string &text, std::string *error = NULL);
+
+  //  Append the changes from the last saved text
+  bool Save(const std::string &path, const std::string &text);
+
+  //  Modification time of the log (or the base)
+  time_t ModificationTime(const std::string &path);
+
+  bool NeedsCompaction(const std::string &path);
+  bool Compact(const std::string &path);
+
+  //  The books loaded so far
+  std::vector<std::string> Books();
+
+  //  Drop the state (after the store is removed)
+  void Forget(const std::string &path);
+
+  //  {generation, logBytes, deadBytes, months}
+  json Info(const std::string &path);
+
+  static const uint64_t kCompactBytes = 64 * 1024;
+
+private:
+  struct Book {
+    uint64_t generation;
+    std::string head;
+    std::map<int, std::string> pages;         //  YYYYMM -> the lines
+    std::map<int, uint32_t> pageLogBytes;     //  Size of the live record in the log (0: in the base)
+    uint32_t headLogBytes;
+    bool verbatim;                            //  The state is text (a text record)
+    std::string text;
+    uint64_t logBytes;
+    uint64_t seq;
+    bool torn;
+    Book() : generation(0), headLogBytes(0), verbatim(false), logBytes(0), seq(0), torn(false) {}
+    uint64_t DeadBytes() const;
+  };
+  typedef std::shared_ptr<Book> BookPtr;
+
+  LedgerLog() {}
+  BookPtr Load(const std::string &path, std::string *error);
+  bool WriteBase(const std::string &path, Book &book, uint64_t generation);
+  static std::string Text(const Book &book);
+  static std::string StateRecords(const Book &book);
+  static size_t Replay(Book &book, const char *p, size_t len, bool inLog, bool *bad);
+
+  std::map<std::string, BookPtr> m_books;
+  std::mutex m_mutex;
+};
+
+#endif // LEDGERLOG_H
@@ -0,0 +1,315 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Logger.h"
+#include "Metrics.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+
+#include "wx/wx.h"
+
+std::atomic<int> gLogLevel(kLogInfo);
+
+//  Lines lost because the ring of their thread was full
+static std::atomic<int64_t> sDropped(0);
+
+//  One per logging thread. Single producer (the thread) and single
+//  consumer (the writer, under m_mutex): the producer fills the slot at
+//  head and then publishes it by moving head; the consumer reads up to
+//  head and then releases the slots by moving tail.
+struct Logger::Ring {
+  static const uint64_t kSlots = 128;
+  static const size_t kText = 240;
+  struct Slot {
+    int64_t usec;
+    int level;
+    uint32_t len;
+    char text[kText];
+  };
+  Slot slots[kSlots];
+  std::atomic<uint64_t> head;
+  std::atomic<uint64_t> tail;
+  std::atomic<bool> retired;    //  The thread has exited
+  int thread;
+  Ring() : head(0), tail(0), retired(false), thread(0) {}
+};
+
+//  Marks the ring as retired when the thread exits; the writer removes it
+//  after the last lines are written
+struct RingHolder {
+  std::shared_ptr<Logger::Ring> ring;
+  ~RingHolder() {
+    if (ring)
+      ring->retired.store(true, std::memory_order_release);
+  }
+};
+static thread_local RingHolder tRing;
+
+static wxString
+toWx(const std::string &path)
+{
+  return wxString(path.c_str(), *wxConvFileName);
+}
+
+static const char *sLevelNames[] = { "off", "error", "warn", "info", "debug", "trace" };
+static const char *sLevelTags[] = { "OFF", "ERROR", "WARN", "INFO", "DEBUG", "TRACE" };
+
+void
+setLogLevel(int level)
+{
+  if (level < kLogOff)
+    level = kLogOff;
+  if (level > kLogTrace)
+    level = kLogTrace;
+  gLogLevel.store(level, std::memory_order_relaxed);
+  metricsSet("logger.level", level);
+}
+
+int
+logLevelFromName(const char *name)
+{
+  if (name == NULL)
+    return -1;
+  for (int i = kLogOff; i <= kLogTrace; i++) {
+    if (strcmp(name, sLevelNames[i]) == 0)
+      return i;
+  }
+  if (name[0] >= '0' && name[0] <= '5' && name[1] == 0)
+    return name[0] - '0';
+  return -1;
+}
+
+const char *
+logLevelName(int level)
+{
+  if (level < kLogOff || level > kLogTrace)
+    return "?";
+  return sLevelNames[level];
+}
+
+static int64_t
+nowMicroseconds()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void
+logPrintf(int level, const char *fmt, ...)
+{
+  Logger::Ring *ring = Logger::Get().ThisThreadRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t used = head - ring->tail.load(std::memory_order_acquire);
+  if (used >= Logger::Ring::kSlots) {
+    sDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Logger::Ring::Slot &slot = ring->slots[head % Logger::Ring::kSlots];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(slot.text, Logger::Ring::kText, fmt, ap);
+  va_end(ap);
+  if (n < 0)
+    n = 0;
+  if ((size_t)n >= Logger::Ring::kText) {
+    //  Truncated
+    n = Logger::Ring::kText - 1;
+    memcpy(slot.text + n - 3, "...", 3);
+  }
+  slot.len = (uint32_t)n;
+  slot.level = level;
+  slot.usec = nowMicroseconds();
+  ring->head.store(head + 1, std::memory_order_release);
+  //  A burst: drain before the ring is full
+  if (used + 1 == Logger::Ring::kSlots / 2)
+    Logger::Get().Wake();
+}
+
+Logger &
+Logger::Get()
+{
+  static Logger sLogger;
+  return sLogger;
+}
+
+Logger::Logger() : m_thread(NULL), m_stopping(false), m_fp(NULL), m_size(0), m_nextThread(1)
+{
+  const char *env = getenv("WXVUERUNNER_LOG");
+  int level = logLevelFromName(env);
+  if (level >= 0)
+    gLogLevel.store(level, std::memory_order_relaxed);
+}
+
+Logger::Ring *
+Logger::ThisThreadRing()
+{
+  if (!tRing.ring) {
+    std::shared_ptr<Ring> ring(new Ring);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ring->thread = m_nextThread++;
+    m_rings.push_back(ring);
+    tRing.ring = ring;
+  }
+  return tRing.ring.get();
+}
+
+void
+Logger::Start(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_thread != NULL)
+    return;
+  m_path = path;
+  m_stopping = false;
+  m_thread = new std::thread(&Logger::Run, this);
+  metricsSet("logger.level", gLogLevel.load(std::memory_order_relaxed));
+}
+
+void
+Logger::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread == NULL)
+      return;
+    m_stopping = true;
+  }
+  m_cond.notify_all();
+  m_thread->join();
+  delete m_thread;
+  m_thread = NULL;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_fp != NULL) {
+    fclose(m_fp);
+    m_fp = NULL;
+  }
+}
+
+void
+Logger::Wake()
+{
+  m_cond.notify_one();
+}
+
+void
+Logger::Drain()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!m_path.empty())
+    DrainRings(lock);
+}
+
+void
+Logger::Run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  bool busy = false;
+  while (!m_stopping) {
+    if (busy) {
+      //  Lines came while draining: go on, but let a new thread register
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
+    } else {
+      m_cond.wait_for(lock, std::chrono::milliseconds(kDrainMs));
+    }
+    busy = DrainRings(lock);
+  }
+  DrainRings(lock);
+}
+
+//  Called with m_mutex held. The producers never take it (except for the
+//  first line of a thread), so holding it while writing costs them nothing.
+bool
+Logger::DrainRings(std::unique_lock<std::mutex> &lock)
+{
+  (void)lock;
+  int64_t written = 0;
+  char line[Ring::kText + 64];
+  for (size_t i = 0; i < m_rings.size(); ) {
+    Ring &ring = *m_rings[i];
+    //  Read retired before head, so that a ring retired after its last
+    //  line is not removed before that line is written
+    bool retired = ring.retired.load(std::memory_order_acquire);
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      const Ring::Slot &slot = ring.slots[tail % Ring::kSlots];
+      time_t sec = (time_t)(slot.usec / 1000000);
+      struct tm tm;
+#if defined(__WXMSW__)
+      localtime_s(&tm, &sec);
+#else
+      localtime_r(&sec, &tm);
+#endif
+      int n = snprintf(line, sizeof(line), "%04d-%02d-%02d %02d:%02d:%02d.%03d %-5s [%d] ",
+                       tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                       (int)(slot.usec / 1000 % 1000), sLevelTags[slot.level], ring.thread);
+      memcpy(line + n, slot.text, slot.len);
+      n += slot.len;
+      line[n++] = '\n';
+      WriteLine(line, n);
+      written++;
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    if (retired)
+      m_rings.erase(m_rings.begin() + i);
+    else
+      i++;
+  }
+  int64_t dropped = sDropped.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    int n = snprintf(line, sizeof(line), "-- %lld lines dropped (ring full)\n", (long long)dropped);
+    WriteLine(line, n);
+    metricsAdd("logger.dropped", dropped);
+  }
+  if (written > 0 || dropped > 0) {
+    if (m_fp != NULL)
+      fflush(m_fp);
+    metricsAdd("logger.written", written);
+  }
+  return written > 0;
+}
+
+void
+Logger::WriteLine(const char *line, size_t len)
+{
+  if (m_fp == NULL) {
+    m_fp = wxFopen(toWx(m_path), "ab");
+    if (m_fp == NULL)
+      return;
+    fseek(m_fp, 0, SEEK_END);
+    m_size = ftell(m_fp);
+  }
+  if (fwrite(line, 1, len, m_fp) != len)
+    return;
+  m_size += len;
+  metricsAdd("logger.bytes", len);
+  if (m_size >= kMaxBytes)
+    Rotate();
+}
+
+//  wxvuerunner.log -> .1 -> .2 ... -> .kKeep (removed)
+void
+Logger::Rotate()
+{
+  fclose(m_fp);
+  m_fp = NULL;
+  m_size = 0;
+  ::wxRemoveFile(toWx(m_path + "." + std::to_string(kKeep)));
+  for (int i = kKeep - 1; i >= 1; i--) {
+    wxString from = toWx(m_path + "." + std::to_string(i));
+    if (::wxFileExists(from))
+      ::wxRenameFile(from, toWx(m_path + "." + std::to_string(i + 1)), true);
+  }
+  ::wxRenameFile(toWx(m_path), toWx(m_path + ".1"), true);
+  metricsAdd("logger.rotations");
+}
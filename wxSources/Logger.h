@@ -0,0 +1,113 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+//  Diagnostic log (~/wxvuerunner.log). A line is formatted on the calling
+//  thread into a ring buffer owned by that thread, without any lock or
+//  allocation; the writer thread drains the rings every kDrainMs (or as
+//  soon as a ring is half full) and appends the lines to the file, which
+//  is rotated when it exceeds kMaxBytes (wxvuerunner.log.1 ... .kKeep).
+//  A line is dropped, and counted, if the ring of its thread is full.
+//
+//  The LOG_XXX macros compare the level with the current one before the
+//  arguments are evaluated, so a disabled level costs one relaxed atomic
+//  load. The level is set at run time (setLogLevel, the WXVUERUNNER_LOG
+//  environment variable, or the logLevel command).
+//
+//    2026-10-19 12:34:56.789 INFO  [2] Listening on http://127.0.0.1:8081
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+enum LogLevel {
+  kLogOff = 0,
+  kLogError,
+  kLogWarn,
+  kLogInfo,
+  kLogDebug,
+  kLogTrace
+};
+
+extern std::atomic<int> gLogLevel;
+
+inline bool
+logEnabled(int level)
+{
+  return level <= gLogLevel.load(std::memory_order_relaxed);
+}
+
+void setLogLevel(int level);
+int logLevelFromName(const char *name);   //  -1 if unknown
+const char *logLevelName(int level);
+
+void logPrintf(int level, const char *fmt, ...)
+#if defined(__GNUC__)
+  __attribute__((format(printf, 2, 3)))
+#endif
+  ;
+
+#define LOG_AT(level, ...) do { if (logEnabled(level)) logPrintf((level), __VA_ARGS__); } while (0)
+#define LOG_ERROR(...) LOG_AT(kLogError, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(kLogWarn, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(kLogInfo, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(kLogDebug, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(kLogTrace, __VA_ARGS__)
+
+class Logger
+{
+public:
+  static Logger &Get();
+
+  //  Start the writer thread appending to path
+  void Start(const std::string &path);
+
+  //  Write everything logged so far and stop the writer thread
+  void Stop();
+
+  //  Write everything logged so far (on the calling thread)
+  void Drain();
+
+  //  Let the writer thread drain now
+  void Wake();
+
+  static const int kDrainMs = 100;
+  static const int64_t kMaxBytes = 1024 * 1024;
+  static const int kKeep = 3;
+
+  //  The ring of the calling thread (made on the first call)
+  struct Ring;
+  Ring *ThisThreadRing();
+
+private:
+  Logger();
+  void Run();
+  bool DrainRings(std::unique_lock<std::mutex> &lock);
+  void WriteLine(const char *line, size_t len);
+  void Rotate();
+
+  std::vector<std::shared_ptr<Ring> > m_rings;   //  Guarded by m_mutex
+  std::mutex m_mutex;                            //  Registration, the file
+  std::condition_variable m_cond;
+  std::thread *m_thread;
+  bool m_stopping;
+  std::string m_path;
+  FILE *m_fp;
+  int64_t m_size;
+  int m_nextThread;
+};
+
+#endif // LOGGER_H
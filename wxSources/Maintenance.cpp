@@ -0,0 +1,458 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/filename.h>
+
+#include "Maintenance.h"
+#include "ThreadPool.h"
+#include "SaveScheduler.h"
+#include "UndoJournal.h"
+#include "RollupCache.h"
+#include "KakeiboParser.h"
+#include "FileCache.h"
+#include "StatCache.h"
+#include "ShardedBook.h"
+#include "LedgerLog.h"
+#include "DirList.h"
+#include "Hash.h"
+#include "Metrics.h"
+
+#include <time.h>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if defined(_WIN32)
+static const char kSep = '\\';
+#else
+static const char kSep = '/';
+#endif
+
+//  CPU time of the calling thread
+static int64_t
+threadCpuMicros()
+{
+#if defined(_WIN32)
+  FILETIME created, exited, kernel, user;
+  if (::GetThreadTimes(::GetCurrentThread(), &created, &exited, &kernel, &user)) {
+    int64_t k = ((int64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    int64_t u = ((int64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) / 10;
+  }
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MaintenanceBudget::MaintenanceBudget(int budgetMs, const std::atomic<bool> &yield)
+  : m_start(threadCpuMicros()), m_budget((int64_t)budgetMs * 1000), m_yield(yield)
+{
+}
+
+bool
+MaintenanceBudget::Expired() const
+{
+  return m_yield || CpuMicros() >= m_budget;
+}
+
+int64_t
+MaintenanceBudget::CpuMicros() const
+{
+  return threadCpuMicros() - m_start;
+}
+
+Maintenance &
+Maintenance::Get()
+{
+  static Maintenance sMaintenance;
+  return sMaintenance;
+}
+
+void
+Maintenance::Add(const std::string &name, int intervalSec, int budgetMs, MaintenanceTask task)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Job job;
+  job.name = name;
+  job.intervalSec = intervalSec;
+  job.budgetMs = budgetMs;
+  job.task = task;
+  job.due = mg_millis() + (uint64_t)kQuietMs;
+  job.lastRun = 0;
+  job.runs = job.slices = job.cpuUsec = 0;
+  m_jobs.push_back(job);
+}
+
+void
+Maintenance::Start(struct mg_mgr *mgr, std::function<bool()> isBusy)
+{
+  m_isBusy = isBusy;
+  m_lastActivity = mg_millis();
+  mg_timer_add(mgr, kTickMs, MG_TIMER_REPEAT, Tick, this);
+}
+
+void
+Maintenance::NoteActivity()
+{
+  m_lastActivity = mg_millis();
+  if (m_running)
+    m_yield = true;  //  Let the running slice stop at its next check
+}
+
+bool
+Maintenance::RunSoon(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < m_jobs.size(); i++) {
+    if (m_jobs[i].name == name) {
+      m_jobs[i].due = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+Maintenance::Tick(void *arg)
+{
+  ((Maintenance *)arg)->OnTick();
+}
+
+void
+Maintenance::OnTick()
+{
+  if (m_running)
+    return;
+  uint64_t now = mg_millis();
+  size_t index = m_jobs.size();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+      if (m_jobs[i].due <= now && (index == m_jobs.size() || m_jobs[i].due < m_jobs[index].due))
+        index = i;
+    }
+  }
+  if (index == m_jobs.size())
+    return;  //  Nothing to do
+  if (now - m_lastActivity < (uint64_t)kQuietMs || (m_isBusy && m_isBusy())) {
+    metricsAdd("maint.deferred");
+    return;
+  }
+  m_running = true;
+  m_yield = false;
+  ThreadPool::Get().Submit([this, index]() {
+    Job &job = m_jobs[index];  //  The vector does not change after Start()
+    MaintenanceBudget budget(job.budgetMs, m_yield);
+    bool done = job.task(budget);
+    int64_t usec = budget.CpuMicros();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      job.slices++;
+      job.cpuUsec += usec;
+      if (done) {
+        job.runs++;
+        job.lastRun = mg_millis();
+        job.due = job.lastRun + (uint64_t)job.intervalSec * 1000;
+      }
+    }
+    metricsAdd("maint.slices");
+    metricsAdd("maint.cpuUsec", usec);
+    if (m_yield)
+      metricsAdd("maint.yielded");
+    m_running = false;
+  });
+}
+
+json
+Maintenance::Status()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  json res;
+  json jobs = json::array();
+  uint64_t now = mg_millis();
+  for (size_t i = 0; i < m_jobs.size(); i++) {
+    const Job &job = m_jobs[i];
+    json j;
+    j["name"] = job.name;
+    j["runs"] = job.runs;
+    j["slices"] = job.slices;
+    j["cpuUsec"] = job.cpuUsec;
+    j["lastRun"] = (job.lastRun == 0 ? -1 : (int64_t)(now - job.lastRun) / 1000);   //  Seconds ago
+    j["nextRun"] = (job.due <= now ? 0 : (int64_t)(job.due - now) / 1000);          //  Seconds from now
+    jobs.push_back(j);
+  }
+  res["jobs"] = jobs;
+  res["problems"] = json::object();
+  for (std::map<std::string, std::string>::iterator it = m_problems.begin(); it != m_problems.end(); ++it)
+    res["problems"][it->first] = it->second;
+  return res;
+}
+
+void
+Maintenance::ReportProblem(const std::string &path, const std::string &error)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (error.empty())
+    m_problems.erase(path);
+  else
+    m_problems[path] = error;
+}
+
+//  ----------------------------------------------------------------------
+//  Standard jobs
+
+//  The books: <root>/<name>/kakeibo.csv (including "default")
+static std::vector<std::string>
+listBooks(const std::string &root)
+{
+  std::vector<std::string> books;
+  DirLister lister;
+  DirEntry e;
+  if (lister.Open(root)) {
+    while (lister.Next(e)) {
+      if (strcmp(e.type, "dir") != 0)
+        continue;
+      std::string path = root + kSep + e.name + kSep + "kakeibo.csv";
+      if (bookStat(path).exists)
+        books.push_back(path);
+    }
+  }
+  std::sort(books.begin(), books.end());
+  return books;
+}
+
+static std::string
+dirOf(const std::string &path)
+{
+  size_t pos = path.find_last_of(kSep);
+  return (pos == std::string::npos ? std::string() : path.substr(0, pos));
+}
+
+static bool
+removeFile(const std::string &path)
+{
+  bool b = ::wxRemoveFile(wxString(path.c_str(), *wxConvFileName));
+  StatCache::Get().Invalidate(path);
+  return b;
+}
+
+//  A task that calls fn for each book, as many as the budget allows per
+//  slice. A round starts with a fresh list of the books.
+static MaintenanceTask
+forEachBook(const std::string &root, std::function<void(const std::string &path)> fn)
+{
+  struct Round {
+    std::vector<std::string> books;
+    size_t next;
+    Round() : next(0) {}
+  };
+  std::shared_ptr<Round> round = std::make_shared<Round>();
+  return [root, fn, round](const MaintenanceBudget &budget) -> bool {
+    if (round->next >= round->books.size()) {
+      round->books = listBooks(root);
+      round->next = 0;
+    }
+    while (round->next < round->books.size()) {
+      if (budget.Expired())
+        return false;
+      fn(round->books[round->next++]);
+    }
+    return true;
+  };
+}
+
+static bool
+isBackupName(const std::string &name)
+{
+  //  kakeibo_dddddddd.csv
+  if (name.size() != 20 || name.compare(0, 8, "kakeibo_") != 0 || name.compare(16, 4, ".csv") != 0)
+    return false;
+  for (size_t i = 8; i < 16; i++) {
+    if (name[i] < '0' || name[i] > '9')
+      return false;
+  }
+  return true;
+}
+
+//  The backups to delete, from the names sorted newest first. Same rule as
+//  handleBackup() in MainWindow.vue: keep the 10 newest, then one per 10
+//  days for 5 more, one per month for 5 more, and one per year after that.
+static std::vector<std::string>
+backupsToRemove(const std::vector<std::string> &names, size_t blen)
+{
+  std::vector<std::string> removed;
+  int stage = 3, count = 0;
+  std::string last;
+  bool hasLast = false;
+  for (size_t i = 0; i < names.size(); i++) {
+    const std::string &entry = names[i];
+    bool remove = false;
+    if (stage == 3) {
+      if (++count == 10)
+        stage = 4;
+    } else {
+      size_t n = blen + (stage == 4 ? 7 : (stage == 5 ? 6 : 4));
+      if (hasLast && last.compare(0, n, entry, 0, n) == 0) {
+        remove = true;
+      } else {
+        count++;
+        if (stage == 4 && count == 15)
+          stage = 5;
+        else if (stage == 5 && count == 20)
+          stage = 6;
+      }
+    }
+    if (remove)
+      removed.push_back(entry);
+    else {
+      last = entry;
+      hasLast = true;
+    }
+  }
+  return removed;
+}
+
+static uint64_t
+hashFile(const std::string &path, bool *ok)
+{
+  FileBlobPtr blob = openBookFile(path);
+  *ok = (blob != NULL);
+  return (blob ? xxh64(blob->Data(), blob->Size()) : 0);
+}
+
+//  Today's backup, if the book has changed since the newest backup; then
+//  the rotation
+static void
+backupBook(const std::string &path)
+{
+  std::string dir = dirOf(path);
+  std::vector<std::string> names;
+  DirLister lister;
+  DirEntry e;
+  if (lister.Open(dir, "kakeibo_*.csv")) {
+    while (lister.Next(e)) {
+      if (isBackupName(e.name))
+        names.push_back(e.name);
+    }
+  }
+  std::sort(names.rbegin(), names.rend());
+
+  time_t t = time(NULL);
+  struct tm tm;
+#if defined(_WIN32)
+  localtime_s(&tm, &t);
+#else
+  localtime_r(&t, &tm);
+#endif
+  char today[32];
+  snprintf(today, sizeof(today), "kakeibo_%04d%02d%02d.csv", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+  if (names.empty() || names[0] != today) {
+    bool changed = true;
+    if (!names.empty()) {
+      std::string newest = dir + kSep + names[0];
+      FileMeta a = bookStat(path);
+      FileMeta b = StatCache::Get().Stat(newest);
+      if (a.size == b.size || bookLayoutOf(path) != "single") {
+        bool okA, okB;
+        uint64_t hashA = hashFile(path, &okA);
+        uint64_t hashB = hashFile(newest, &okB);
+        changed = !(okA && okB && hashA == hashB);
+      }
+    }
+    if (changed) {
+      std::string backup = dir + kSep + today;
+      if (SaveScheduler::Get().Backup(path, backup)) {
+        StatCache::Get().Invalidate(backup);
+        names.insert(names.begin(), today);
+        metricsAdd("maint.backups");
+      }
+    }
+  }
+  std::vector<std::string> removed = backupsToRemove(names, 8);  //  "kakeibo_"
+  for (size_t i = 0; i < removed.size(); i++) {
+    if (removeFile(dir + kSep + removed[i]))
+      metricsAdd("maint.backupsRemoved");
+  }
+}
+
+static void
+compactJournals(void)
+{
+  std::vector<std::string> books = UndoJournal::Get().LoadedBooks();
+  for (size_t i = 0; i < books.size(); i++) {
+    if (UndoJournal::Get().Compact(books[i]))
+      metricsAdd("maint.journalsCompacted");
+  }
+}
+
+static bool
+compactLogs(const MaintenanceBudget &budget)
+{
+  std::vector<std::string> books = LedgerLog::Get().Books();
+  for (size_t i = 0; i < books.size(); i++) {
+    if (budget.Expired())
+      return false;
+    if (LedgerLog::Get().NeedsCompaction(books[i]) && LedgerLog::Get().Compact(books[i]))
+      metricsAdd("maint.logsCompacted");
+  }
+  return true;
+}
+
+static void
+refreshRollup(const std::string &path)
+{
+  FileBlobPtr blob = openBookFile(path);
+  if (!blob)
+    return;
+  uint64_t hash = xxh64(blob->Data(), blob->Size());
+  json result;
+  if (RollupCache::Get().Peek(path, hash, result))
+    return;  //  Up to date
+  Ledger ledger;
+  if (parseKakeibo(blob->Data(), blob->Size(), ledger)) {
+    RollupCache::Get().Update(path, ledger, &hash);
+    metricsAdd("maint.rollupsRefreshed");
+  }
+}
+
+static void
+checkBook(const std::string &path)
+{
+  std::string error;
+  FileBlobPtr blob = openBookFile(path, &error);  //  Also verifies the segments of a sharded book
+  if (blob) {
+    Ledger ledger;
+    if (!parseKakeibo(blob->Data(), blob->Size(), ledger, &error) && error.empty())
+      error = "malformed";
+  }
+  if (!error.empty())
+    metricsAdd("maint.integrityErrors");
+  metricsAdd("maint.integrityChecked");
+  Maintenance::Get().ReportProblem(path, error);
+}
+
+void
+Maintenance::AddStandardJobs(const std::string &root)
+{
+  Add("backup", 3600, 50, forEachBook(root, backupBook));
+  Add("compactJournals", 600, 20, [](const MaintenanceBudget &) -> bool {
+    compactJournals();
+    return true;
+  });
+  Add("compactLogs", 60, 50, compactLogs);
+  Add("refreshRollups", 600, 50, forEachBook(root, refreshRollup));
+  Add("checkIntegrity", 6 * 3600, 50, forEachBook(root, checkBook));
+}
@@ -0,0 +1,106 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+//  Housekeeping of the books in ~/kakeibo done by the server itself, so
+//  that it does not depend on the client writing the book: daily backups
+//  and their rotation, compaction of the undo journals, refresh of the
+//  rollup sidecars, and integrity checks of the files.
+//
+//  A mongoose timer in the server thread looks for a job that is due once
+//  a second. Nothing is started while the client is active (a request in
+//  the last kQuietMs, or a background request still running). A job runs
+//  on the thread pool, one at a time, in slices: a slice ends when its CPU
+//  budget is used up or as soon as a request comes in, and the job resumes
+//  where it stopped at the next tick.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Json.h"
+#include "mongoose.h"
+
+class MaintenanceBudget
+{
+public:
+  MaintenanceBudget(int budgetMs, const std::atomic<bool> &yield);
+  //  The slice should end (checked between units of work)
+  bool Expired() const;
+  int64_t CpuMicros() const;  //  Used so far
+private:
+  int64_t m_start;
+  int64_t m_budget;
+  const std::atomic<bool> &m_yield;
+};
+
+//  Does some work and returns true when the round is complete (false to
+//  be called again at the next opportunity)
+typedef std::function<bool(const MaintenanceBudget &budget)> MaintenanceTask;
+
+class Maintenance
+{
+public:
+  static Maintenance &Get();
+
+  //  Run task every intervalSec seconds in slices of budgetMs of CPU time
+  void Add(const std::string &name, int intervalSec, int budgetMs, MaintenanceTask task);
+
+  //  The jobs for the books in root
+  void AddStandardJobs(const std::string &root);
+
+  //  Called from the server thread. isBusy tells whether requests are in
+  //  progress elsewhere (on the worker threads).
+  void Start(struct mg_mgr *mgr, std::function<bool()> isBusy);
+
+  //  A request of the client arrived (server thread)
+  void NoteActivity();
+
+  //  Make the job due now
+  bool RunSoon(const std::string &name);
+
+  //  {jobs: [{name, runs, slices, cpuUsec, lastRun, nextRun}], problems: {path: error}}
+  json Status();
+
+  //  Result of an integrity check (an empty error clears the problem)
+  void ReportProblem(const std::string &path, const std::string &error);
+
+  static const int kTickMs = 1000;
+  static const int kQuietMs = 3000;
+
+private:
+  struct Job {
+    std::string name;
+    int intervalSec;
+    int budgetMs;
+    MaintenanceTask task;
+    uint64_t due;        //  mg_millis()
+    uint64_t lastRun;    //  When the last round completed
+    int64_t runs;
+    int64_t slices;
+    int64_t cpuUsec;
+  };
+  Maintenance() : m_running(false), m_yield(false), m_lastActivity(0) {}
+  static void Tick(void *arg);
+  void OnTick();
+
+  std::mutex m_mutex;
+  std::vector<Job> m_jobs;   //  Fixed after Start()
+  std::map<std::string, std::string> m_problems;
+  std::function<bool()> m_isBusy;
+  std::atomic<bool> m_running;
+  std::atomic<bool> m_yield;
+  std::atomic<uint64_t> m_lastActivity;
+};
+
+#endif // MAINTENANCE_H
@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Metrics.h"
+
+#include <map>
+#include <mutex>
+
+static std::map<std::string, int64_t> sCounters;
+static std::mutex sCountersMutex;
+
+void
+metricsAdd(const char *name, int64_t delta)
+{
+  std::lock_guard<std::mutex> lock(sCountersMutex);
+  sCounters[name] += delta;
+}
+
+void
+metricsSet(const char *name, int64_t value)
+{
+  std::lock_guard<std::mutex> lock(sCountersMutex);
+  sCounters[name] = value;
+}
+
+int64_t
+metricsGet(const char *name)
+{
+  std::lock_guard<std::mutex> lock(sCountersMutex);
+  std::map<std::string, int64_t>::const_iterator it = sCounters.find(name);
+  return (it == sCounters.end() ? 0 : it->second);
+}
+
+json
+metricsSnapshot(void)
+{
+  json j = json::object();
+  std::lock_guard<std::mutex> lock(sCountersMutex);
+  for (std::map<std::string, int64_t>::const_iterator it = sCounters.begin(); it != sCounters.end(); ++it) {
+    j[it->first] = it->second;
+  }
+  return j;
+}
@@ -0,0 +1,24 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include "Json.h"
+
+//  Named counters shared by the server thread and the worker threads.
+//  The client can read all of them with the "metrics" command.
+//  Names are dotted, like "save.written" or "save.bytesWritten".
+void metricsAdd(const char *name, int64_t delta = 1);
+void metricsSet(const char *name, int64_t value);
+int64_t metricsGet(const char *name);
+json metricsSnapshot(void);
+
+#endif // METRICS_H
@@ -20,16 +20,39 @@
 #include "MyApp.h"
 #include "MyFrame.h"
 #include "MyWebFrame.h"
+#include "SaveScheduler.h"
+#include "Metrics.h"
+#include "EventHub.h"
+#include "CsvImporter.h"
+#include "BookStore.h"
+#include "KakeiboWriter.h"
+#include "UndoJournal.h"
+#include "ThreadPool.h"
+#include "Rollup.h"
+#include "Consolidation.h"
+#include "RollupCache.h"
+#include "KakeiboParser.h"
+#include "Hash.h"
+#include "FileCache.h"
+#include "DirList.h"
+#include "StatCache.h"
+#include "Maintenance.h"
+#include "Compress.h"
+#include "ShardedBook.h"
+#include "Logger.h"
 
 #include "mongoose.h"
 #include <thread>
 #include <atomic>
 #include <queue>
+#include <deque>
+#include <condition_variable>
 #include <mutex>
+#include <chrono>
+#include <functional>
+#include <memory>
 
-#include <nlohmann/json.hpp>
-
-using json = nlohmann::json;
+#include "Json.h"
 
 //  Shared variable to show the server status
 std::atomic<int> server_status(0);
@@ -68,12 +91,254 @@ std::queue<std::pair<unsigned long, std::string>> sSSEResults;
 //  Mutex for thread-safe access to the queue
 std::mutex sMutex;
 
+//  Content-Encoding accepted by the client for the request being handled
+//  (server thread only; see Compress.h)
+static int sRequestCoding = kCodingIdentity;
+
+//  Send a 200 response with a body already compressed by coding
+static void
+replyEncoded(struct mg_connection *c, const char *contentType, const std::string &body, int coding)
+{
+  mg_printf(c, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Encoding: %s\r\nVary: Accept-Encoding\r\n"
+            "Content-Length: %lu\r\n\r\n", contentType, codingName(coding), (unsigned long)body.size());
+  mg_send(c, body.data(), body.size());
+  c->is_resp = 0;
+}
+
+//  Send a 200 response; the body is compressed if the client accepts it
+//  and it is large enough
+static void
+replyBody(struct mg_connection *c, const char *contentType, const std::string &body, int coding)
+{
+  std::string z;
+  if (compressBody(body.data(), body.size(), coding, z)) {
+    replyEncoded(c, contentType, z, coding);
+  } else {
+    char header[64];
+    snprintf(header, sizeof(header), "Content-Type: %s\r\n", contentType);
+    mg_http_reply(c, 200, header, "%s", body.c_str());
+  }
+}
+
+//  Requests handled on worker threads. The reply (JSON) is compressed on
+//  the worker and left in sBackgroundReplies; mg_wakeup() tells the server
+//  thread to send it (the MG_EV_WAKEUP handler).
+static std::atomic<int> sBackgroundJobs(0);
+
+struct BackgroundReply {
+  std::string body;      //  Compressed if coding is not identity
+  int coding;
+  uint64_t millis;       //  When it was made
+};
+static std::map<unsigned long, BackgroundReply> sBackgroundReplies;
+static std::mutex sBackgroundMutex;
+
+static void
+runInBackground(struct mg_connection *c, std::function<std::string(void)> job)
+{
+  unsigned long id = c->id;
+  int coding = sRequestCoding;
+  sBackgroundJobs++;
+  ThreadPool::Get().Submit([id, coding, job]() {
+    BackgroundReply reply;
+    reply.body = job();
+    reply.coding = kCodingIdentity;
+    reply.millis = mg_millis();
+    std::string z;
+    if (compressBody(reply.body.data(), reply.body.size(), coding, z)) {
+      reply.body.swap(z);
+      reply.coding = coding;
+    }
+    {
+      std::lock_guard<std::mutex> lock(sBackgroundMutex);
+      //  Drop the replies whose connections were closed before they came
+      std::map<unsigned long, BackgroundReply>::iterator it = sBackgroundReplies.begin();
+      while (it != sBackgroundReplies.end()) {
+        if (reply.millis - it->second.millis > 60000)
+          sBackgroundReplies.erase(it++);
+        else
+          ++it;
+      }
+      sBackgroundReplies[id] = reply;
+    }
+    mg_wakeup(&mgr, id, "", 0);
+    sBackgroundJobs--;
+  });
+}
+
+//  Send the reply made by runInBackground() (server thread)
+static void
+sendBackgroundReply(struct mg_connection *c)
+{
+  BackgroundReply reply;
+  {
+    std::lock_guard<std::mutex> lock(sBackgroundMutex);
+    std::map<unsigned long, BackgroundReply>::iterator it = sBackgroundReplies.find(c->id);
+    if (it == sBackgroundReplies.end())
+      return;
+    reply.body.swap(it->second.body);
+    reply.coding = it->second.coding;
+    sBackgroundReplies.erase(it);
+  }
+  if (reply.coding == kCodingIdentity)
+    replyBody(c, "application/json", reply.body, kCodingIdentity);
+  else
+    replyEncoded(c, "application/json", reply.body, reply.coding);
+}
+
+//  Replies streamed from a worker thread (chunked, one chunk per line).
+//  The worker queues the lines and wakes the server thread, which sends
+//  them as the socket drains (pumpBackgroundStream on MG_EV_WAKEUP and
+//  MG_EV_WRITE); the worker waits while kStreamQueueBytes are queued, so
+//  neither side holds the whole reply.
+struct BackgroundStream {
+  std::deque<std::string> lines;   //  Guarded by sBackgroundMutex
+  size_t queuedBytes;
+  bool done;
+  bool closed;                     //  The connection was closed
+  BackgroundStream() : queuedBytes(0), done(false), closed(false) {}
+};
+typedef std::function<void(const std::string &)> StreamWriter;
+static std::map<unsigned long, std::shared_ptr<BackgroundStream> > sBackgroundStreams;  //  Server thread only
+static std::condition_variable sStreamDrained;
+static const size_t kStreamQueueBytes = 256 * 1024;
+
+//  The response header must have been sent; job writes the lines
+static void
+streamInBackground(struct mg_connection *c, std::function<void(const StreamWriter &)> job)
+{
+  unsigned long id = c->id;
+  std::shared_ptr<BackgroundStream> stream = std::make_shared<BackgroundStream>();
+  sBackgroundStreams[id] = stream;
+  sBackgroundJobs++;
+  ThreadPool::Get().Submit([id, stream, job]() {
+    job([id, stream](const std::string &line) {
+      {
+        std::unique_lock<std::mutex> lock(sBackgroundMutex);
+        while (!stream->closed && stream->queuedBytes >= kStreamQueueBytes)
+          sStreamDrained.wait(lock);
+        if (stream->closed)
+          return;  //  Nobody to send to; the job runs to the end all the same
+        stream->lines.push_back(line);
+        stream->queuedBytes += line.size();
+      }
+      mg_wakeup(&mgr, id, "", 0);
+    });
+    {
+      std::lock_guard<std::mutex> lock(sBackgroundMutex);
+      stream->done = true;
+    }
+    mg_wakeup(&mgr, id, "", 0);
+    sBackgroundJobs--;
+  });
+}
+
+//  Send the queued lines while the send buffer has room (server thread)
+static void
+pumpBackgroundStream(struct mg_connection *c)
+{
+  std::map<unsigned long, std::shared_ptr<BackgroundStream> >::iterator it = sBackgroundStreams.find(c->id);
+  if (it == sBackgroundStreams.end())
+    return;
+  BackgroundStream &stream = *it->second;
+  bool finished = false;
+  {
+    std::lock_guard<std::mutex> lock(sBackgroundMutex);
+    while (c->send.len < FileCache::kSendChunk && !stream.lines.empty()) {
+      const std::string &line = stream.lines.front();
+      mg_http_write_chunk(c, line.data(), line.size());
+      stream.queuedBytes -= line.size();
+      stream.lines.pop_front();
+    }
+    finished = (stream.done && stream.lines.empty());
+  }
+  sStreamDrained.notify_all();
+  if (finished) {
+    mg_http_write_chunk(c, "", 0);  //  End of the chunked response
+    sBackgroundStreams.erase(it);
+    c->is_resp = 0;
+  }
+}
+
+//  The connection was closed, or the server is stopping: the worker need
+//  not wait any more
+static void
+closeBackgroundStream(unsigned long id)
+{
+  std::map<unsigned long, std::shared_ptr<BackgroundStream> >::iterator it = sBackgroundStreams.find(id);
+  if (it == sBackgroundStreams.end())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(sBackgroundMutex);
+    it->second->closed = true;
+  }
+  sBackgroundStreams.erase(it);
+  sStreamDrained.notify_all();
+}
+
+//  Bring the rollup sidecar of the book up to date with the text (which is
+//  the contents of the file, just read or written). snap is the snapshot
+//  made from the text, if any; otherwise the text is parsed again.
+static void
+refreshRollupCache(const std::string &path, const char *buf, size_t len, BookSnapshotPtr snap)
+{
+  uint64_t hash = xxh64(buf, len);
+  if (snap) {
+    ThreadPool::Get().Submit([path, snap, hash]() {
+      RollupCache::Get().Update(path, *snap->ledger, &hash);
+    });
+  } else {
+    std::string text(buf, len);
+    ThreadPool::Get().Submit([path, text, hash]() {
+      Ledger ledger;
+      if (parseKakeibo(text.data(), text.size(), ledger))
+        RollupCache::Get().Update(path, ledger, &hash);
+    });
+  }
+}
+
+//  Generation of the newest text sent by scheduleSave for each book; the
+//  texts are parsed into BookStore one at a time, and a text that is
+//  already superseded is not parsed (the newer one has all its edits)
+static std::mutex sParseMutex;
+static std::map<std::string, uint64_t> sNewestText;
+static std::mutex sParseRunMutex;
+
+//  Parts of the replies of handlePost()
+static request_json
+rowToJson(const LedgerRow &row, const StringTable &strings)
+{
+  request_json r;
+  if (row.date != 0)
+    r["date"] = row.date;
+  r["item"] = strings.At(row.item);
+  r["kind"] = strings.At(row.kind);
+  r["isIncome"] = row.isIncome;
+  r["amount"] = row.amount;
+  r["card"] = strings.At(row.card);
+  return r;
+}
+
+static request_json
+metaToJson(const FileMeta &meta)
+{
+  request_json res;
+  res["exists"] = meta.exists;
+  if (meta.exists) {
+    res["type"] = (meta.isDir ? "dir" : "file");
+    res["size"] = meta.size;
+    res["mtime"] = meta.mtime;
+  }
+  return res;
+}
+
 void
-handlePost(struct mg_connection *c, json &j)
+handlePost(struct mg_connection *c, request_json &j)
 {
   std::string cmd = j["cmd"];
   std::string ret;
   std::string type = "text/plain";
+  LOG_TRACE("rpc %s", cmd.c_str());
   
   //  std::string and wxString
   //  The strings in json and in res are std::string encoded in UTF-8.
@@ -83,10 +348,6 @@ handlePost(struct mg_connection *c, json &j)
   //  explicitly specify the encoding; *wxConvFileName for filenames, and
   //  wxConvUTF8 for other strings.
   
-  if (j["id"] != sRandomId) {
-    mg_http_reply(c, 401, "", "");  /*  Unauthorized  */
-    return;
-  }
   if (cmd == "homeDir") {
     ret = wxGetHomeDir().ToStdString(*wxConvFileName);
   } else if (cmd == "isAvailable") {
@@ -98,23 +359,37 @@ handlePost(struct mg_connection *c, json &j)
     ret = dirPath + pathSep + file;
   } else if (cmd == "mkdir") {
     std::string path = j["path"];
-    json options = j["options"];
+    request_json options = j["options"];
     bool recursive = false;
     if (options.contains("recursive")) {
       recursive = options["recursive"];
     }
     wxString wpath(path.c_str(), *wxConvFileName);
     bool b = wxFileName::Mkdir(wpath, wxS_DIR_DEFAULT, (recursive ? wxPATH_MKDIR_FULL : 0));
+    StatCache::Get().Invalidate(path);
     ret = (b ? "ok" : "");
   } else if (cmd == "exists") {
     std::string path = j["path"];
-    wxString wpath(path.c_str(), *wxConvFileName);
-    bool b = wxFileName::Exists(wpath);
+    bool b = bookStat(path).exists;
     ret = (b ? "ok" : "");
+  } else if (cmd == "stat") {
+    //  {exists, type, size, mtime} of path, or an array of them for paths
+    //  (answered from StatCache for the files under ~/kakeibo)
+    request_json res;
+    if (j.contains("paths") && j["paths"].is_array()) {
+      res = request_json::array();
+      for (const request_json &p : j["paths"])
+        res.push_back(metaToJson(bookStat(p.is_string() ? p.get<std::string>() : std::string())));
+    } else {
+      res = metaToJson(bookStat(j["path"]));
+    }
+    ret = res.dump();
+    type = "application/json";
   } else if (cmd == "create") {
     std::string path = j["path"];
     wxString wpath(path.c_str(), *wxConvFileName);
     wxFile file(wpath, wxFile::write);
+    StatCache::Get().Invalidate(path);
     ret = (file.IsOpened() ? "ok" : "");
   } else if (cmd == "rename") {
     std::string oldPath = j["oldPath"];
@@ -122,23 +397,355 @@ handlePost(struct mg_connection *c, json &j)
     wxString woldPath(oldPath.c_str(), *wxConvFileName);
     wxString wnewPath(newPath.c_str(), *wxConvFileName);
     bool b = ::wxRenameFile(woldPath, wnewPath);
+    StatCache::Get().Invalidate(oldPath);
+    StatCache::Get().Invalidate(newPath);
     ret = (b ? "ok" : "");
+  } else if (cmd == "backup") {
+    //  Keep the current contents of path as backup (a hard link if possible)
+    std::string path = j["path"];
+    std::string backup = j["backup"];
+    bool linked;
+    request_json res;
+    res["ok"] = SaveScheduler::Get().Backup(path, backup, &linked);
+    StatCache::Get().Invalidate(backup);
+    res["linked"] = linked;
+    ret = res.dump();
+    type = "application/json";
   } else if (cmd == "remove") {
     std::string path = j["path"];
     wxString wpath(path.c_str(), *wxConvFileName);
     bool b = ::wxRemoveFile(wpath);
+    StatCache::Get().Invalidate(path);
     ret = (b ? "ok" : "");
-  } else if (cmd == "readTextFile") {
+  } else if (cmd == "readTextFile" || cmd == "openBook") {
+    //  The file is sent from FileCache (read in one call) without
+    //  converting it to a wxString. openBook also parses the book into
+    //  BookStore.
     std::string path = j["path"];
-    wxString wpath(path.c_str(), *wxConvFileName);
-    wxString contents;
-    wxFFile file(wpath, "rt");
-    if (file.IsOpened()) {
-      bool b = file.ReadAll(&contents, wxConvUTF8);
-      ret = (b ? contents.ToStdString(wxConvUTF8) : "");
+    std::string pending;
+    FileBlobPtr blob;
+    if (SaveScheduler::Get().PendingText(path, pending)) {
+      blob = makeStringBlob(pending);  //  The latest text is not yet written to disk
     } else {
-      ret = "";
+      //  Not through the LRU cache: the data files change within the
+      //  resolution of mtime. A sharded or log book is put together from
+      //  its files, which must all be intact.
+      std::string error;
+      blob = openBookFile(path, &error);
+      if (!blob && bookLayoutOf(path) != "single") {
+        mg_http_reply(c, 500, "Content-Type: text/plain\r\n", "%s", error.c_str());
+        return;
+      }
+      if (blob && cmd == "openBook")
+        SaveScheduler::Get().SetDiskContents(path, blob->Data(), blob->Size());
+    }
+    if (!blob)
+      blob = makeStringBlob("");
+    //  A malformed book is still returned; the client reports the error
+    if (cmd == "openBook" && blob->Size() > 0 && BookStore::Get().Update(path, blob->Data(), blob->Size()))
+      refreshRollupCache(path, blob->Data(), blob->Size(), BookStore::Get().Snapshot(path));
+    //  The version of the book goes with the text, as the starting point
+    //  of changesSince
+    char headers[256];
+    int n = snprintf(headers, sizeof(headers), "Content-Type: text/plain\r\n");
+    if (cmd == "openBook") {
+      n += snprintf(headers + n, sizeof(headers) - n, "X-Book-Epoch: %llu\r\nX-Book-Version: %llu\r\n",
+                    (unsigned long long)BookStore::Get().Epoch(), (unsigned long long)BookStore::Get().Version(path));
+    }
+    std::string z;
+    if (compressBody(blob->Data(), blob->Size(), sRequestCoding, z)) {
+      snprintf(headers + n, sizeof(headers) - n, "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", codingName(sRequestCoding));
+      replyWithBlob(c, headers, makeStringBlob(z));
+    } else {
+      replyWithBlob(c, headers, blob);
+    }
+    return;
+  } else if (cmd == "bookLayout") {
+    //  {path, layout: "single" | "sharded" | "log", yearStart} converts the
+    //  book (pending saves are written first, and no save runs meanwhile);
+    //  without layout, just reports it (see bookLayoutInfo)
+    std::string path = j["path"];
+    request_json res;
+    if (j.contains("layout") && j["layout"].is_string()) {
+      std::string layout = j["layout"];
+      int yearStart = (j.contains("yearStart") && j["yearStart"].is_number_integer() ? j["yearStart"].get<int>() : 1);
+      std::string error;
+      bool ok = SaveScheduler::Get().RunExclusive(path, [&]() -> bool {
+        return setBookLayout(path, layout, yearStart, &error);
+      });
+      if (ok) {
+        //  The text is the same, only the files changed
+        std::string pending;
+        FileBlobPtr blob = openBookFile(path);
+        if (blob && !SaveScheduler::Get().PendingText(path, pending))
+          SaveScheduler::Get().SetDiskContents(path, blob->Data(), blob->Size());
+      } else {
+        res["error"] = (error.empty() ? std::string("cannot write the book") : error);
+      }
+    }
+    res.update(bookLayoutInfo(path));
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "bookInfo") {
+    std::string path = j["path"];
+    std::shared_ptr<const Ledger> ledger = BookStore::Get().Find(path);
+    request_json res;
+    res["loaded"] = (ledger != NULL);
+    if (ledger) {
+      res["epoch"] = BookStore::Get().Epoch();
+      res["version"] = BookStore::Get().Version(path);
+      res["rows"] = ledger->NumberOfRows();
+      res["months"] = ledger->months.size();
+      res["strings"] = ledger->strings->Size();
+    }
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "queryRows") {
+    std::string book = j["book"];
+    std::shared_ptr<const LedgerIndex> index = BookStore::Get().Index(book);
+    request_json res;
+    if (index) {
+      std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+      size_t total;
+      res["rows"] = index->Query(RowQuery::fromJson(j), total);
+      res["total"] = total;
+      res["version"] = BookStore::Get().Version(book);
+      metricsAdd("query.count");
+      metricsAdd("query.usec", (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+    } else {
+      res["rows"] = request_json::array();
+      res["total"] = 0;
+      res["error"] = "book not loaded";
+    }
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "changesSince") {
+    //  Delta sync: {book, epoch, version} as the client last saw them ->
+    //  the months changed since, in full, and the months removed. With
+    //  refresh, the book is read again from the disk first (unless a save
+    //  is pending), so that edits made outside the app are picked up; the
+    //  months left as they were keep their versions.
+    std::string book = j["book"];
+    uint64_t epoch = (j.contains("epoch") && j["epoch"].is_number_unsigned() ? j["epoch"].get<uint64_t>() : 0);
+    uint64_t version = (j.contains("version") && j["version"].is_number_unsigned() ? j["version"].get<uint64_t>() : 0);
+    bool refresh = (j.contains("refresh") && j["refresh"].is_boolean() && j["refresh"].get<bool>());
+    std::string pending;
+    if (refresh && !SaveScheduler::Get().PendingText(book, pending) && BookStore::Get().Snapshot(book)) {
+      FileBlobPtr blob = openBookFile(book);
+      if (blob && blob->Size() > 0 && !SaveScheduler::Get().PendingText(book, pending)) {
+        uint64_t before = BookStore::Get().Version(book);
+        SaveScheduler::Get().SetDiskContents(book, blob->Data(), blob->Size());
+        if (BookStore::Get().Update(book, blob->Data(), blob->Size()))
+          refreshRollupCache(book, blob->Data(), blob->Size(), BookStore::Get().Snapshot(book));
+        if (BookStore::Get().Version(book) != before)
+          metricsAdd("sync.refreshed");
+      }
+    }
+    BookChanges changes = BookStore::Get().ChangesSince(book, epoch, version);
+    request_json res;
+    res["epoch"] = BookStore::Get().Epoch();
+    if (!changes.snapshot) {
+      res["error"] = "book not loaded";
+    } else {
+      const BookSnapshot &snap = *changes.snapshot;
+      const Ledger &ledger = *snap.ledger;
+      res["version"] = snap.version;
+      res["current"] = (!changes.full && snap.version == version);
+      res["full"] = changes.full;
+      if (!changes.full) {
+        const StringTable &strings = *ledger.strings;
+        request_json pages = request_json::array();
+        int64_t nrows = 0;
+        for (size_t i = 0; i < changes.pages.size(); i++) {
+          const LedgerPage &page = *ledger.months.at(changes.pages[i]);
+          request_json p;
+          p["ym"] = changes.pages[i];
+          p["version"] = snap.pageVersions.at(changes.pages[i]);
+          request_json rows = request_json::array();
+          for (size_t k = 0; k < page.size(); k++)
+            rows.push_back(rowToJson(page[k], strings));
+          p["rows"] = rows;
+          pages.push_back(p);
+          nrows += (int64_t)page.size();
+        }
+        res["pages"] = pages;
+        res["removed"] = changes.removed;
+        if (changes.meta) {
+          request_json cards = request_json::array();
+          for (size_t i = 0; i < ledger.cards.size(); i++) {
+            request_json card;
+            card["name"] = ledger.cards[i].name;
+            card["closing"] = ledger.cards[i].closing;
+            cards.push_back(card);
+          }
+          res["settings"] = { {"incomeKinds", ledger.incomeKinds}, {"paymentKinds", ledger.paymentKinds}, {"cards", cards} };
+        }
+        metricsAdd("sync.pages", (int64_t)changes.pages.size());
+        metricsAdd("sync.rows", nrows);
+      }
+      metricsAdd(changes.full ? "sync.full" : (changes.pages.empty() && changes.removed.empty() && !changes.meta ? "sync.current" : "sync.delta"));
+    }
+    metricsAdd("sync.count");
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "sumRows") {
+    //  Filtered totals by the bitmap indexes
+    std::string book = j["book"];
+    std::string groupBy = (j.contains("groupBy") && j["groupBy"].is_string() ? j["groupBy"].get<std::string>() : "");
+    std::shared_ptr<const LedgerIndex> index = BookStore::Get().Index(book);
+    request_json res;
+    if (index) {
+      std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+      res = index->Sum(RowQuery::fromJson(j), groupBy);
+      res["version"] = BookStore::Get().Version(book);
+      metricsAdd("sum.count");
+      metricsAdd("sum.usec", (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+    } else {
+      res["sum"] = 0;
+      res["count"] = 0;
+      res["error"] = "book not loaded";
+    }
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "fiscalRollup") {
+    //  Totals by fiscal year (April to March) and by month. The month pages
+    //  are totaled in parallel on ThreadPool; "parallel": false runs them
+    //  serially for comparison.
+    std::string book = j["book"];
+    int fromYear = (j.contains("from") && j["from"].is_number_integer() ? j["from"].get<int>() : 0);
+    int toYear = (j.contains("to") && j["to"].is_number_integer() ? j["to"].get<int>() : 0);
+    bool parallel = !(j.contains("parallel") && j["parallel"].is_boolean() && !j["parallel"].get<bool>());
+    BookSnapshotPtr snap = BookStore::Get().Snapshot(book);
+    if (snap) {
+      runInBackground(c, [snap, fromYear, toYear, parallel]() -> std::string {
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        json res = rollupLedger(*snap->ledger, fromYear, toYear, parallel).toJson();
+        int64_t usec = (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - startTime).count();
+        res["version"] = snap->version;
+        res["usec"] = usec;
+        metricsAdd("rollup.count");
+        metricsAdd("rollup.usec", usec);
+        metricsSet("rollup.threads", (int64_t)(parallel ? ThreadPool::Get().NumThreads() + 1 : 1));
+        return res.dump();
+      });
+      return;  //  Replied by the MG_EV_WAKEUP handler
+    }
+    request_json res;
+    res["error"] = "book not loaded";
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "cachedRollup") {
+    //  Month, fiscal year and card month totals of the book. If the file has
+    //  not changed since the sidecar was written, they come from there
+    //  without parsing the book; see RollupCache.h
+    std::string book = j["book"];
+    BookSnapshotPtr snap = BookStore::Get().Snapshot(book);
+    runInBackground(c, [book, snap]() -> std::string {
+      json res;
+      if (snap) {
+        res = RollupCache::Get().Update(book, *snap->ledger, NULL);
+        res["source"] = "store";
+        res["version"] = snap->version;
+        return res.dump();
+      }
+      std::string text;
+      if (!SaveScheduler::Get().PendingText(book, text)) {
+        std::string error;
+        FileBlobPtr blob = openBookFile(book, &error);
+        if (!blob) {
+          res["error"] = (error.empty() ? std::string("cannot open") : error);
+          return res.dump();
+        }
+        text.assign(blob->Data(), blob->Size());
+      }
+      uint64_t hash = xxh64(text.data(), text.size());
+      if (RollupCache::Get().Peek(book, hash, res)) {
+        res["source"] = "sidecar";
+        return res.dump();
+      }
+      Ledger ledger;
+      std::string error;
+      if (!parseKakeibo(text.data(), text.size(), ledger, &error)) {
+        res["error"] = error;
+        return res.dump();
+      }
+      res = RollupCache::Get().Update(book, ledger, &hash);
+      res["source"] = "file";
+      return res.dump();
+    });
+    return;  //  Replied by the MG_EV_WAKEUP handler
+  } else if (cmd == "consolidatedRollup") {
+    //  Totals over all the books in ~/kakeibo, with the kinds renamed by
+    //  kindMap (or ~/kakeibo/kindMap.json); see Consolidation.h
+    json kindMap;
+    if (j.contains("kindMap"))
+      kindMap = j["kindMap"];
+    int fromYear = (j.contains("from") && j["from"].is_number_integer() ? j["from"].get<int>() : 0);
+    int toYear = (j.contains("to") && j["to"].is_number_integer() ? j["to"].get<int>() : 0);
+    runInBackground(c, [kindMap, fromYear, toYear]() -> std::string {
+      return Consolidation::Get().Run(kindMap, fromYear, toYear).dump();
+    });
+    return;  //  Replied by the MG_EV_WAKEUP handler
+  } else if (cmd == "recordUndo" || cmd == "undo" || cmd == "redo" || cmd == "undoStatus" || cmd == "clearUndo" || cmd == "history") {
+    //  Undo history kept in UndoJournal (the client applies the returned ops)
+    std::string book = j["book"];
+    UndoJournal &journal = UndoJournal::Get();
+    request_json res;
+    bool applied = false;
+    if (cmd == "recordUndo") {
+      //  The same edits are applied to the book in BookStore right away
+      //  (the text sent later by scheduleSave is still authoritative); the
+      //  step keeps the hashes of its months before and after them
+      json ops = j["ops"];
+      json before = UndoJournal::Fingerprint(book, ops);
+      applied = BookStore::Get().Apply(book, ops);
+      res = journal.Record(book, ops, j["inverse"], before, (applied ? UndoJournal::Fingerprint(book, ops) : json()));
+    } else if (cmd == "undo")
+      res = journal.Undo(book);
+    else if (cmd == "redo")
+      res = journal.Redo(book);
+    else if (cmd == "clearUndo")
+      res = journal.Clear(book);
+    else if (cmd == "history")
+      res = journal.History(book, (j.contains("n") && j["n"].is_number_unsigned() ? j["n"].get<size_t>() : 20));
+    else
+      res = journal.Status(book);
+    if ((cmd == "undo" || cmd == "redo") && !res["ops"].empty())
+      applied = BookStore::Get().Apply(book, res["ops"]);
+    if (applied) {
+      //  The version that has the edits (which the client has, too): the
+      //  client moves its sync point there, as with scheduleSave
+      res["epoch"] = BookStore::Get().Epoch();
+      res["version"] = BookStore::Get().Version(book);
     }
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "exportRange") {
+    //  Write the rows in the book directly from BookStore to the file
+    //  (the file is chosen beforehand with saveDialog). The export runs on
+    //  a worker thread with the current snapshot, so that edits can go on.
+    std::string book = j["book"];
+    std::string path = j["path"];
+    bool gzip = (j.contains("gzip") && j["gzip"].is_boolean() && j["gzip"].get<bool>());
+    BookSnapshotPtr snap = BookStore::Get().Snapshot(book);
+    if (snap) {
+      ExportFilter filter = ExportFilter::fromJson(j);
+      runInBackground(c, [snap, path, filter, gzip]() -> std::string {
+        json res;
+        res["ok"] = exportKakeibo(*snap->ledger, path, filter, gzip, res);
+        res["version"] = snap->version;
+        return res.dump();
+      });
+      return;  //  Replied by the MG_EV_WAKEUP handler
+    }
+    request_json res;
+    res["ok"] = false;
+    res["error"] = "book not loaded";
+    ret = res.dump();
+    type = "application/json";
   } else if (cmd == "writeTextFile") {
     std::string path = j["path"];
     std::string text = j["text"];
@@ -151,65 +758,266 @@ handlePost(struct mg_connection *c, json &j)
     } else {
       ret = "";
     }
+    StatCache::Get().Invalidate(path);
+  } else if (cmd == "scheduleSave") {
+    //  The file is written later by the flusher thread of SaveScheduler.
+    //  The text is parsed into BookStore on a worker, and the reply is sent
+    //  when it is published, so that the requests that follow (exportRange,
+    //  queryRows...) see it. The edits applied by recordUndo etc. after
+    //  this point are applied again on top of the text.
+    std::string path = j["path"];
+    std::shared_ptr<const std::string> text(new std::string(j["text"].get<std::string>()));
+    uint64_t gen = SaveScheduler::Get().Schedule(path, *text);
+    uint64_t base = BookStore::Get().Version(path);
+    {
+      std::lock_guard<std::mutex> lock(sParseMutex);
+      sNewestText[path] = gen;
+    }
+    runInBackground(c, [path, text, gen, base]() -> std::string {
+      {
+        std::lock_guard<std::mutex> run(sParseRunMutex);
+        bool newest;
+        {
+          std::lock_guard<std::mutex> lock(sParseMutex);
+          newest = (sNewestText[path] == gen);
+        }
+        if (newest)
+          BookStore::Get().UpdateRebased(path, text->data(), text->size(), base);
+        else
+          metricsAdd("store.parsesCoalesced");
+      }
+      json res;
+      res["generation"] = gen;
+      res["savedGeneration"] = SaveScheduler::Get().SavedGeneration(path);
+      res["epoch"] = BookStore::Get().Epoch();
+      res["version"] = BookStore::Get().Version(path);
+      return res.dump();
+    });
+    return;  //  Replied by the MG_EV_WAKEUP handler
+  } else if (cmd == "flushSaves") {
+    std::string path = (j.contains("path") ? j["path"].get<std::string>() : "");
+    SaveScheduler &sched = SaveScheduler::Get();
+    bool b = sched.Flush(path);
+    request_json res;
+    res["ok"] = b;
+    res["generation"] = sched.Generation();
+    if (!path.empty())
+      res["savedGeneration"] = sched.SavedGeneration(path);
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "setSaveTiming") {
+    int delay = (j.contains("delay") ? j["delay"].get<int>() : -1);
+    int interval = (j.contains("interval") ? j["interval"].get<int>() : -1);
+    SaveScheduler::Get().SetTiming(delay, interval);
+    ret = "ok";
+  } else if (cmd == "maintenance") {
+    //  State of the housekeeping jobs; {run: name} makes the job due now
+    //  (it still waits until the client is idle)
+    request_json res;
+    if (j.contains("run") && j["run"].is_string())
+      res["scheduled"] = Maintenance::Get().RunSoon(j["run"]);
+    json status = Maintenance::Get().Status();
+    res["jobs"] = status["jobs"];
+    res["problems"] = status["problems"];
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "metrics") {
+    ret = metricsSnapshot().dump();
+    type = "application/json";
+  } else if (cmd == "logLevel") {
+    //  {level: "off" | "error" | "warn" | "info" | "debug" | "trace"} sets the
+    //  level of wxvuerunner.log; returns {level} (the current one)
+    request_json res;
+    if (j.contains("level") && j["level"].is_string()) {
+      std::string name = j["level"];
+      int level = logLevelFromName(name.c_str());
+      if (level >= 0) {
+        setLogLevel(level);
+        LOG_INFO("Log level: %s", logLevelName(level));
+      } else {
+        res["error"] = "unknown level " + name;
+      }
+    }
+    res["level"] = logLevelName(gLogLevel.load());
+    ret = res.dump();
+    type = "application/json";
   } else if (cmd == "readDir") {
     std::string path = j["path"];
     wxString wpath(path.c_str(), *wxConvFileName);
     wxDir dir(wpath);
+    request_json res = request_json::array();
     if (dir.IsOpened()) {
-      wxString s = wxT("[");
       wxString fname;
       bool b = dir.GetFirst(&fname, wxEmptyString, wxDIR_FILES | wxDIR_DIRS | wxDIR_NO_FOLLOW);
-      int count = 0;
       while (b) {
-        fname.Replace(wxT("\""), wxT("\\\""));
-        fname = wxT("\"") + fname + wxT("\"");
-        if (count > 0) {
-          s += wxT(",");
-        }
-        s += fname;
-        count++;
+        res.push_back(fname.ToStdString(wxConvUTF8));
         b = dir.GetNext(&fname);
       }
-      s += wxT("]");
-      ret = s.ToStdString(wxConvUTF8);
-    } else {
-      ret = "[]";
     }
-  } else if (cmd == "saveDialog") {
+    ret = res.dump();
+    type = "application/json";
+  } else if (cmd == "readDirStat") {
+    //  [{name, type, size, mtime}] of the entries matching the glob pattern
+    //  (if any), sent in chunks as the directory is read; see DirList.h
+    std::string path = j["path"];
+    std::string pattern = (j.contains("pattern") && j["pattern"].is_string() ? j["pattern"].get<std::string>() : std::string());
+    DirLister lister;
+    if (!lister.Open(path, pattern)) {
+      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "[]");
+      return;
+    }
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+              "Content-Type: application/json\r\n"
+              "Transfer-Encoding: chunked\r\n\r\n");
+    std::string buf = "[";
+    DirEntry e;
+    int64_t count = 0;
+    while (lister.Next(e)) {
+      request_json entry;
+      entry["name"] = e.name;
+      entry["type"] = e.type;
+      entry["size"] = e.size;
+      entry["mtime"] = e.mtime;
+      if (count++ > 0)
+        buf += ",";
+      buf += entry.dump(-1, ' ', false, request_json::error_handler_t::replace);
+      if (buf.size() >= 16384) {
+        mg_http_write_chunk(c, buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+    buf += "]";
+    mg_http_write_chunk(c, buf.data(), buf.size());
+    mg_http_write_chunk(c, "", 0);  //  End of the chunked response
+    metricsAdd("readDirStat.entries", count);
+    return;
+  } else if (cmd == "importProfiles") {
+    ret = loadImportProfiles().dump();
+    type = "application/json";
+  } else if (cmd == "saveImportProfile") {
+    ret = (saveImportProfile(j["profile"]) ? "ok" : "");
+  } else if (cmd == "importStatement") {
+    //  The rows are sent in batches as they are parsed, one JSON line per batch
+    //  (Content-Type: application/x-ndjson), followed by a summary line
+    std::string path = j["path"];
+    ImportProfile profile;
+    if (j["profile"].is_string()) {
+      if (!findImportProfile(j["profile"], profile)) {
+        mg_http_reply(c, 404, "", "");  /*  No such profile  */
+        return;
+      }
+    } else if (j["profile"].is_object()) {
+      profile = ImportProfile::fromJson(j["profile"]);
+    }
+    size_t batchSize = (j.contains("batchSize") && j["batchSize"].is_number_unsigned() ? j["batchSize"].get<size_t>() : 1000);
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+              "Content-Type: application/x-ndjson\r\n"
+              "Transfer-Encoding: chunked\r\n\r\n");
+    //  Read and converted on a worker; the batches are sent as they come
+    streamInBackground(c, [path, profile, batchSize](const StreamWriter &write) {
+      json summary;
+      bool b = importStatement(path, profile, batchSize, [&write](const json &rows) {
+        json batch;
+        batch["rows"] = rows;
+        write(batch.dump() + "\n");
+      }, summary);
+      summary["ok"] = b;
+      summary["done"] = true;
+      write(summary.dump() + "\n");
+    });
+    return;  //  Sent by pumpBackgroundStream
+  } else if (cmd == "saveDialog" || cmd == "openDialog") {
     j["connection_id"] = c->id;
     wxCommandEvent *anEvent = new wxCommandEvent(MyEvent);
-    anEvent->SetClientData(strdup(j.dump().c_str()));
+    anEvent->SetClientData(new json(j));  //  Handed to the main thread (a heap copy)
     wxGetApp().QueueEvent(anEvent);
     mg_printf(c, sSSEResponse);
     c->is_resp = 0;
     return;  //  Early return: no standard http reply
   } else if (cmd == "terminate") {
+    SaveScheduler::Get().Flush();
     server_status = eServer_StopFromClient;  //  terminate is requested by the client
   }
-  type = "Content-Type: " + type + "\r\n";
-  mg_http_reply(c, 200, type.c_str(), "%s", ret.c_str());
+  replyBody(c, type.c_str(), ret, sRequestCoding);
 }
 
 static struct mg_http_serve_opts sServeOpts;
-static signed long sSSEConnectionId = -1;
 
-static int
-checkCookie(struct mg_http_message *hm)
+//  Per-request arena for the JSON values (used only by the server thread)
+static Arena sRequestArena;
+
+#if DEBUG
+//  Whether all the keys and strings of j fit in the small-string buffer
+//  of std::string (so that parsing them makes no heap allocation)
+static bool
+hasOnlyShortStrings(const request_json &j)
 {
-  int i;
-  for (i = 0; i < MG_MAX_HTTP_HEADERS; i++) {
-    struct mg_http_header *hd = hm->headers + i;
-    if (hd->name.buf == NULL)
-      return 0;
-    if (mg_match(hd->name, mg_str("Cookie"), NULL)) {
-      if (strncmp(hd->value.buf, "token=", 6) == 0 &&
-          strncmp(hd->value.buf + 6, sCookie, 15) == 0 &&
-          hd->value.len == 21) {
-        return 1;
-      }
+  static const size_t kShort = std::string().capacity();
+  if (j.is_string())
+    return j.get_ref<const std::string &>().size() <= kShort;
+  if (j.is_object()) {
+    for (request_json::const_iterator it = j.begin(); it != j.end(); ++it) {
+      if (it.key().size() > kShort || !hasOnlyShortStrings(it.value()))
+        return false;
+    }
+  } else if (j.is_array()) {
+    for (const request_json &e : j) {
+      if (!hasOnlyShortStrings(e))
+        return false;
     }
   }
-  return 0;
+  return true;
+}
+#endif
+
+//  Compare a secret in a time that does not depend on where the strings
+//  differ (only the length, which is not secret, ends it early)
+static bool
+secretEquals(struct mg_str s, const char *secret)
+{
+  size_t len = strlen(secret);
+  if (s.buf == NULL || s.len != len)
+    return false;
+  unsigned char diff = 0;
+  for (size_t i = 0; i < len; i++)
+    diff |= (unsigned char)(s.buf[i] ^ secret[i]);
+  return diff == 0;
+}
+
+//  Authentication state of a connection, kept in c->data (zeroed by
+//  mongoose when the connection is made)
+enum {
+  kConnAuthorized = 1
+};
+
+//  A request must carry the token cookie (set when the page is served) and
+//  the random id of the page URL (X-VueRunner-Id, or the id query of the
+//  event stream). Both are checked on the first request of a connection
+//  and the result is kept, so that the requests that follow on a
+//  keep-alive connection are not checked again. This is done before the
+//  body is parsed.
+static bool
+isAuthorized(struct mg_connection *c, struct mg_http_message *hm, struct mg_str id)
+{
+  if (c->data[0] & kConnAuthorized) {
+    metricsAdd("auth.cached");
+    return true;
+  }
+  metricsAdd("auth.checked");
+  if (sCookie[0] == 0 || sRandomId[0] == 0)
+    return false;  //  The page is not served yet
+  char token[32];
+  snprintf(token, sizeof(token), "token=%s", sCookie);
+  struct mg_str *cookie = mg_http_get_header(hm, "Cookie");
+  //  Check both anyway
+  bool ok = (cookie != NULL && secretEquals(*cookie, token));
+  ok = secretEquals(id, sRandomId) && ok;
+  if (!ok) {
+    metricsAdd("auth.rejected");
+    return false;
+  }
+  c->data[0] |= kConnAuthorized;
+  return true;
 }
 
 static void
@@ -223,12 +1031,21 @@ eventHandler(struct mg_connection *c, int ev, void *ev_data)
         if (useWebView) {
           mg_http_reply(c, 404, "", "");  /*  Do not use SSE  */
         } else {
-          if (checkCookie(hm) && hm->query.len == strlen(sRandomId) + 3 && strncmp(hm->query.buf, "id=", 3) == 0 && strncmp(hm->query.buf + 3, sRandomId, strlen(sRandomId)) == 0) {
+          struct mg_str id = mg_str_n(NULL, 0);
+          if (hm->query.len >= 3 && strncmp(hm->query.buf, "id=", 3) == 0)
+            id = mg_str_n(hm->query.buf + 3, hm->query.len - 3);
+          if (isAuthorized(c, hm, id)) {
             /*  Start SSE connection  */
+            /*  (All the SSE connections receive the server events)  */
+            uint64_t lastEventId = 0;
+            struct mg_str *lastId = mg_http_get_header(hm, "Last-Event-ID");
+            if (lastId != NULL)
+              mg_str_to_num(*lastId, 10, &lastEventId, sizeof(lastEventId));
             mg_printf(c, sSSEResponse);
-            sSSEConnectionId = (signed long)c->id;
+            EventHub::Get().Subscribe(c, lastEventId);
             c->is_resp = 0;
           } else {
+            LOG_WARN("Unauthorized request to %.*s", (int)hm->uri.len, hm->uri.buf);
             mg_http_reply(c, 401, "", "");  /*  Unauthorized  */
           }
         }
@@ -237,10 +1054,40 @@ eventHandler(struct mg_connection *c, int ev, void *ev_data)
       }
     } else if (mg_match(hm->uri, mg_str("/@vueRunner/"), NULL)) {
       if (strncmp(hm->method.buf, "POST", hm->method.len) == 0) {
-        if (checkCookie(hm)) {
-          json j = json::parse(hm->body.buf);
-          handlePost(c, j);
+        struct mg_str *id = mg_http_get_header(hm, "X-VueRunner-Id");
+        if (isAuthorized(c, hm, (id != NULL ? *id : mg_str_n(NULL, 0)))) {
+          Maintenance::Get().NoteActivity();
+          //  No compression for the local WebView
+          sRequestCoding = (wxGetApp().m_useWebView ? kCodingIdentity : acceptedCoding(hm));
+          //  The request and the reply built from it (request_json) are
+          //  allocated in sRequestArena, which is recycled for the next request
+          uint64_t heapAllocs = arenaHeapAllocations();
+          {
+            ArenaScope scope(&sRequestArena);
+#if DEBUG
+            size_t capacity = sRequestArena.Capacity();
+#endif
+            request_json j = request_json::parse(hm->body.buf, hm->body.buf + hm->body.len);
+#if DEBUG
+            //  Once the arena has grown to the size of the requests, parsing
+            //  a request whose strings all fit in std::string itself makes
+            //  only the few allocations of the parser (its stacks and token
+            //  buffer; 7 to 9 for the requests of the client), however many
+            //  values the request has. The values must all be in the arena.
+            const uint64_t kParserAllocs = 16;
+            wxASSERT_MSG(arenaHeapAllocations() - heapAllocs <= kParserAllocs || sRequestArena.Capacity() != capacity || !hasOnlyShortStrings(j),
+                         "request_json allocated on the heap in a steady-state request");
+#endif
+            handlePost(c, j);
+          }
+          heapAllocs = arenaHeapAllocations() - heapAllocs;
+          metricsAdd("rpc.count");
+          metricsAdd("rpc.arenaBytes", (int64_t)sRequestArena.BytesUsed());
+          metricsAdd("rpc.heapAllocs", (int64_t)heapAllocs);
+          metricsSet("rpc.arenaCapacity", (int64_t)sRequestArena.Capacity());
+          sRequestArena.Reset();
         } else {
+          LOG_WARN("Unauthorized request to %.*s", (int)hm->uri.len, hm->uri.buf);
           mg_http_reply(c, 401, "", "");  /*  Unauthorized  */
         }
       } else {
@@ -259,7 +1106,17 @@ eventHandler(struct mg_connection *c, int ev, void *ev_data)
         sServeOpts.extra_headers = NULL;
       }
       mg_http_serve_dir(c, hm, &sServeOpts);  // For all other URLs, Serve static files
+      prepareFileSend(c);
     }
+  } else if (ev == MG_EV_WAKEUP) {  // Reply from runInBackground() or streamInBackground()
+    sendBackgroundReply(c);
+    pumpBackgroundStream(c);
+  } else if (ev == MG_EV_WRITE || ev == MG_EV_POLL) {  // Continue replyWithBlob() or streamInBackground()
+    pumpBlob(c);
+    pumpBackgroundStream(c);
+  } else if (ev == MG_EV_CLOSE) {
+    dropBlob(c);
+    closeBackgroundStream(c->id);
   }
 }
 
@@ -270,18 +1127,26 @@ runServer(int port, std::string rootDir)
   std::string server_url = "http://127.0.0.1:" + std::to_string(port);
   mg_log_set(MG_LL_ERROR);
   mg_mgr_init(&mgr);  // Initialise event manager
+  mg_wakeup_init(&mgr);  // For the replies from the worker threads
   memset(&sServeOpts, 0, sizeof(sServeOpts));
   sServeOpts.root_dir = strdup(rootDir.c_str());
-  sServeOpts.fs = &mg_fs_posix;
+  sServeOpts.fs = &mg_fs_cached;
   server_status = eServer_Running;
-  mg_http_listen(&mgr, server_url.c_str(), eventHandler, NULL);
+  if (mg_http_listen(&mgr, server_url.c_str(), eventHandler, NULL) == NULL)
+    LOG_ERROR("Cannot listen on %s", server_url.c_str());
+  else
+    LOG_INFO("Listening on %s", server_url.c_str());
+  //  Housekeeping of the books while the client is idle
+  Maintenance::Get().AddStandardJobs(Consolidation::RootDir());
+  Maintenance::Get().Start(&mgr, []() { return sBackgroundJobs > 0; });
   while (server_status < eServer_StopFromClient) {
-    //  If the application is going to exit, then notify client to stop
-    if (server_status == eServer_StopFromServer && sSSEConnectionId >= 0) {
-      std::lock_guard<std::mutex> lock(sMutex);
-      sSSEResults.push(std::make_pair(sSSEConnectionId, "stop"));
+    //  If the application is going to exit, then notify clients to stop
+    if (server_status == eServer_StopFromServer && EventHub::Get().NumSubscribers() > 0) {
+      EventHub::Get().Publish("stop");
       server_status = eServer_Stopping;  //  The polling loop will terminate next
     }
+    //  Send the server events to all the SSE connections
+    EventHub::Get().Pump(&mgr);
     //  If data is present in sSSEResults, then send it (and close the connection)
     while (1) {
       std::pair<unsigned long, std::string> pair;
@@ -305,6 +1170,11 @@ runServer(int port, std::string rootDir)
     }
     mg_mgr_poll(&mgr, 1000);  // Infinite event loop
   }
+  //  Let the exports etc. finish (the streams are not sent any more)
+  while (!sBackgroundStreams.empty())
+    closeBackgroundStream(sBackgroundStreams.begin()->first);
+  while (sBackgroundJobs > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
   server_status = eServer_Terminated;  //  End of server thread
 }
 
@@ -317,26 +1187,6 @@ terminateServer(bool useWebView)
   server_status = (useWebView ? eServer_Stopping : eServer_StopFromServer);
 }
 
-FILE *fp = NULL;
-void
-writeLog(wxString str)
-{
-  if (fp == NULL) {
-    wxString home = wxGetHomeDir();
-    fp = fopen((home + wxT("/wxvuerunner.log")).utf8_str(), "wt");
-  }
-  if (fp != NULL) {
-    fprintf(fp, "%s\n", (const char *)str.utf8_str());
-    fflush(fp);
-  }
-}
-
-#if 0
-#define write_log(s) writeLog(s)
-#else
-#define write_log(s)
-#endif
-
 static int
 findAvailablePort(bool useWebView)
 {
@@ -348,14 +1198,14 @@ findAvailablePort(bool useWebView)
   while (1) {
     addr.Service(port);
     printf("Trying to connect to 127.0.0.1:%d...\n", port);
-    write_log(wxString::Format(wxT("Trying to connect to 127.0.0.1:%d..."), port));
+    LOG_DEBUG("Trying to connect to 127.0.0.1:%d...", port);
     if (sock->Connect(addr, true)) {
       sock->Close();
       port += 1;
       continue;
     }
     printf("Looks like port %d is not in use.\n", port);
-    write_log(wxString::Format(wxT("Looks like port %d is not in use."), port));
+    LOG_INFO("Port %d is not in use", port);
     break;
   }
   sock->Destroy();
@@ -412,16 +1262,13 @@ GetVersionNumbersFromInfoPlist(wxString path, int &major, int &minor)
     return;
   }
   tfile.Open(infoPath);
-  write_log(wxT("Opening " + infoPath));
+  LOG_DEBUG("Opening %s", (const char *)infoPath.utf8_str());
   if (tfile.IsOpened()) {
     wxString line = tfile.GetFirstLine();
-    write_log(wxT("Reading " + infoPath));
     while (!tfile.Eof()) {
       if (line.Find("CFBundleShortVersionString") != wxNOT_FOUND) {
-        write_log("CFBundleShortVersionString found: " + line);
         line = tfile.GetNextLine();
         long pos = line.Find("<string>");
-        write_log("Next line: " + line);
         if (pos != wxNOT_FOUND) {
           wxString line1 = line.Mid(pos + 8);
           pos = line1.Find(".");
@@ -438,14 +1285,13 @@ GetVersionNumbersFromInfoPlist(wxString path, int &major, int &minor)
             }
             line1.ToInt(&minor);
           }
-          write_log(wxString::Format(wxT("major = %d, minor = %d"), major, minor));
+          LOG_DEBUG("%s: version %d.%d", (const char *)infoPath.utf8_str(), major, minor);
           break;
         }
       }
       line = tfile.GetNextLine();
     }
     tfile.Close();
-    write_log(wxT("Closing " + infoPath));
   }
 }
 #endif
@@ -461,6 +1307,9 @@ MyApp::OnInit()
   //  Disable any wxLog functionality (otherwise ::exit() may crash)
   wxLog::EnableLogging(false);
 
+  //  Our own log instead (level: WXVUERUNNER_LOG or the logLevel command)
+  Logger::Get().Start((wxGetHomeDir() + wxT("/wxvuerunner.log")).ToStdString(*wxConvFileName));
+
   //  Determine whether we use wxWebView or not
   m_useWebView = shouldUseWebView();
 
@@ -473,6 +1322,19 @@ MyApp::OnInit()
   //  Determine the root directory.
   wxString distDir = wxStandardPaths::Get().GetResourcesDir() + wxT("/dist");
   
+  //  Start the thread to write the files scheduled by the client
+  SaveScheduler::Get().Start();
+  //  (The book in BookStore may already be newer than the written text)
+  SaveScheduler::Get().SetWrittenHandler([](const std::string &path, const std::string &text) {
+    refreshRollupCache(path, text.data(), text.size(), BookSnapshotPtr());
+  });
+
+  //  Worker threads for the background requests and the aggregations
+  ThreadPool::Get().Start();
+
+  //  Metadata of the files under ~/kakeibo for the exists and stat commands
+  StatCache::Get().Start((wxGetHomeDir() + wxFileName::GetPathSeparator() + wxT("kakeibo")).ToStdString(*wxConvFileName));
+
   //  Run the server in a separate thread.
   server_thread = new std::thread(runServer, m_port, distDir.utf8_string());
   
@@ -520,7 +1382,7 @@ MyApp::OnInit()
         }
       }
     }
-    write_log(wxT("Invoking " + invoke));
+    LOG_INFO("Invoking %s", (const char *)invoke.utf8_str());
     wxExecute(invoke);
     wxExecute(wxT("osascript -e 'tell application \"") + browser + wxT("\" to activate'"));
   }
@@ -539,15 +1401,15 @@ MyApp::OnInit()
 void
 MyApp::OnCustomEvent(wxCommandEvent &event)
 {
-  void *d = event.GetClientData();
-  json j = json::parse((const char *)d);
-  free(d);  //  d must have been allocated by strdup()
+  std::unique_ptr<json> data((json *)event.GetClientData());  //  Allocated by handlePost()
+  json &j = *data;
   std::string cmd = j["cmd"];
   unsigned long id = j["connection_id"];
-  if (cmd == "saveDialog") {
+  if (cmd == "saveDialog" || cmd == "openDialog") {
+    bool isSave = (cmd == "saveDialog");
     json options = j["options"];
     std::string defaultPath = "";
-    std::string title = "Save File";
+    std::string title = (isSave ? "Save File" : "Open File");
     std::string dir = "";
     std::string wildcard = "*.*";
     std::string result = "";
@@ -568,7 +1430,7 @@ MyApp::OnCustomEvent(wxCommandEvent &event)
                         wxString::FromUTF8(dir.c_str()),
                         wxString::FromUTF8(defaultPath.c_str()),
                         wxString::FromUTF8(wildcard.c_str()),
-                        wxFD_SAVE | wxFD_OVERWRITE_PROMPT | wxFD_CHANGE_DIR);
+                        (isSave ? wxFD_SAVE | wxFD_OVERWRITE_PROMPT : wxFD_OPEN | wxFD_FILE_MUST_EXIST) | wxFD_CHANGE_DIR);
     if (dialog.ShowModal() == wxID_OK) {
       result = (const char *)(dialog.GetPath().mb_str(wxConvFile));
     }
@@ -595,6 +1457,12 @@ MyApp::OnExit()
   }
   if (server_thread->joinable())
     server_thread->join();
+  //  Write the pending files before exit
+  SaveScheduler::Get().Stop();
+  ThreadPool::Get().Stop();
+  StatCache::Get().Stop();
+  LOG_INFO("Exit");
+  Logger::Get().Stop();
   return wxApp::OnExit();
 }
 wxIMPLEMENT_APP(MyApp);
@@ -0,0 +1,146 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "Rollup.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+
+void
+RollupTotals::Merge(const RollupTotals &t)
+{
+  for (std::map<std::string, int64_t>::const_iterator it = t.kinds.begin(); it != t.kinds.end(); ++it)
+    kinds[it->first] += it->second;
+  income += t.income;
+  payment += t.payment;
+  rows += t.rows;
+}
+
+json
+RollupTotals::toJson() const
+{
+  json j;
+  json k = json::object();
+  for (std::map<std::string, int64_t>::const_iterator it = kinds.begin(); it != kinds.end(); ++it)
+    k[it->first] = it->second;
+  j["kinds"] = k;
+  j["income"] = income;
+  j["payment"] = payment;
+  j["balance"] = income - payment;
+  j["rows"] = rows;
+  return j;
+}
+
+RollupTotals
+RollupTotals::fromJson(const json &j)
+{
+  RollupTotals t;
+  if (j.contains("kinds") && j["kinds"].is_object()) {
+    for (json::const_iterator it = j["kinds"].begin(); it != j["kinds"].end(); ++it) {
+      if (it.value().is_number_integer())
+        t.kinds[it.key()] = it.value().get<int64_t>();
+    }
+  }
+  if (j.contains("income") && j["income"].is_number_integer())
+    t.income = j["income"].get<int64_t>();
+  if (j.contains("payment") && j["payment"].is_number_integer())
+    t.payment = j["payment"].get<int64_t>();
+  if (j.contains("rows") && j["rows"].is_number_integer())
+    t.rows = j["rows"].get<uint64_t>();
+  return t;
+}
+
+void
+FiscalRollup::AddMonth(int ym, const RollupTotals &t)
+{
+  months[ym].Merge(t);
+  years[fiscalYearOf(ym)].Merge(t);
+}
+
+void
+FiscalRollup::Merge(const FiscalRollup &r)
+{
+  for (std::map<int, RollupTotals>::const_iterator it = r.months.begin(); it != r.months.end(); ++it)
+    months[it->first].Merge(it->second);
+  for (std::map<int, RollupTotals>::const_iterator it = r.years.begin(); it != r.years.end(); ++it)
+    years[it->first].Merge(it->second);
+}
+
+json
+FiscalRollup::toJson() const
+{
+  json j;
+  json m = json::object(), y = json::object();
+  for (std::map<int, RollupTotals>::const_iterator it = months.begin(); it != months.end(); ++it)
+    m[std::to_string(it->first)] = it->second.toJson();
+  for (std::map<int, RollupTotals>::const_iterator it = years.begin(); it != years.end(); ++it)
+    y[std::to_string(it->first)] = it->second.toJson();
+  j["months"] = m;
+  j["years"] = y;
+  return j;
+}
+
+//  Kinds are summed by id, and converted to names only once at the end.
+//  A page has only a few kinds (the strings table holds all the items as
+//  well), so the sums are kept in a short list searched linearly; the
+//  cost is proportional to the rows, not to the size of the table.
+void
+rollupPage(const LedgerPage &page, const StringTable &strings, RollupTotals &t)
+{
+  std::vector<std::pair<uint32_t, int64_t> > byKind;
+  size_t last = 0;
+  for (size_t i = 0; i < page.size(); i++) {
+    const LedgerRow &row = page[i];
+    int64_t amount = (row.isIncome ? row.amount : -row.amount);
+    if (row.isIncome)
+      t.income += row.amount;
+    else
+      t.payment += row.amount;
+    //  Rows of the same kind often come together
+    if (last >= byKind.size() || byKind[last].first != row.kind) {
+      for (last = 0; last < byKind.size() && byKind[last].first != row.kind; last++)
+        ;
+      if (last == byKind.size())
+        byKind.push_back(std::make_pair(row.kind, (int64_t)0));
+    }
+    byKind[last].second += amount;
+  }
+  for (size_t k = 0; k < byKind.size(); k++)
+    t.kinds[strings.At(byKind[k].first)] += byKind[k].second;
+  t.rows += page.size();
+}
+
+FiscalRollup
+rollupLedger(const Ledger &ledger, int fromYear, int toYear, bool parallel)
+{
+  //  The pages in range: one task each
+  std::vector<std::pair<int, const LedgerPage *> > pages;
+  LedgerMonths::const_iterator it = (fromYear > 0 ? ledger.months.lower_bound(fromYear * 100 + 4) : ledger.months.begin());
+  LedgerMonths::const_iterator itEnd = (toYear > 0 ? ledger.months.upper_bound((toYear + 1) * 100 + 3) : ledger.months.end());
+  for ( ; it != itEnd; ++it)
+    pages.push_back(std::make_pair(it->first, it->second.get()));
+
+  std::vector<RollupTotals> partial(pages.size());
+  const StringTable &strings = *ledger.strings;
+  std::function<void(size_t)> task = [&](size_t i) {
+    rollupPage(*pages[i].second, strings, partial[i]);
+  };
+  if (parallel)
+    ThreadPool::Get().ParallelFor(pages.size(), task);
+  else {
+    for (size_t i = 0; i < pages.size(); i++)
+      task(i);
+  }
+
+  //  Merge the months into the fiscal years
+  FiscalRollup r;
+  for (size_t i = 0; i < pages.size(); i++)
+    r.AddMonth(pages[i].first, partial[i]);
+  return r;
+}
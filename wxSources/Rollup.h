@@ -0,0 +1,55 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include "Json.h"
+#include "Ledger.h"
+
+//  Totals of one month, or of one fiscal year (April to March, like
+//  fiscalYear() in TableTab.vue). Amounts of the kinds are signed: income
+//  is positive and payment is negative, as in dispData.
+struct RollupTotals {
+  std::map<std::string, int64_t> kinds;
+  int64_t income;
+  int64_t payment;   //  Positive
+  uint64_t rows;
+  RollupTotals() : income(0), payment(0), rows(0) {}
+  void Merge(const RollupTotals &t);
+  json toJson() const;
+  static RollupTotals fromJson(const json &j);
+};
+
+//  Fiscal year containing the month (YYYYMM)
+inline int
+fiscalYearOf(int ym)
+{
+  return (ym % 100 <= 3 ? ym / 100 - 1 : ym / 100);
+}
+
+struct FiscalRollup {
+  std::map<int, RollupTotals> months;  //  Key is YYYYMM
+  std::map<int, RollupTotals> years;   //  Key is the fiscal year
+  void Merge(const FiscalRollup &r);
+  void AddMonth(int ym, const RollupTotals &t);  //  To months and years
+  json toJson() const;
+};
+
+//  Aggregate the fiscal years [fromYear, toYear] (0 = unbounded) of the
+//  ledger. The month pages are totaled in parallel on ThreadPool and the
+//  partial results are merged into the years.
+FiscalRollup rollupLedger(const Ledger &ledger, int fromYear, int toYear, bool parallel = true);
+
+//  Totals of one month page (sequentially)
+void rollupPage(const LedgerPage &page, const StringTable &strings, RollupTotals &t);
+
+#endif // ROLLUP_H
@@ -0,0 +1,274 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+
+#include "RollupCache.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+
+#include <stdlib.h>
+#include <vector>
+
+
+RollupCache &
+RollupCache::Get()
+{
+  static RollupCache sRollupCache;
+  return sRollupCache;
+}
+
+std::string
+RollupCache::SidecarPath(const std::string &path)
+{
+  size_t pos = path.find_last_of("/\\");
+  return (pos == std::string::npos ? std::string() : path.substr(0, pos + 1)) + "rollup.cache";
+}
+
+static uint64_t
+hashFromString(const json &j)
+{
+  return (j.is_string() ? (uint64_t)strtoull(j.get<std::string>().c_str(), NULL, 16) : 0);
+}
+
+//  Read the sidecar on first use (the caller holds m_mutex)
+RollupCache::Book &
+RollupCache::Load(const std::string &path)
+{
+  std::map<std::string, Book>::iterator it = m_books.find(path);
+  if (it != m_books.end())
+    return it->second;
+  Book &book = m_books[path];
+  std::string spath = SidecarPath(path);
+  wxFFile file(wxString(spath.c_str(), *wxConvFileName), "rt");
+  wxString contents;
+  if (!file.IsOpened() || !file.ReadAll(&contents, wxConvUTF8))
+    return book;
+  json j = json::parse(contents.ToStdString(wxConvUTF8), nullptr, false);
+  if (!j.is_object() || !j.contains("months") || !j["months"].is_object())
+    return book;  //  Missing or broken: everything is recomputed
+  book.fileHash = (j.contains("fileHash") ? hashFromString(j["fileHash"]) : 0);
+  for (json::const_iterator mi = j["months"].begin(); mi != j["months"].end(); ++mi) {
+    const json &m = mi.value();
+    if (!m.is_object() || !m.contains("hash") || !m.contains("totals"))
+      continue;
+    Month &month = book.months[atoi(mi.key().c_str())];
+    month.hash = hashFromString(m["hash"]);
+    month.totals = RollupTotals::fromJson(m["totals"]);
+    if (m.contains("cards") && m["cards"].is_object()) {
+      for (json::const_iterator ci = m["cards"].begin(); ci != m["cards"].end(); ++ci) {
+        const json &v = ci.value();
+        if (v.is_array() && v.size() == 2 && v[0].is_number_integer() && v[1].is_number_integer())
+          month.cards[ci.key()] = std::make_pair(v[0].get<int64_t>(), v[1].get<int64_t>());
+      }
+    }
+  }
+  return book;
+}
+
+bool
+RollupCache::Save(const std::string &path, const Book &book)
+{
+  json j;
+  json months = json::object();
+  j["fileHash"] = hashToString(book.fileHash);
+  for (std::map<int, Month>::const_iterator it = book.months.begin(); it != book.months.end(); ++it) {
+    json m;
+    m["hash"] = hashToString(it->second.hash);
+    m["totals"] = it->second.totals.toJson();
+    json cards = json::object();
+    for (std::map<std::string, std::pair<int64_t, int64_t> >::const_iterator ci = it->second.cards.begin(); ci != it->second.cards.end(); ++ci)
+      cards[ci->first] = json::array({ci->second.first, ci->second.second});
+    m["cards"] = cards;
+    months[std::to_string(it->first)] = m;
+  }
+  j["months"] = months;
+  std::string s = j.dump();
+  std::string spath = SidecarPath(path);
+  wxString wpath(spath.c_str(), *wxConvFileName);
+  wxString wtemp = wpath + wxT(".saving");
+  {
+    wxFFile file(wtemp, "wt");
+    if (!file.IsOpened() || file.Write(s.data(), s.size()) != s.size() || !file.Close()) {
+      ::wxRemoveFile(wtemp);
+      metricsAdd("rollupCache.failed");
+      return false;
+    }
+  }
+  return ::wxRenameFile(wtemp, wpath, true);
+}
+
+static inline int
+nextMonth(int ym)
+{
+  return (ym % 100 == 12 ? ym + 89 : ym + 1);
+}
+
+static inline int
+lastMonth(int ym)
+{
+  return (ym % 100 == 1 ? ym - 89 : ym - 1);
+}
+
+json
+RollupCache::ToResult(const Book &book)
+{
+  FiscalRollup r;
+  std::map<std::string, std::map<int, int64_t> > cycles;
+  for (std::map<int, Month>::const_iterator it = book.months.begin(); it != book.months.end(); ++it) {
+    r.AddMonth(it->first, it->second.totals);
+    for (std::map<std::string, std::pair<int64_t, int64_t> >::const_iterator ci = it->second.cards.begin(); ci != it->second.cards.end(); ++ci) {
+      //  The early rows belong to the card month before
+      std::map<int, int64_t> &c = cycles[ci->first];
+      if (ci->second.first != 0)
+        c[lastMonth(it->first)] += ci->second.first;
+      if (ci->second.second != 0)
+        c[it->first] += ci->second.second;
+    }
+  }
+  json res = r.toJson();
+  json cards = json::object();
+  for (std::map<std::string, std::map<int, int64_t> >::const_iterator ci = cycles.begin(); ci != cycles.end(); ++ci) {
+    json c = json::object();
+    for (std::map<int, int64_t>::const_iterator it = ci->second.begin(); it != ci->second.end(); ++it)
+      c[std::to_string(it->first)] = it->second;
+    cards[ci->first] = c;
+  }
+  res["cards"] = cards;
+  return res;
+}
+
+bool
+RollupCache::Peek(const std::string &path, uint64_t fileHash, json &result)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Book &book = Load(path);
+  if (book.fileHash == 0 || book.fileHash != fileHash) {
+    metricsAdd("rollupCache.misses");
+    return false;
+  }
+  result = ToResult(book);
+  metricsAdd("rollupCache.hits");
+  return true;
+}
+
+//  Hash of the rows of one month, by their contents (the string ids differ
+//  between runs). seed is the hash of the card settings.
+static uint64_t
+hashPage(const LedgerPage &page, const StringTable &strings, uint64_t seed, std::string &buf)
+{
+  buf.clear();
+  for (size_t i = 0; i < page.size(); i++) {
+    const LedgerRow &row = page[i];
+    buf.append((const char *)&row.amount, sizeof(row.amount));
+    buf += (char)row.date;
+    buf += (char)row.isIncome;
+    const std::string *s[3] = { &strings.At(row.item), &strings.At(row.kind), &strings.At(row.card) };
+    for (int k = 0; k < 3; k++) {
+      uint32_t n = (uint32_t)s[k]->size();
+      buf.append((const char *)&n, sizeof(n));
+      buf.append(*s[k]);
+    }
+  }
+  return xxh64(buf.data(), buf.size(), seed);
+}
+
+uint64_t
+RollupCache::HashPage(const LedgerPage &page, const StringTable &strings, uint64_t seed)
+{
+  std::string buf;
+  return hashPage(page, strings, seed, buf);
+}
+
+//  m_mutex is not held while the pages are totaled, so that a Peek (or an
+//  Update of another book) does not wait for it.
+json
+RollupCache::Update(const std::string &path, const Ledger &ledger, const uint64_t *fileHash)
+{
+  std::map<int, Month> cached;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cached = Load(path).months;
+  }
+  const StringTable &strings = *ledger.strings;
+
+  //  Closing day by string id (-1 if not a card)
+  std::vector<int> closing(strings.Size(), -1);
+  std::string cardsText;
+  for (size_t i = 0; i < ledger.cards.size(); i++) {
+    uint32_t id;
+    if (strings.Find(ledger.cards[i].name, id))
+      closing[id] = ledger.cards[i].closing;
+    cardsText += ledger.cards[i].name + "," + std::to_string(ledger.cards[i].closing) + "\n";
+  }
+  uint64_t seed = xxh64(cardsText.data(), cardsText.size());
+
+  std::vector<std::pair<int, const LedgerPage *> > pages;
+  for (LedgerMonths::const_iterator it = ledger.months.begin(); it != ledger.months.end(); ++it)
+    pages.push_back(std::make_pair(it->first, it->second.get()));
+  std::vector<Month> fresh(pages.size());
+  std::vector<char> changed(pages.size(), 0);
+  ThreadPool::Get().ParallelFor(pages.size(), [&](size_t i) {
+    std::string buf;
+    const LedgerPage &page = *pages[i].second;
+    uint64_t h = hashPage(page, strings, seed, buf);
+    std::map<int, Month>::const_iterator it = cached.find(pages[i].first);
+    if (it != cached.end() && it->second.hash == h)
+      return;
+    Month &m = fresh[i];
+    m.hash = h;
+    rollupPage(page, strings, m.totals);
+    for (size_t k = 0; k < page.size(); k++) {
+      const LedgerRow &row = page[k];
+      if (row.date == 0 || closing[row.card] < 0)
+        continue;
+      std::pair<int64_t, int64_t> &c = m.cards[strings.At(row.card)];
+      if (row.date <= closing[row.card])
+        c.first += row.amount;
+      else
+        c.second += row.amount;
+    }
+    changed[i] = 1;
+  });
+
+  std::map<int, Month> months;
+  size_t recomputed = 0;
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (changed[i]) {
+      months[pages[i].first] = fresh[i];
+      recomputed++;
+    } else {
+      months[pages[i].first] = cached[pages[i].first];
+    }
+  }
+  bool modified = (recomputed > 0 || months.size() != cached.size());
+
+  //  The months are those of this ledger, whatever another Update stored
+  //  meanwhile
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Book &book = Load(path);
+  bool same = (book.months.size() == months.size());
+  for (std::map<int, Month>::const_iterator it = book.months.begin(), mt = months.begin(); same && it != book.months.end(); ++it, ++mt)
+    same = (it->first == mt->first && it->second.hash == mt->second.hash);
+  if (!same) {
+    book.months.swap(months);
+    modified = true;
+  }
+  uint64_t newFileHash = (fileHash != NULL ? *fileHash : (modified ? 0 : book.fileHash));
+  if (modified || newFileHash != book.fileHash) {
+    book.fileHash = newFileHash;
+    Save(path, book);
+  }
+  metricsAdd("rollupCache.recomputed", (int64_t)recomputed);
+  metricsAdd("rollupCache.reused", (int64_t)(pages.size() - recomputed));
+  json res = ToResult(book);
+  res["recomputed"] = recomputed;
+  return res;
+}
@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ROLLUPCACHE_H
+#define ROLLUPCACHE_H
+
+//  Rollups of the books kept in a sidecar file "rollup.cache" next to each
+//  kakeibo.csv. Every month is stored with the XXH64 hash of its rows, so
+//  only the months whose rows changed are totaled again; and the file as a
+//  whole is stored with the hash of kakeibo.csv, so that the totals can be
+//  returned before the book is parsed at all.
+//
+//  The sidecar is JSON:
+//    {"fileHash": "<hex>",
+//     "months": {"202404": {"hash": "<hex>", "totals": {...},
+//                           "cards": {"VISA": [early, late]}}, ...}}
+//  where early/late are the sums of the card rows dated on or before, and
+//  after, the closing day (a card month is late[ym] + early[ym + 1], as
+//  cardData in CardTab.vue). The closing days are part of the month hash.
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include "Json.h"
+#include "Rollup.h"
+
+class RollupCache
+{
+public:
+  static RollupCache &Get();
+
+  //  The rollup from the sidecar if it was made from contents hashing to
+  //  fileHash. Returns false if there is none.
+  bool Peek(const std::string &path, uint64_t fileHash, json &result);
+
+  //  Bring the sidecar up to date with the ledger and return the rollup.
+  //  fileHash is the hash of the text the ledger was parsed from, or NULL
+  //  if unknown (the ledger has edits not yet written).
+  json Update(const std::string &path, const Ledger &ledger, const uint64_t *fileHash);
+
+  static std::string SidecarPath(const std::string &path);
+
+  //  Hash of the rows of one month by their contents (the same for equal
+  //  rows in any version of the book, or in another run)
+  static uint64_t HashPage(const LedgerPage &page, const StringTable &strings, uint64_t seed = 0);
+
+private:
+  struct Month {
+    uint64_t hash;
+    RollupTotals totals;
+    std::map<std::string, std::pair<int64_t, int64_t> > cards;  //  early, late
+    Month() : hash(0) {}
+  };
+  struct Book {
+    uint64_t fileHash;  //  0 if unknown
+    std::map<int, Month> months;
+    Book() : fileHash(0) {}
+  };
+  RollupCache() {}
+  Book &Load(const std::string &path);
+  bool Save(const std::string &path, const Book &book);
+  static json ToResult(const Book &book);
+  std::mutex m_mutex;
+  std::map<std::string, Book> m_books;  //  Key is the path of kakeibo.csv
+};
+
+#endif // ROLLUPCACHE_H
@@ -0,0 +1,398 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "SaveScheduler.h"
+#include "Metrics.h"
+#include "Hash.h"
+#include "ShardedBook.h"
+#include "LedgerLog.h"
+#include "Logger.h"
+
+#include <chrono>
+#if defined(__WXMSW__)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static uint64_t
+nowMs(void)
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//  Write to a temporary file and rename it, so that a crash during the write
+//  never leaves a truncated file.
+static bool
+writeFileAtomically(const std::string &path, const std::string &text)
+{
+  wxString wpath(path.c_str(), *wxConvFileName);
+  wxString wtemp = wpath + wxT(".saving");
+  {
+    wxFFile file(wtemp, "wt");
+    if (!file.IsOpened())
+      return false;
+    if (file.Write(text.data(), text.size()) != text.size() || !file.Close()) {
+      ::wxRemoveFile(wtemp);
+      return false;
+    }
+  }
+  return ::wxRenameFile(wtemp, wpath, true);
+}
+
+static bool
+linkFile(const wxString &from, const wxString &to)
+{
+#if defined(__WXMSW__)
+  return ::CreateHardLinkW(to.wc_str(), from.wc_str(), NULL) != 0;
+#else
+  return ::link(from.fn_str(), to.fn_str()) == 0;
+#endif
+}
+
+SaveScheduler &
+SaveScheduler::Get()
+{
+  static SaveScheduler sInstance;
+  return sInstance;
+}
+
+SaveScheduler::SaveScheduler()
+  : m_thread(nullptr), m_generation(0), m_delay(500), m_interval(2000), m_stopping(false), m_writing(false)
+{
+}
+
+void
+SaveScheduler::Start()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_thread != nullptr)
+    return;
+  m_stopping = false;
+  m_thread = new std::thread(&SaveScheduler::Run, this);
+}
+
+void
+SaveScheduler::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_cond.notify_all();
+  if (m_thread != nullptr) {
+    if (m_thread->joinable())
+      m_thread->join();
+    delete m_thread;
+    m_thread = nullptr;
+  }
+  Flush();
+}
+
+void
+SaveScheduler::SetTiming(int delayMs, int intervalMs)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (delayMs >= 0)
+      m_delay = delayMs;
+    if (intervalMs >= 0)
+      m_interval = intervalMs;
+  }
+  m_cond.notify_all();
+}
+
+uint64_t
+SaveScheduler::Schedule(const std::string &path, const std::string &text)
+{
+  uint64_t gen;
+  uint64_t hash = xxh64(text.data(), text.size());
+  time_t mtime = bookModificationTime(path);
+  bool same;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &e = m_entries[path];
+    uint64_t now = nowMs();
+    e.generation = gen = ++m_generation;
+    //  Identical to the file (which nobody else has modified): nothing to
+    //  write, and the text pending so far (if any) is dropped
+    same = (e.onDisk && !e.writing && e.diskHash == hash && e.diskSize == text.size() && e.diskMtime == mtime);
+    if (same) {
+      if (e.dirty)
+        metricsAdd("save.coalesced");
+      e.dirty = false;
+      std::string().swap(e.text);
+      e.savedGeneration = gen;
+    } else {
+      if (e.dirty) {
+        metricsAdd("save.coalesced");  //  The previous text is never written
+      } else {
+        e.dirty = true;
+        e.firstDirtyMs = now;
+      }
+      e.text = text;
+      e.textHash = hash;
+    }
+    e.lastScheduleMs = now;
+  }
+  metricsAdd("save.scheduled");
+  metricsAdd("save.bytesScheduled", (int64_t)text.size());
+  if (same) {
+    metricsAdd("save.skipped");
+    metricsAdd("save.bytesAvoided", (int64_t)text.size());
+  } else {
+    m_cond.notify_all();
+  }
+  return gen;
+}
+
+bool
+SaveScheduler::PendingText(const std::string &path, std::string &text)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<std::string, Entry>::const_iterator it = m_entries.find(path);
+  if (it == m_entries.end() || it->second.generation <= it->second.savedGeneration)
+    return false;
+  text = it->second.text;
+  return true;
+}
+
+void
+SaveScheduler::SetDiskContents(const std::string &path, const char *buf, size_t len)
+{
+  uint64_t hash = xxh64(buf, len);
+  time_t mtime = bookModificationTime(path);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry &e = m_entries[path];
+  if (e.writing)
+    return;
+  e.onDisk = true;
+  e.diskHash = hash;
+  e.diskSize = len;
+  e.diskMtime = mtime;
+}
+
+uint64_t
+SaveScheduler::SavedGeneration(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<std::string, Entry>::const_iterator it = m_entries.find(path);
+  return (it == m_entries.end() ? 0 : it->second.savedGeneration);
+}
+
+uint64_t
+SaveScheduler::Generation()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_generation;
+}
+
+//  The time when a dirty entry should be written
+uint64_t
+SaveScheduler::Deadline(const Entry &e)
+{
+  uint64_t t = e.lastScheduleMs + m_delay;
+  //  Do not postpone forever while the requests keep coming
+  if (t > e.firstDirtyMs + m_interval)
+    t = e.firstDirtyMs + m_interval;
+  if (t < e.lastWriteMs + m_interval)
+    t = e.lastWriteMs + m_interval;
+  return t;
+}
+
+//  Called with m_mutex held; the lock is released during the file operation.
+//  Only one thread writes at a time (the flusher, or the caller of Flush()),
+//  which is guaranteed by m_writing.
+bool
+SaveScheduler::WriteEntry(const std::string &path, std::unique_lock<std::mutex> &lock)
+{
+  std::map<std::string, Entry>::iterator it = m_entries.find(path);
+  if (it == m_entries.end() || !it->second.dirty)
+    return true;
+  std::string text = it->second.text;
+  uint64_t gen = it->second.generation;
+  uint64_t hash = it->second.textHash;
+  it->second.dirty = false;
+  it->second.writing = true;
+  lock.unlock();
+  bool ok;
+  if (LedgerLog::IsLogBook(path))
+    ok = LedgerLog::Get().Save(path, text);
+  else if (isShardedBook(path))
+    ok = writeShardedBook(path, text);
+  else
+    ok = writeFileAtomically(path, text);
+  time_t mtime = (ok ? bookModificationTime(path) : 0);
+  lock.lock();
+  it = m_entries.find(path);
+  Entry &e = it->second;
+  e.lastWriteMs = nowMs();
+  e.writing = false;
+  e.onDisk = ok;
+  if (ok) {
+    e.diskHash = hash;
+    e.diskSize = text.size();
+    e.diskMtime = mtime;
+    if (e.savedGeneration < gen)
+      e.savedGeneration = gen;
+    if (e.generation == gen)
+      std::string().swap(e.text);  //  Written: no need to keep the text
+    metricsAdd("save.written");
+    metricsAdd("save.bytesWritten", (int64_t)text.size());
+    if (m_written) {
+      WrittenHandler handler = m_written;
+      lock.unlock();
+      handler(path, text);
+      lock.lock();
+    }
+  } else {
+    //  Try again later
+    if (!e.dirty) {
+      e.dirty = true;
+      e.firstDirtyMs = e.lastWriteMs;
+    }
+    metricsAdd("save.failed");
+    LOG_ERROR("Cannot write %s (will retry)", path.c_str());
+  }
+  return ok;
+}
+
+void
+SaveScheduler::SetWrittenHandler(WrittenHandler handler)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_written = handler;
+}
+
+bool
+SaveScheduler::Flush(const std::string &path)
+{
+  bool ok = true;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_writing)
+    m_cond.wait(lock);
+  m_writing = true;
+  if (path.empty()) {
+    std::map<std::string, Entry>::iterator it;
+    for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+      if (it->second.dirty) {
+        std::string p = it->first;
+        if (!WriteEntry(p, lock))
+          ok = false;
+        it = m_entries.find(p);
+      }
+    }
+  } else {
+    ok = WriteEntry(path, lock);
+  }
+  m_writing = false;
+  lock.unlock();
+  m_cond.notify_all();
+  return ok;
+}
+
+bool
+SaveScheduler::Backup(const std::string &path, const std::string &backup, bool *linked)
+{
+  if (linked != NULL)
+    *linked = false;
+  wxString wpath(path.c_str(), *wxConvFileName);
+  wxString wbackup(backup.c_str(), *wxConvFileName);
+  if (!Flush(path))
+    return false;
+  if (wxFileExists(wbackup))
+    return true;
+  //  No write may replace the file while the link is made
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_writing)
+    m_cond.wait(lock);
+  m_writing = true;
+  lock.unlock();
+  bool ok;
+  if (bookLayoutOf(path) != "single") {
+    //  The backup is a single file all the same
+    FileBlobPtr blob = openBookFile(path);
+    ok = (blob && writeFileAtomically(backup, std::string(blob->Data(), blob->Size())));
+    metricsAdd(ok ? "backup.copied" : "backup.failed");
+  } else {
+    ok = linkFile(wpath, wbackup);
+    if (ok) {
+      wxFFile file(wpath, "rb");
+      metricsAdd("backup.linked");
+      if (file.IsOpened())
+        metricsAdd("backup.bytesAvoided", (int64_t)file.Length());
+      if (linked != NULL)
+        *linked = true;
+    } else {
+      ok = ::wxCopyFile(wpath, wbackup, false);
+      metricsAdd(ok ? "backup.copied" : "backup.failed");
+    }
+  }
+  lock.lock();
+  m_writing = false;
+  lock.unlock();
+  m_cond.notify_all();
+  return ok;
+}
+
+bool
+SaveScheduler::RunExclusive(const std::string &path, std::function<bool()> fn)
+{
+  if (!Flush(path))
+    return false;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_writing)
+    m_cond.wait(lock);
+  m_writing = true;
+  lock.unlock();
+  bool ok = fn();
+  lock.lock();
+  m_writing = false;
+  lock.unlock();
+  m_cond.notify_all();
+  return ok;
+}
+
+void
+SaveScheduler::Run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stopping) {
+    uint64_t now = nowMs();
+    uint64_t next = UINT64_MAX;
+    std::string due;
+    std::map<std::string, Entry>::const_iterator it;
+    for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+      if (!it->second.dirty)
+        continue;
+      uint64_t d = Deadline(it->second);
+      if (d <= now) {
+        due = it->first;
+        break;
+      }
+      if (d < next)
+        next = d;
+    }
+    if (!due.empty() && !m_writing) {
+      m_writing = true;
+      WriteEntry(due, lock);
+      m_writing = false;
+      m_cond.notify_all();
+      continue;
+    }
+    if (next == UINT64_MAX || m_writing)
+      m_cond.wait(lock);
+    else
+      m_cond.wait_for(lock, std::chrono::milliseconds(next - now));
+  }
+}
@@ -0,0 +1,107 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef SAVESCHEDULER_H
+#define SAVESCHEDULER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+//  Coalesces the save requests from the clients.
+//  Schedule() only records the latest text for the path and marks it dirty.
+//  A single flusher thread writes each dirty file when no new request has
+//  come for m_delay msec, but no more often than once per m_interval msec.
+//  Every request gets a generation number; the generation of the last text
+//  actually written is reported back, so that the client can tell whether
+//  its edit is already on disk.
+//  The hash of the contents last written (or read) is remembered for each
+//  file, and a text identical to the file is not written again.
+class SaveScheduler
+{
+public:
+  static SaveScheduler &Get();
+
+  void Start();
+  void Stop();    //  Flush everything and terminate the flusher thread
+
+  //  Returns the generation number given to this request
+  uint64_t Schedule(const std::string &path, const std::string &text);
+
+  //  Write the pending text now (all paths if path is empty)
+  bool Flush(const std::string &path = "");
+
+  //  The text not yet written to disk (returns false if none)
+  bool PendingText(const std::string &path, std::string &text);
+
+  //  Tell that text has just been read from the file
+  void SetDiskContents(const std::string &path, const char *buf, size_t len);
+
+  //  Make a backup of the file (after writing the pending text) as a hard
+  //  link, or a copy if the file system does not support links. The backup
+  //  keeps the contents, as the file is always replaced by rename.
+  //  Nothing is done if the backup already exists.
+  bool Backup(const std::string &path, const std::string &backup, bool *linked = NULL);
+
+  //  Write the pending text, then call fn while no write can take place
+  //  (e.g. to change the layout of the file); returns what fn returns
+  bool RunExclusive(const std::string &path, std::function<bool()> fn);
+
+  uint64_t SavedGeneration(const std::string &path);
+  uint64_t Generation();
+
+  void SetTiming(int delayMs, int intervalMs);
+
+  //  Called (on the writing thread, without the lock) after a text is
+  //  written to the file
+  typedef std::function<void(const std::string &path, const std::string &text)> WrittenHandler;
+  void SetWrittenHandler(WrittenHandler handler);
+
+private:
+  struct Entry {
+    std::string text;
+    bool dirty;
+    uint64_t generation;       //  Generation of text
+    uint64_t savedGeneration;  //  Generation of the text last written
+    uint64_t firstDirtyMs;     //  When the entry became dirty
+    uint64_t lastScheduleMs;   //  When the last request came
+    uint64_t lastWriteMs;      //  When the file was last written
+    uint64_t textHash;         //  xxh64 of text
+    bool writing;              //  WriteEntry() is writing this file
+    bool onDisk;               //  The file contents are known:
+    uint64_t diskHash;         //    their hash and size, and the
+    size_t diskSize;           //    modification time when the file
+    time_t diskMtime;          //    was written or read
+    Entry() : dirty(false), generation(0), savedGeneration(0),
+      firstDirtyMs(0), lastScheduleMs(0), lastWriteMs(0), textHash(0),
+      writing(false), onDisk(false), diskHash(0), diskSize(0), diskMtime(0) {}
+  };
+
+  SaveScheduler();
+  void Run();
+  uint64_t Deadline(const Entry &e);
+  bool WriteEntry(const std::string &path, std::unique_lock<std::mutex> &lock);
+
+  std::map<std::string, Entry> m_entries;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread *m_thread;
+  uint64_t m_generation;
+  int m_delay;
+  int m_interval;
+  bool m_stopping;
+  bool m_writing;
+  WrittenHandler m_written;
+};
+
+#endif // SAVESCHEDULER_H
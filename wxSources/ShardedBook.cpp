@@ -0,0 +1,499 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "ShardedBook.h"
+#include "KakeiboParser.h"
+#include "KakeiboWriter.h"
+#include "DirList.h"
+#include "Metrics.h"
+#include "Hash.h"
+#include "LedgerLog.h"
+
+#include <set>
+#include <vector>
+
+#if defined(_WIN32)
+static const char kSep = '\\';
+#else
+static const char kSep = '/';
+#endif
+
+static const char *kFormat = "kakeibo-sharded";
+
+struct Segment {
+  std::string key;
+  std::string text;
+  size_t rows;
+  Segment() : rows(0) {}
+};
+
+static wxString
+toWx(const std::string &path)
+{
+  return wxString(path.c_str(), *wxConvFileName);
+}
+
+//  Binary, so that the checksums hold on every platform
+bool
+writeFileBinary(const std::string &path, const std::string &data)
+{
+  wxString wpath = toWx(path);
+  wxString wtemp = wpath + wxT(".saving");
+  {
+    wxFFile file(wtemp, "wb");
+    if (!file.IsOpened())
+      return false;
+    if (file.Write(data.data(), data.size()) != data.size() || !file.Close()) {
+      ::wxRemoveFile(wtemp);
+      return false;
+    }
+  }
+  return ::wxRenameFile(wtemp, wpath, true);
+}
+
+std::string
+shardDirOf(const std::string &path)
+{
+  return path + ".d";
+}
+
+std::string
+shardManifestOf(const std::string &path)
+{
+  return shardDirOf(path) + kSep + "manifest.json";
+}
+
+bool
+isShardedBook(const std::string &path)
+{
+  return wxFileExists(toWx(shardManifestOf(path)));
+}
+
+static bool
+loadManifest(const std::string &path, json &manifest)
+{
+  FileBlobPtr blob = FileCache::Get().Open(shardManifestOf(path), false);
+  if (!blob)
+    return false;
+  manifest = json::parse(blob->Data(), blob->Data() + blob->Size(), nullptr, false);
+  return manifest.is_object() && manifest.contains("format") && manifest["format"] == kFormat
+    && manifest.contains("segments") && manifest["segments"].is_array();
+}
+
+//  The length of the line starting at p, including the newline
+static size_t
+lineLength(const std::string &text, size_t p)
+{
+  size_t e = text.find('\n', p);
+  return (e == std::string::npos ? text.size() : e + 1) - p;
+}
+
+//  Whether the line is "[data]" (trimmed, as the parser does)
+static bool
+isDataHeader(const char *p, size_t len)
+{
+  while (len > 0 && (*p == ' ' || *p == '\t'))
+    p++, len--;
+  while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r' || p[len - 1] == ' ' || p[len - 1] == '\t'))
+    len--;
+  return len == 6 && memcmp(p, "[data]", 6) == 0;
+}
+
+//  The segment key of a data line ("" if the line has no date)
+static std::string
+segmentKey(const char *p, size_t len, int yearStart)
+{
+  while (len > 0 && (*p == ' ' || *p == '\t'))
+    p++, len--;
+  int ym = 0;
+  for (int i = 0; i < 6; i++) {
+    if ((size_t)i >= len || p[i] < '0' || p[i] > '9')
+      return std::string();
+    ym = ym * 10 + (p[i] - '0');
+  }
+  int year = ym / 100;
+  if (yearStart > 1 && ym % 100 < yearStart)
+    year--;
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%d", year);
+  return buf;
+}
+
+//  Split the text into the settings part (up to the [data] line) and the
+//  runs of the lines of each year. Lines without a date go with the run
+//  they are in (or the first run).
+static void
+splitBook(const std::string &text, int yearStart, std::string &head, std::vector<Segment> &segments)
+{
+  size_t p = 0;
+  while (p < text.size()) {
+    size_t len = lineLength(text, p);
+    bool found = isDataHeader(text.data() + p, len);
+    p += len;
+    if (found)
+      break;
+  }
+  head.assign(text, 0, p);
+  segments.clear();
+  std::set<std::string> seen;
+  bool contiguous = true;
+  while (p < text.size()) {
+    size_t len = lineLength(text, p);
+    std::string key = segmentKey(text.data() + p, len, yearStart);
+    if (segments.empty())
+      segments.push_back(Segment());
+    if (!key.empty() && segments.back().key != key) {
+      if (seen.count(key) != 0)
+        contiguous = false;
+      seen.insert(key);
+      //  A run of undated lines at the top goes with the first year
+      if (!segments.back().key.empty())
+        segments.push_back(Segment());
+      segments.back().key = key;
+    }
+    segments.back().text.append(text, p, len);
+    if (!key.empty())
+      segments.back().rows++;
+    p += len;
+  }
+  if (!contiguous || (segments.size() == 1 && segments[0].key.empty())) {
+    Segment all;
+    all.key = "all";
+    for (size_t i = 0; i < segments.size(); i++) {
+      all.text += segments[i].text;
+      all.rows += segments[i].rows;
+    }
+    segments.assign(1, all);
+  }
+}
+
+//  The settings as writeKakeibo() writes them, up to the [data] line
+static std::string
+settingsText(const Ledger &ledger)
+{
+  Ledger settings;
+  settings.incomeKinds = ledger.incomeKinds;
+  settings.paymentKinds = ledger.paymentKinds;
+  settings.cards = ledger.cards;
+  std::string text;
+  writeKakeibo(settings, ExportFilter(), [&text](const char *p, size_t len) -> bool {
+    text.append(p, len);
+    return true;
+  });
+  return text;
+}
+
+//  The settings into the manifest: as the lists if the text is what
+//  writeKakeibo() would make of them, verbatim otherwise
+static void
+putSettings(json &manifest, const std::string &head)
+{
+  Ledger ledger;
+  if (!head.empty() && parseKakeibo(head.data(), head.size(), ledger) && settingsText(ledger) == head) {
+    manifest["incomeKinds"] = ledger.incomeKinds;
+    manifest["paymentKinds"] = ledger.paymentKinds;
+    json cards = json::array();
+    for (size_t i = 0; i < ledger.cards.size(); i++) {
+      json card;
+      card["name"] = ledger.cards[i].name;
+      card["closing"] = ledger.cards[i].closing;
+      cards.push_back(card);
+    }
+    manifest["cards"] = cards;
+  } else {
+    manifest["head"] = head;
+  }
+}
+
+static void
+getStrings(const json &manifest, const char *key, std::vector<std::string> &list)
+{
+  if (manifest.contains(key) && manifest[key].is_array()) {
+    for (const json &s : manifest[key])
+      if (s.is_string())
+        list.push_back(s.get<std::string>());
+  }
+}
+
+static std::string
+getSettings(const json &manifest)
+{
+  if (manifest.contains("head") && manifest["head"].is_string())
+    return manifest["head"].get<std::string>();
+  Ledger ledger;
+  getStrings(manifest, "incomeKinds", ledger.incomeKinds);
+  getStrings(manifest, "paymentKinds", ledger.paymentKinds);
+  if (manifest.contains("cards") && manifest["cards"].is_array()) {
+    for (const json &c : manifest["cards"]) {
+      LedgerCard card;
+      card.name = (c.contains("name") && c["name"].is_string() ? c["name"].get<std::string>() : "");
+      card.closing = (c.contains("closing") && c["closing"].is_number_integer() ? c["closing"].get<int>() : 0);
+      ledger.cards.push_back(card);
+    }
+  }
+  return settingsText(ledger);
+}
+
+bool
+readShardedBook(const std::string &path, std::string &text, std::string *error)
+{
+  json manifest;
+  if (!loadManifest(path, manifest)) {
+    if (error != NULL)
+      *error = "cannot read the manifest";
+    return false;
+  }
+  std::string dir = shardDirOf(path);
+  text = getSettings(manifest);
+  for (const json &seg : manifest["segments"]) {
+    std::string file = (seg.contains("file") && seg["file"].is_string() ? seg["file"].get<std::string>() : "");
+    uint64_t hash = (seg.contains("xxh64") && seg["xxh64"].is_string() ? strtoull(seg["xxh64"].get<std::string>().c_str(), NULL, 16) : 0);
+    FileBlobPtr blob = (file.empty() ? FileBlobPtr() : FileCache::Get().Open(dir + kSep + file, false));
+    if (!blob || xxh64(blob->Data(), blob->Size()) != hash) {
+      metricsAdd("shard.checksumErrors");
+      if (error != NULL)
+        *error = (blob ? "checksum mismatch: " : "missing segment: ") + file;
+      return false;
+    }
+    text.append(blob->Data(), blob->Size());
+  }
+  metricsAdd("shard.reads");
+  return true;
+}
+
+bool
+writeShardedBook(const std::string &path, const std::string &text, int yearStart)
+{
+  std::string dir = shardDirOf(path);
+  if (!wxDirExists(toWx(dir)) && !wxFileName::Mkdir(toWx(dir), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+    return false;
+
+  //  The segments of the current version are kept as they are
+  std::set<std::string> current;
+  json old;
+  if (loadManifest(path, old)) {
+    for (const json &seg : old["segments"])
+      if (seg.contains("file") && seg["file"].is_string())
+        current.insert(seg["file"].get<std::string>());
+    if (yearStart <= 0 && old.contains("yearStart") && old["yearStart"].is_number_integer())
+      yearStart = old["yearStart"].get<int>();
+  }
+  if (yearStart < 1 || yearStart > 12)
+    yearStart = 1;
+
+  std::string head;
+  std::vector<Segment> segments;
+  splitBook(text, yearStart, head, segments);
+  json manifest;
+  manifest["format"] = kFormat;
+  manifest["version"] = 1;
+  manifest["yearStart"] = yearStart;
+  putSettings(manifest, head);
+  json list = json::array();
+  std::set<std::string> files;
+  for (size_t i = 0; i < segments.size(); i++) {
+    const Segment &s = segments[i];
+    std::string hash = hashToString(xxh64(s.text.data(), s.text.size()));
+    std::string file = s.key + "-" + hash + ".csv";
+    if (current.count(file) != 0 && wxFileExists(toWx(dir + kSep + file))) {
+      metricsAdd("shard.segmentsKept");
+      metricsAdd("shard.bytesAvoided", (int64_t)s.text.size());
+    } else {
+      if (!writeFileBinary(dir + kSep + file, s.text))
+        return false;
+      metricsAdd("shard.segmentsWritten");
+      metricsAdd("shard.bytesWritten", (int64_t)s.text.size());
+    }
+    json seg;
+    seg["key"] = s.key;
+    seg["file"] = file;
+    seg["size"] = s.text.size();
+    seg["rows"] = s.rows;
+    seg["xxh64"] = hash;
+    list.push_back(seg);
+    files.insert(file);
+  }
+  manifest["segments"] = list;
+  if (!writeFileBinary(shardManifestOf(path), manifest.dump(2) + "\n"))
+    return false;
+
+  //  Committed; remove the segments of the older versions
+  DirLister lister;
+  DirEntry e;
+  std::vector<std::string> garbage;
+  if (lister.Open(dir, "*.csv*")) {
+    while (lister.Next(e)) {
+      if (files.count(e.name) == 0)
+        garbage.push_back(e.name);
+    }
+    lister.Close();
+  }
+  for (size_t i = 0; i < garbage.size(); i++) {
+    if (::wxRemoveFile(toWx(dir + kSep + garbage[i])))
+      metricsAdd("shard.segmentsRemoved");
+  }
+  metricsAdd("shard.writes");
+  return true;
+}
+
+FileBlobPtr
+openBookFile(const std::string &path, std::string *error)
+{
+  std::string text;
+  if (LedgerLog::IsLogBook(path)) {
+    if (!LedgerLog::Get().Read(path, text, error))
+      return FileBlobPtr();
+  } else if (isShardedBook(path)) {
+    if (!readShardedBook(path, text, error))
+      return FileBlobPtr();
+  } else {
+    FileBlobPtr blob = FileCache::Get().Open(path, false);
+    if (!blob && error != NULL)
+      *error = "cannot read the file";
+    return blob;
+  }
+  return makeStringBlob(text);
+}
+
+time_t
+bookModificationTime(const std::string &path)
+{
+  if (LedgerLog::IsLogBook(path))
+    return LedgerLog::Get().ModificationTime(path);
+  if (isShardedBook(path))
+    return wxFileModificationTime(toWx(shardManifestOf(path)));
+  return wxFileModificationTime(toWx(path));
+}
+
+FileMeta
+bookStat(const std::string &path)
+{
+  FileMeta meta = StatCache::Get().Stat(path);
+  if (!meta.exists && path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+    FileMeta m = StatCache::Get().Stat(shardManifestOf(path));
+    if (!m.exists) {
+      m = StatCache::Get().Stat(LedgerLog::DirOf(path));
+      m.isDir = false;
+      //  An append does not touch the directory
+      if (m.exists)
+        m.mtime = (int64_t)LedgerLog::Get().ModificationTime(path);
+    }
+    if (m.exists && !m.isDir)
+      meta = m;
+  }
+  return meta;
+}
+
+//  Remove the files of the layout and the directory
+static void
+removeLayoutDir(const std::string &dir)
+{
+  std::vector<std::string> names;
+  DirLister lister;
+  DirEntry e;
+  if (lister.Open(dir)) {
+    while (lister.Next(e)) {
+      if (strcmp(e.type, "file") == 0)
+        names.push_back(e.name);
+    }
+    lister.Close();
+  }
+  for (size_t i = 0; i < names.size(); i++)
+    ::wxRemoveFile(toWx(dir + kSep + names[i]));
+  ::wxRmdir(toWx(dir));
+  StatCache::Get().Invalidate(dir);
+}
+
+static void
+removeLayout(const std::string &path, const std::string &layout)
+{
+  if (layout == "log") {
+    removeLayoutDir(LedgerLog::DirOf(path));
+    LedgerLog::Get().Forget(path);
+  } else if (layout == "sharded") {
+    removeLayoutDir(shardDirOf(path));
+  } else {
+    ::wxRemoveFile(toWx(path));
+  }
+  StatCache::Get().Invalidate(path);
+}
+
+std::string
+bookLayoutOf(const std::string &path)
+{
+  if (LedgerLog::IsLogBook(path))
+    return "log";
+  if (isShardedBook(path))
+    return "sharded";
+  return "single";
+}
+
+bool
+setBookLayout(const std::string &path, const std::string &layout, int yearStart, std::string *error)
+{
+  std::string from = bookLayoutOf(path);
+  if (layout != "single" && layout != "sharded" && layout != "log") {
+    if (error != NULL)
+      *error = "unknown layout: " + layout;
+    return false;
+  }
+  if (from == layout && layout != "sharded")
+    return true;
+  FileBlobPtr blob = openBookFile(path, error);
+  if (!blob)
+    return false;
+  std::string text(blob->Data(), blob->Size());
+
+  //  Write the new layout beside the old one (for sharded to sharded, the
+  //  manifest is replaced with the new yearStart as usual), and read it back
+  bool ok;
+  std::string check;
+  if (layout == "log") {
+    ok = LedgerLog::Get().Create(path, text, error) && LedgerLog::Get().Read(path, check, error);
+  } else if (layout == "sharded") {
+    ok = writeShardedBook(path, text, (yearStart < 1 ? 1 : yearStart)) && readShardedBook(path, check, error);
+  } else {
+    ok = writeFileBinary(path, text);
+    FileBlobPtr b = (ok ? FileCache::Get().Open(path, false) : FileBlobPtr());
+    ok = (b != NULL);
+    if (ok)
+      check.assign(b->Data(), b->Size());
+  }
+  if (!ok || check != text) {
+    if (error != NULL && error->empty())
+      *error = "the new layout does not reproduce the book";
+    if (from != layout)
+      removeLayout(path, layout);
+    return false;
+  }
+  if (from != layout)
+    removeLayout(path, from);
+  StatCache::Get().Invalidate(path);
+  metricsAdd("layout.converted");
+  return true;
+}
+
+json
+bookLayoutInfo(const std::string &path)
+{
+  json res;
+  json manifest;
+  std::string layout = bookLayoutOf(path);
+  if (layout == "log") {
+    res = LedgerLog::Get().Info(path);
+  } else if (layout == "sharded" && loadManifest(path, manifest)) {
+    res["yearStart"] = (manifest.contains("yearStart") ? manifest["yearStart"] : json(1));
+    res["segments"] = manifest["segments"];
+  }
+  res["layout"] = layout;
+  return res;
+}
@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHARDEDBOOK_H
+#define SHARDEDBOOK_H
+
+//  Optional on-disk layout of a book, where the rows of each year live in
+//  a segment file of their own. For kakeibo.csv, the directory
+//  kakeibo.csv.d holds manifest.json and the segments:
+//
+//    { "format": "kakeibo-sharded", "version": 1, "yearStart": 1,
+//      "incomeKinds": [...], "paymentKinds": [...], "cards": [{name, closing}],
+//      "segments": [{"key": "2025", "file": "2025-<xxh64>.csv",
+//                    "size": n, "rows": n, "xxh64": "<16 hex digits>"}, ...] }
+//
+//  The text of the book is the settings (as writeKakeibo() puts them,
+//  or "head" verbatim if the file had them differently) followed by the
+//  segments in the order of the manifest, so that it is always exactly the
+//  text that was saved. The key of a segment is the year, or with
+//  yearStart > 1 the fiscal year named by the year it starts in. If the
+//  years are not in one run each (a file edited by hand), all the rows
+//  go to a single segment "all".
+//
+//  A segment file is named by its hash and never rewritten: a save writes
+//  only the segments that changed, then replaces the manifest by rename,
+//  which is the moment the new version takes over; the segments no longer
+//  listed are removed after that. The checksums are verified on reading.
+//
+//  The rest of the server goes through openBookFile(), bookStat() and
+//  bookModificationTime(), which handle every layout (also the log of
+//  LedgerLog.h), and SaveScheduler writes in the layout of the book; so
+//  the client still
+//  reads and saves one kakeibo.csv text, and backups and exports are
+//  single files as before.
+
+#include <time.h>
+#include <string>
+#include "Json.h"
+#include "FileCache.h"
+#include "StatCache.h"
+
+//  Whether path (kakeibo.csv) is stored in the sharded layout
+bool isShardedBook(const std::string &path);
+
+//  path + ".d", and the manifest in it
+std::string shardDirOf(const std::string &path);
+std::string shardManifestOf(const std::string &path);
+
+//  The text of the book in either layout (NULL on failure)
+FileBlobPtr openBookFile(const std::string &path, std::string *error = NULL);
+
+//  Modification time of the file, or of the manifest (0 if none)
+time_t bookModificationTime(const std::string &path);
+
+//  StatCache::Stat(path), but a sharded or log book is reported with the
+//  metadata of its manifest or directory (and the mtime of its log)
+FileMeta bookStat(const std::string &path);
+
+//  Write to a temporary file and rename it (binary, unlike SaveScheduler)
+bool writeFileBinary(const std::string &path, const std::string &data);
+
+//  Read and write a sharded book. yearStart 0 keeps that of the manifest.
+bool readShardedBook(const std::string &path, std::string &text, std::string *error = NULL);
+bool writeShardedBook(const std::string &path, const std::string &text, int yearStart = 0);
+
+//  "single", "sharded" or "log" (see LedgerLog.h)
+std::string bookLayoutOf(const std::string &path);
+
+//  Convert the book to the layout. The new layout is read back and
+//  compared before the old one is removed. yearStart is the first month of
+//  the year for the segments (1 for the calendar year); a sharded book may
+//  be converted to sharded to change it.
+bool setBookLayout(const std::string &path, const std::string &layout, int yearStart, std::string *error = NULL);
+
+//  {layout, yearStart, segments: [...]} for sharded,
+//  {layout, generation, logBytes, deadBytes, months} for log
+json bookLayoutInfo(const std::string &path);
+
+#endif // SHARDEDBOOK_H
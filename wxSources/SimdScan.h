@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef SIMDSCAN_H
+#define SIMDSCAN_H
+
+//  Find the first occurrence of any of three bytes.
+//  Used by the CSV tokenizers to skip over the ordinary characters in bulk.
+//  AVX2 is used when the compiler targets it (-mavx2), SSE2 on x86_64 and
+//  NEON on arm64; otherwise a plain loop.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMDSCAN_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMDSCAN_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMDSCAN_NEON 1
+#endif
+
+static inline const char *
+scanForScalar(const char *p, const char *end, char c1, char c2, char c3)
+{
+  while (p < end) {
+    char c = *p;
+    if (c == c1 || c == c2 || c == c3)
+      return p;
+    p++;
+  }
+  return end;
+}
+
+//  Returns end if none is found
+static inline const char *
+scanFor(const char *p, const char *end, char c1, char c2, char c3)
+{
+#if SIMDSCAN_AVX2
+  const __m256i v1 = _mm256_set1_epi8(c1), v2 = _mm256_set1_epi8(c2), v3 = _mm256_set1_epi8(c3);
+  while (end - p >= 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, v1), _mm256_cmpeq_epi8(x, v2)), _mm256_cmpeq_epi8(x, v3));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+#elif SIMDSCAN_SSE2
+  const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2), v3 = _mm_set1_epi8(c3);
+  while (end - p >= 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, v1), _mm_cmpeq_epi8(x, v2)), _mm_cmpeq_epi8(x, v3));
+    unsigned mask = (unsigned)_mm_movemask_epi8(m);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#elif SIMDSCAN_NEON
+  const uint8x16_t v1 = vdupq_n_u8((uint8_t)c1), v2 = vdupq_n_u8((uint8_t)c2), v3 = vdupq_n_u8((uint8_t)c3);
+  while (end - p >= 16) {
+    uint8x16_t x = vld1q_u8((const uint8_t *)p);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(x, v1), vceqq_u8(x, v2)), vceqq_u8(x, v3));
+    if (vmaxvq_u8(m) != 0)
+      return scanForScalar(p, p + 16, c1, c2, c3);
+    p += 16;
+  }
+#endif
+  return scanForScalar(p, end, c1, c2, c3);
+}
+
+#endif // SIMDSCAN_H
@@ -0,0 +1,228 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "StatCache.h"
+#include "Metrics.h"
+#include "mongoose.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if defined(_WIN32)
+static const char kSep = '\\';
+#else
+static const char kSep = '/';
+#endif
+
+#if defined(__linux__)
+static const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY
+  | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+static FileMeta
+statPath(const std::string &path)
+{
+  FileMeta meta;
+  size_t size = 0;
+  time_t mtime = 0;
+  int flags = mg_fs_posix.st(path.c_str(), &size, &mtime);
+  if (flags != 0) {
+    meta.exists = true;
+    meta.isDir = ((flags & MG_FS_DIR) != 0);
+    meta.size = (int64_t)size;
+    meta.mtime = (int64_t)mtime;
+  }
+  return meta;
+}
+
+StatCache &
+StatCache::Get()
+{
+  static StatCache sStatCache;
+  return sStatCache;
+}
+
+void
+StatCache::Start(const std::string &root)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_root = root;
+  ClearLocked();
+#if defined(__linux__)
+  if (m_fd < 0)
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+void
+StatCache::Stop()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ClearLocked();
+#if defined(__linux__)
+  if (m_fd >= 0)
+    ::close(m_fd);  //  Removes all the watches
+#endif
+  m_fd = -1;
+  m_root.clear();
+}
+
+//  Only the plain paths below the root, so that a path has one spelling
+//  (the events are mapped back to the paths by name)
+bool
+StatCache::IsCacheable(const std::string &path) const
+{
+  if (m_root.empty() || path.size() <= m_root.size() + 1
+      || path.compare(0, m_root.size(), m_root) != 0 || path[m_root.size()] != kSep
+      || path[path.size() - 1] == kSep)
+    return false;
+  std::string sep(1, kSep);
+  return path.find(sep + sep, m_root.size()) == std::string::npos
+    && path.find(sep + "." + sep, m_root.size()) == std::string::npos
+    && path.find(sep + ".." + sep, m_root.size()) == std::string::npos
+    && path.compare(path.size() - 2, 2, sep + ".") != 0
+    && (path.size() < 3 || path.compare(path.size() - 3, 3, sep + "..") != 0);
+}
+
+bool
+StatCache::Watch(const std::string &dir)
+{
+#if defined(__linux__)
+  if (m_watches.count(dir) > 0)
+    return true;
+  int wd = ::inotify_add_watch(m_fd, dir.c_str(), kWatchMask);
+  if (wd < 0)
+    return false;
+  std::map<int, std::string>::iterator it = m_dirs.find(wd);
+  if (it != m_dirs.end())
+    return it->second == dir;  //  Another name of a watched directory (symbolic link)
+  m_dirs[wd] = dir;
+  m_watches[dir] = wd;
+  metricsSet("statCache.watches", (int64_t)m_watches.size());
+#endif
+  return true;
+}
+
+//  Watch the root and every directory between it and the path
+bool
+StatCache::WatchParents(const std::string &path)
+{
+  if (m_fd < 0)
+    return true;
+  size_t pos = m_root.size();
+  while (pos != std::string::npos) {
+    if (!Watch(path.substr(0, pos)))
+      return false;
+    pos = path.find(kSep, pos + 1);
+  }
+  return true;
+}
+
+void
+StatCache::ReadEvents()
+{
+#if defined(__linux__)
+  if (m_fd < 0)
+    return;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while ((n = ::read(m_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      metricsAdd("statCache.events");
+      if (ev->mask & IN_Q_OVERFLOW) {
+        ClearLocked();  //  Events are lost
+        continue;
+      }
+      std::map<int, std::string>::iterator it = m_dirs.find(ev->wd);
+      if (it == m_dirs.end())
+        continue;  //  Already removed
+      std::string dir = it->second;
+      if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        InvalidateLocked(dir);
+        continue;
+      }
+      if (ev->len > 0)
+        InvalidateLocked(dir + kSep + ev->name);
+      m_entries.erase(dir);  //  The mtime of the directory has changed
+    }
+  }
+#endif
+}
+
+void
+StatCache::InvalidateLocked(const std::string &path)
+{
+  std::string below = path + kSep;
+  m_entries.erase(path);
+  std::map<std::string, Entry>::iterator it = m_entries.lower_bound(below);
+  while (it != m_entries.end() && it->first.compare(0, below.size(), below) == 0)
+    m_entries.erase(it++);
+#if defined(__linux__)
+  //  The watches below refer to the old names; they are made again on demand
+  std::map<std::string, int>::iterator w = m_watches.lower_bound(path);
+  while (w != m_watches.end() && (w->first == path || w->first.compare(0, below.size(), below) == 0)) {
+    ::inotify_rm_watch(m_fd, w->second);
+    m_dirs.erase(w->second);
+    m_watches.erase(w++);
+  }
+  metricsSet("statCache.watches", (int64_t)m_watches.size());
+#endif
+}
+
+void
+StatCache::ClearLocked()
+{
+  m_entries.clear();
+#if defined(__linux__)
+  for (std::map<int, std::string>::iterator it = m_dirs.begin(); it != m_dirs.end(); ++it)
+    ::inotify_rm_watch(m_fd, it->first);
+#endif
+  m_dirs.clear();
+  m_watches.clear();
+}
+
+FileMeta
+StatCache::Stat(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!IsCacheable(path)) {
+    metricsAdd("statCache.bypass");
+    return statPath(path);
+  }
+  ReadEvents();
+  uint64_t now = mg_millis();
+  std::map<std::string, Entry>::iterator it = m_entries.find(path);
+  if (it != m_entries.end()) {
+    if (m_fd >= 0 || now - it->second.millis < (uint64_t)kTTL * 1000) {
+      metricsAdd("statCache.hits");
+      return it->second.meta;
+    }
+    m_entries.erase(it);
+  }
+  metricsAdd("statCache.misses");
+  //  Watch before stat, so that no change after the stat goes unnoticed
+  bool watched = WatchParents(path);
+  FileMeta meta = statPath(path);
+  if (watched) {
+    Entry &e = m_entries[path];
+    e.meta = meta;
+    e.millis = now;
+  }
+  return meta;
+}
+
+void
+StatCache::Invalidate(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  InvalidateLocked(path);
+}
@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+//  Cache of the file metadata under ~/kakeibo, for the exists and stat
+//  commands (the client probes the same paths over and over). An entry is
+//  made on the first query of the path (also for a path that does not
+//  exist). On Linux, the directories from the root down to the parent of
+//  a cached path are watched with inotify, and the pending events are read
+//  before each lookup; so an entry is dropped as soon as the file, or any
+//  directory above it, is created, changed, moved or removed, by this
+//  process or by anyone else. Elsewhere the entries expire after kTTL
+//  seconds, and the commands of the client that change files invalidate
+//  the paths they touch.
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+struct FileMeta {
+  bool exists;
+  bool isDir;
+  int64_t size;
+  int64_t mtime;   //  Seconds since the epoch
+  FileMeta() : exists(false), isDir(false), size(0), mtime(0) {}
+};
+
+class StatCache
+{
+public:
+  static StatCache &Get();
+
+  //  Cache the paths below root (other paths are not cached)
+  void Start(const std::string &root);
+  void Stop();
+
+  FileMeta Stat(const std::string &path);
+
+  //  Drop the path and everything below it
+  void Invalidate(const std::string &path);
+
+  static const int kTTL = 2;
+
+private:
+  StatCache() : m_fd(-1) {}
+  struct Entry {
+    FileMeta meta;
+    uint64_t millis;   //  When it was made
+  };
+  bool IsCacheable(const std::string &path) const;
+  bool WatchParents(const std::string &path);
+  bool Watch(const std::string &dir);
+  void ReadEvents();
+  void InvalidateLocked(const std::string &path);
+  void ClearLocked();
+
+  std::mutex m_mutex;
+  std::string m_root;
+  std::map<std::string, Entry> m_entries;
+  int m_fd;                               //  inotify instance, or -1
+  std::map<int, std::string> m_dirs;      //  Watch descriptor -> directory
+  std::map<std::string, int> m_watches;   //  Directory -> watch descriptor
+};
+
+#endif // STATCACHE_H
@@ -0,0 +1,208 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+
+//  Index of the worker running on this thread (-1 if not a worker)
+static thread_local int tWorkerIndex = -1;
+
+ThreadPool &
+ThreadPool::Get()
+{
+  static ThreadPool sThreadPool;
+  return sThreadPool;
+}
+
+void
+ThreadPool::Start(int nthreads)
+{
+  if (!m_threads.empty())
+    return;
+  if (nthreads <= 0)
+    nthreads = (int)std::thread::hardware_concurrency();
+  if (nthreads <= 0)
+    nthreads = 2;
+  m_stopping = false;
+  for (int i = 0; i < nthreads; i++)
+    m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+  for (int i = 0; i < nthreads; i++)
+    m_threads.push_back(std::thread(&ThreadPool::Run, this, (size_t)i));
+  metricsSet("pool.threads", nthreads);
+}
+
+void
+ThreadPool::Stop()
+{
+  if (m_threads.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (size_t i = 0; i < m_threads.size(); i++)
+    m_threads[i].join();
+  m_threads.clear();
+  m_workers.clear();
+}
+
+//  A worker pushes to its own deque; other threads spread the tasks
+void
+ThreadPool::Push(std::function<void(void)> task)
+{
+  size_t n = m_workers.size();
+  size_t i = (tWorkerIndex >= 0 ? (size_t)tWorkerIndex : m_next++ % n);
+  {
+    //  Counted first, so that m_queued never goes below zero
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_queued++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_workers[i]->mutex);
+    m_workers[i]->tasks.push_back(task);
+  }
+  m_wake.notify_one();
+}
+
+//  Own deque first (newest), then steal from the others (oldest)
+bool
+ThreadPool::TakeTask(std::function<void(void)> &task)
+{
+  size_t n = m_workers.size();
+  if (n == 0)
+    return false;
+  if (tWorkerIndex >= 0) {
+    Worker &w = *m_workers[tWorkerIndex];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (!w.tasks.empty()) {
+      task = w.tasks.back();
+      w.tasks.pop_back();
+      m_queued--;
+      return true;
+    }
+  }
+  size_t start = (tWorkerIndex >= 0 ? (size_t)tWorkerIndex + 1 : m_next.load());
+  for (size_t k = 0; k < n; k++) {
+    Worker &w = *m_workers[(start + k) % n];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (!w.tasks.empty()) {
+      task = w.tasks.front();
+      w.tasks.pop_front();
+      m_queued--;
+      if (tWorkerIndex >= 0)
+        metricsAdd("pool.stolen");
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+ThreadPool::Run(size_t index)
+{
+  tWorkerIndex = (int)index;
+  while (1) {
+    std::function<void(void)> task;
+    if (TakeTask(task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    if (m_queued > 0)
+      continue;
+    if (m_stopping)
+      break;
+    m_wake.wait(lock);
+  }
+}
+
+void
+ThreadPool::Submit(std::function<void(void)> task)
+{
+  if (m_threads.empty()) {
+    std::thread(task).detach();  //  Not started (or already stopped)
+    return;
+  }
+  Push(task);
+}
+
+static int64_t
+nowUsec()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//  The indices are claimed from a counter of the group, by the caller and
+//  by up to NumThreads() helper tasks. The caller never runs other tasks of
+//  the pool while it waits: it may hold a lock, or thread-local state, that
+//  an unrelated task must not see. Once no index is left to claim, the
+//  remaining ones are already running on the workers, so waiting for them
+//  cannot deadlock (a nested ParallelFor runs its own indices in the same way).
+void
+ThreadPool::ParallelFor(size_t n, std::function<void(size_t)> fn)
+{
+  if (n == 0)
+    return;
+  if (n == 1 || m_threads.empty()) {
+    for (size_t i = 0; i < n; i++)
+      fn(i);
+    return;
+  }
+  //  Shared by the tasks, which may outlive this call by a moment
+  struct Group {
+    size_t n;
+    std::function<void(size_t)> fn;
+    std::atomic<size_t> next;
+    std::atomic<size_t> remaining;
+    std::atomic<int64_t> workUsec;   //  Time spent in fn, on all threads
+    std::mutex mutex;
+    std::condition_variable done;
+    void RunIndices() {
+      int64_t start = nowUsec();
+      size_t i;
+      while ((i = next++) < n) {
+        fn(i);
+        if (--remaining == 0) {
+          workUsec += nowUsec() - start;
+          std::lock_guard<std::mutex> lock(mutex);
+          done.notify_all();
+          return;
+        }
+      }
+      workUsec += nowUsec() - start;
+    }
+  };
+  int64_t start = nowUsec();
+  std::shared_ptr<Group> group = std::make_shared<Group>();
+  group->n = n;
+  group->fn = fn;
+  group->next = 0;
+  group->remaining = n;
+  group->workUsec = 0;
+  size_t helpers = std::min(n - 1, m_threads.size());
+  for (size_t k = 0; k < helpers; k++)
+    Push([group]() { group->RunIndices(); });
+  group->RunIndices();
+  if (group->remaining > 0) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    while (group->remaining > 0)
+      group->done.wait(lock);
+  }
+  //  Speedup = work / wall
+  int64_t wall = nowUsec() - start;
+  int64_t work = group->workUsec;
+  metricsAdd("pool.parallelFor");
+  metricsAdd("pool.parallelUsec", wall);
+  metricsAdd("pool.parallelWorkUsec", work);
+  if (wall > 0)
+    metricsSet("pool.lastSpeedupX100", work * 100 / wall);
+}
@@ -0,0 +1,65 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+//  Worker threads shared by the server (exports, reports, aggregation).
+//  Every worker has its own deque of tasks. A worker takes the newest task
+//  from its own deque and, when that is empty, steals the oldest task from
+//  another worker, so that a worker that finished early helps the others.
+class ThreadPool
+{
+public:
+  static ThreadPool &Get();
+
+  //  nthreads = 0: one thread per core
+  void Start(int nthreads = 0);
+  void Stop();    //  Finish the queued tasks and join the threads
+  size_t NumThreads() const { return m_threads.size(); }
+
+  //  Queue a task and return immediately
+  void Submit(std::function<void(void)> task);
+
+  //  Run fn(0) ... fn(n - 1) and wait for all of them. The calling thread
+  //  runs them too (but no other task of the pool), so this can be called
+  //  from within a task. If the pool is not running (or n == 1),
+  //  everything runs on the caller. The metrics pool.parallelUsec and
+  //  pool.parallelWorkUsec give the speedup (work / wall time).
+  void ParallelFor(size_t n, std::function<void(size_t)> fn);
+
+private:
+  struct Worker {
+    std::deque<std::function<void(void)> > tasks;
+    std::mutex mutex;
+  };
+  ThreadPool() : m_stopping(false), m_next(0), m_queued(0) {}
+  void Push(std::function<void(void)> task);
+  bool TakeTask(std::function<void(void)> &task);
+  void Run(size_t index);
+
+  std::vector<std::unique_ptr<Worker> > m_workers;
+  std::vector<std::thread> m_threads;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+  bool m_stopping;
+  std::atomic<size_t> m_next;    //  Round-robin for the tasks from outside
+  std::atomic<size_t> m_queued;  //  Tasks in all the deques
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,324 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "UndoJournal.h"
+#include "BookStore.h"
+#include "RollupCache.h"
+#include "Hash.h"
+#include "Metrics.h"
+
+
+UndoJournal &
+UndoJournal::Get()
+{
+  static UndoJournal sUndoJournal;
+  return sUndoJournal;
+}
+
+std::string
+UndoJournal::JournalPath(const std::string &book)
+{
+  size_t pos = book.find_last_of("/\\");
+  return (pos == std::string::npos ? std::string() : book.substr(0, pos + 1)) + "undo.journal";
+}
+
+json
+UndoJournal::StatusOf(const Journal &jr)
+{
+  json res;
+  res["canUndo"] = (jr.cursor > 0);
+  res["canRedo"] = (jr.cursor < jr.steps.size());
+  return res;
+}
+
+json
+UndoJournal::Fingerprint(const std::string &book, const json &ops)
+{
+  BookSnapshotPtr snap = BookStore::Get().Snapshot(book);
+  if (!snap || !ops.is_array())
+    return json();
+  const Ledger &ledger = *snap->ledger;
+  json res = json::object();
+  for (const json &op : ops) {
+    if (!op.is_object() || !op.contains("page") || !op["page"].is_number_integer())
+      continue;
+    int ym = op["page"].get<int>();
+    std::string key = std::to_string(ym);
+    if (res.contains(key))
+      continue;
+    LedgerMonths::const_iterator it = ledger.months.find(ym);
+    res[key] = (it == ledger.months.end() ? std::string("0") : hashToString(RollupCache::HashPage(*it->second, *ledger.strings)));
+  }
+  return res;
+}
+
+//  Whether the months of the book are still as in fingerprint
+bool
+UndoJournal::Matches(const std::string &book, const json &fingerprint)
+{
+  if (!fingerprint.is_object())
+    return false;  //  Not known (a step from an older journal, or the book was not loaded)
+  BookSnapshotPtr snap = BookStore::Get().Snapshot(book);
+  if (!snap)
+    return false;
+  const Ledger &ledger = *snap->ledger;
+  for (json::const_iterator it = fingerprint.begin(); it != fingerprint.end(); ++it) {
+    LedgerMonths::const_iterator mt = ledger.months.find(atoi(it.key().c_str()));
+    std::string hash = (mt == ledger.months.end() ? std::string("0") : hashToString(RollupCache::HashPage(*mt->second, *ledger.strings)));
+    if (!it.value().is_string() || it.value().get<std::string>() != hash)
+      return false;
+  }
+  return true;
+}
+
+void
+UndoJournal::AddStep(Journal &jr, const json &ops, const json &inverse, const json &before, const json &after)
+{
+  jr.steps.resize(jr.cursor);  //  Discard the redo steps
+  Step st;
+  st.seq = jr.nextSeq++;
+  st.ops = ops;
+  st.inverse = inverse;
+  st.before = before;
+  st.after = after;
+  jr.steps.push_back(st);
+  if (jr.steps.size() > kMaxSteps)
+    jr.steps.pop_front();
+  jr.cursor = jr.steps.size();
+}
+
+//  Read the journal file on the first access to the book
+UndoJournal::Journal &
+UndoJournal::Load(const std::string &book)
+{
+  std::map<std::string, Journal>::iterator it = m_journals.find(book);
+  if (it != m_journals.end())
+    return it->second;
+  Journal &jr = m_journals[book];
+  std::string path = JournalPath(book);
+  wxString wpath(path.c_str(), *wxConvFileName);
+  if (!wxFileName::FileExists(wpath))
+    return jr;
+  wxFFile file(wpath, "rt");
+  wxString contents;
+  if (!file.IsOpened() || !file.ReadAll(&contents, wxConvUTF8))
+    return jr;
+  std::string text = contents.ToStdString(wxConvUTF8);
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t eol = text.find('\n', pos);
+    if (eol == std::string::npos)
+      eol = text.size();
+    std::string line = text.substr(pos, eol - pos);
+    pos = eol + 1;
+    json j = json::parse(line, NULL, false);
+    if (j.is_discarded() || !j.is_object())
+      continue;  //  Possibly the last line written halfway
+    jr.lines++;
+    if (j.contains("do"))
+      AddStep(jr, j["do"], (j.contains("inverse") ? j["inverse"] : json::array()),
+              (j.contains("before") ? j["before"] : json()), (j.contains("after") ? j["after"] : json()));
+    else if (j.contains("undo") && jr.cursor > 0)
+      jr.cursor--;
+    else if (j.contains("redo") && jr.cursor < jr.steps.size())
+      jr.cursor++;
+  }
+  metricsAdd("undo.loaded");
+  return jr;
+}
+
+void
+UndoJournal::Append(const std::string &book, Journal &jr, const json &line)
+{
+  if (jr.lines + 1 > kMaxSteps * 2) {
+    Rewrite(book, jr);
+    return;
+  }
+  std::string path = JournalPath(book);
+  wxString wpath(path.c_str(), *wxConvFileName);
+  wxFFile file(wpath, "at");
+  if (!file.IsOpened()) {
+    metricsAdd("undo.failed");
+    return;
+  }
+  std::string s = line.dump() + "\n";
+  file.Write(s.data(), s.size());
+  file.Close();
+  jr.lines++;
+}
+
+//  Write the steps we still have (and the undone ones as "undo" lines)
+void
+UndoJournal::Rewrite(const std::string &book, Journal &jr)
+{
+  std::string s;
+  for (size_t i = 0; i < jr.steps.size(); i++) {
+    json line;
+    line["do"] = jr.steps[i].ops;
+    line["inverse"] = jr.steps[i].inverse;
+    line["before"] = jr.steps[i].before;
+    line["after"] = jr.steps[i].after;
+    s += line.dump() + "\n";
+  }
+  for (size_t i = jr.cursor; i < jr.steps.size(); i++)
+    s += "{\"undo\":1}\n";
+  std::string path = JournalPath(book);
+  wxString wpath(path.c_str(), *wxConvFileName);
+  wxString wtemp = wpath + wxT(".saving");
+  {
+    wxFFile file(wtemp, "wt");
+    if (!file.IsOpened() || file.Write(s.data(), s.size()) != s.size() || !file.Close()) {
+      ::wxRemoveFile(wtemp);
+      metricsAdd("undo.failed");
+      return;
+    }
+  }
+  ::wxRenameFile(wtemp, wpath, true);
+  jr.lines = jr.steps.size() * 2 - jr.cursor;
+  metricsAdd("undo.compacted");
+}
+
+//  The book does not match the history any more
+void
+UndoJournal::Discard(const std::string &book, Journal &jr)
+{
+  jr.steps.clear();
+  jr.cursor = 0;
+  Rewrite(book, jr);
+  metricsAdd("undo.stale");
+}
+
+json
+UndoJournal::Record(const std::string &book, const json &ops, const json &inverse,
+                    const json &before, const json &after)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Journal &jr = Load(book);
+  AddStep(jr, ops, inverse, before, after);
+  json line;
+  line["do"] = ops;
+  line["inverse"] = inverse;
+  line["before"] = before;
+  line["after"] = after;
+  Append(book, jr, line);
+  metricsAdd("undo.recorded");
+  return StatusOf(jr);
+}
+
+json
+UndoJournal::Undo(const std::string &book)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Journal &jr = Load(book);
+  json res;
+  if (jr.cursor > 0 && !Matches(book, jr.steps[jr.cursor - 1].after)) {
+    Discard(book, jr);
+    res = StatusOf(jr);
+    res["ops"] = json::array();
+    res["stale"] = true;
+  } else if (jr.cursor > 0) {
+    jr.cursor--;
+    res = StatusOf(jr);
+    res["ops"] = jr.steps[jr.cursor].inverse;
+    Append(book, jr, json({{"undo", 1}}));
+  } else {
+    res = StatusOf(jr);
+    res["ops"] = json::array();
+  }
+  return res;
+}
+
+json
+UndoJournal::Redo(const std::string &book)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Journal &jr = Load(book);
+  json res;
+  if (jr.cursor < jr.steps.size() && !Matches(book, jr.steps[jr.cursor].before)) {
+    Discard(book, jr);
+    res = StatusOf(jr);
+    res["ops"] = json::array();
+    res["stale"] = true;
+  } else if (jr.cursor < jr.steps.size()) {
+    json ops = jr.steps[jr.cursor].ops;
+    jr.cursor++;
+    res = StatusOf(jr);
+    res["ops"] = ops;
+    Append(book, jr, json({{"redo", 1}}));
+  } else {
+    res = StatusOf(jr);
+    res["ops"] = json::array();
+  }
+  return res;
+}
+
+json
+UndoJournal::Status(const std::string &book)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return StatusOf(Load(book));
+}
+
+json
+UndoJournal::Clear(const std::string &book)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Journal &jr = Load(book);
+  jr.steps.clear();
+  jr.cursor = 0;
+  Rewrite(book, jr);
+  return StatusOf(jr);
+}
+
+json
+UndoJournal::History(const std::string &book, size_t n)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Journal &jr = Load(book);
+  json res = StatusOf(jr);
+  json steps = json::array();
+  for (size_t i = jr.steps.size(); i > 0 && steps.size() < n; i--) {
+    const Step &st = jr.steps[i - 1];
+    json s;
+    s["seq"] = st.seq;
+    s["ops"] = st.ops;
+    s["undone"] = (i - 1 >= jr.cursor);
+    steps.push_back(s);
+  }
+  res["steps"] = steps;
+  return res;
+}
+
+std::vector<std::string>
+UndoJournal::LoadedBooks()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::string> books;
+  for (std::map<std::string, Journal>::iterator it = m_journals.begin(); it != m_journals.end(); ++it)
+    books.push_back(it->first);
+  return books;
+}
+
+bool
+UndoJournal::Compact(const std::string &book)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::map<std::string, Journal>::iterator it = m_journals.find(book);
+  if (it == m_journals.end())
+    return false;
+  Journal &jr = it->second;
+  size_t needed = jr.steps.size() * 2 - jr.cursor;  //  Lines after Rewrite()
+  if (jr.lines <= needed + kMaxSteps / 10)
+    return false;
+  Rewrite(book, jr);
+  return true;
+}
@@ -0,0 +1,101 @@
+/////////////////////////////////////////////////////////////////////////////
+// Purpose:     wxVueRunner Project
+// Author:      Toshi Nagata
+// Created:     2026/10/19
+// Copyright:   (c) 2026 Toshi Nagata
+// Licence:     GPL 3.0
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef UNDOJOURNAL_H
+#define UNDOJOURNAL_H
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <mutex>
+#include "Json.h"
+
+//  Undo history of the books, kept on the server.
+//  Each undo step is a group of operation records in the vocabulary of
+//  DataMethods ({op: "setValue", page, row, key, value} etc.), together
+//  with the records that revert them. The server only stores them; the
+//  client applies the records returned by Undo() and Redo().
+//
+//  A step also holds the content hashes of the months it touches, before
+//  and after it was done (see Fingerprint()). A step is undone only if the
+//  book in BookStore still has the "after" months, and redone only if it
+//  has the "before" ones; otherwise the book was changed by other means
+//  (an external edit, a backup restored, the data replaced) and the whole
+//  history is dropped instead, as the records address the rows by
+//  position.
+//
+//  The history of a book is kept in "undo.journal" in the same folder as
+//  the book, one JSON object per line:
+//    {"do": [ops], "inverse": [ops], "before": {...}, "after": {...}}
+//                                      a new step (discards the redo steps)
+//    {"undo": 1} / {"redo": 1}         the cursor moved
+//  Only the last kMaxSteps steps are kept, and the file is rewritten
+//  when it has grown to about twice that size.
+class UndoJournal
+{
+public:
+  static UndoJournal &Get();
+
+  //  book is the path of kakeibo.csv. Each call returns the status
+  //  {canUndo, canRedo} (and "ops" for Undo and Redo, with "stale": true
+  //  if the history was dropped)
+  json Record(const std::string &book, const json &ops, const json &inverse,
+              const json &before, const json &after);
+  json Undo(const std::string &book);
+  json Redo(const std::string &book);
+  json Status(const std::string &book);
+  json Clear(const std::string &book);
+
+  //  Last n steps (newest first) as {steps: [{seq, ops, undone}], ...status}
+  json History(const std::string &book, size_t n);
+
+  //  For the maintenance: the books whose journals are loaded, and rewriting
+  //  a journal file that has grown well beyond its steps (returns true if
+  //  it was rewritten)
+  std::vector<std::string> LoadedBooks();
+  bool Compact(const std::string &book);
+
+  //  Content hashes of the months that ops touch, in the book as it is in
+  //  BookStore: {"YYYYMM": "<hex>"} ("0" for a month that does not exist).
+  //  null if the book is not loaded.
+  static json Fingerprint(const std::string &book, const json &ops);
+
+private:
+  enum { kMaxSteps = 500 };
+  struct Step {
+    uint64_t seq;
+    json ops;
+    json inverse;
+    json before;        //  Fingerprint() before and after the step
+    json after;
+  };
+  struct Journal {
+    std::deque<Step> steps;
+    size_t cursor;      //  Number of steps that can be undone
+    uint64_t nextSeq;
+    size_t lines;       //  Number of lines in the file
+    Journal() : cursor(0), nextSeq(1), lines(0) {}
+  };
+
+  UndoJournal() {}
+  Journal &Load(const std::string &book);
+  void Append(const std::string &book, Journal &jr, const json &line);
+  void Rewrite(const std::string &book, Journal &jr);
+  void AddStep(Journal &jr, const json &ops, const json &inverse, const json &before, const json &after);
+  void Discard(const std::string &book, Journal &jr);
+  static bool Matches(const std::string &book, const json &fingerprint);
+  static std::string JournalPath(const std::string &book);
+  static json StatusOf(const Journal &jr);
+
+  std::map<std::string, Journal> m_journals;
+  std::mutex m_mutex;
+};
+
+#endif // UNDOJOURNAL_H